@@ -0,0 +1,127 @@
+// Hit ratio of EdgeCache's LRU and TinyLfu policies on replayed traces
+//
+//   make bench
+//   bench/cache_policy_bench [requests] [cache MB]
+//
+// Shoppers ask for product pages by a Zipf law over the catalog; crawlers
+// walk the catalog in order. Each request is a lookup, and a miss renders
+// and stores the page (4-12 KB). The shopper hit ratio is the one that
+// matters: the crawler's own hits are almost all misses under any policy.
+#include "rangoons.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+static const size_t CATALOG = 50000;
+
+struct Request {
+    uint32_t page;
+    bool crawler;
+};
+
+// Ranks 0..n-1 with P(rank) proportional to 1 / (rank + 1)^s
+class Zipf {
+public:
+    Zipf(size_t n, double s) : cdf(n) {
+        double sum = 0;
+        for (size_t i = 0; i < n; i++) cdf[i] = sum += 1.0 / std::pow((double)(i + 1), s);
+        for (double& c : cdf) c /= sum;
+    }
+
+    uint32_t operator()(std::mt19937_64& rng) {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        return (uint32_t)(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+    }
+
+private:
+    std::vector<double> cdf;
+};
+
+// crawl_share: fraction of requests from a crawler sweeping pages in
+// order. burst_every: additionally, a full sweep of the catalog back to
+// back every this many requests (0: none).
+static std::vector<Request> make_trace(size_t requests, double skew, double crawl_share, size_t burst_every) {
+    std::mt19937_64 rng(42);
+    Zipf zipf(CATALOG, skew);
+
+    // Popularity is unrelated to catalog order, as with real products
+    std::vector<uint32_t> page_of_rank(CATALOG);
+    std::iota(page_of_rank.begin(), page_of_rank.end(), 0);
+    std::shuffle(page_of_rank.begin(), page_of_rank.end(), rng);
+
+    std::vector<Request> trace;
+    trace.reserve(requests + (burst_every ? requests / burst_every * CATALOG : 0));
+    uint32_t crawl = 0;
+    std::bernoulli_distribution from_crawler(crawl_share);
+    for (size_t i = 0; i < requests; i++) {
+        if (burst_every && i > 0 && i % burst_every == 0) {
+            for (uint32_t page = 0; page < CATALOG; page++) trace.push_back({ page, true });
+        }
+        if (crawl_share > 0 && from_crawler(rng)) {
+            trace.push_back({ crawl, true });
+            crawl = (crawl + 1) % CATALOG;
+        } else {
+            trace.push_back({ page_of_rank[zipf(rng)], false });
+        }
+    }
+    return trace;
+}
+
+static void replay(const char* trace_name, const std::vector<Request>& trace, EdgeCachePolicy policy,
+                   size_t cache_mb) {
+    static const std::string body(12 * 1024, 'x');
+    EdgeCache cache(cache_mb, 16, policy);
+
+    uint64_t shopper_requests = 0, shopper_hits = 0, hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const Request& request : trace) {
+        std::string key = "/products/" + std::to_string(request.page);
+        bool hit = cache.lookup(key) != nullptr;
+        if (!hit) cache.put(key, body.substr(0, 4096 + (request.page * 7919) % 8192), "text/html", 0);
+        hits += hit;
+        if (!request.crawler) {
+            shopper_requests++;
+            shopper_hits += hit;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / trace.size();
+    std::printf("%-28s %-8s shoppers %5.1f%%  all %5.1f%%  %6.0f ns/request\n", trace_name,
+                policy == EdgeCachePolicy::Lru ? "lru" : "tinylfu",
+                100.0 * shopper_hits / std::max<uint64_t>(shopper_requests, 1),
+                100.0 * hits / trace.size(), ns);
+}
+
+int main(int argc, char** argv) {
+    size_t requests = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    size_t cache_mb = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 32;
+
+    std::printf("%zu pages, %zu MB cache, %zu requests\n", CATALOG, cache_mb, requests);
+
+    struct Scenario {
+        const char* name;
+        double skew;
+        double crawl_share;
+        size_t burst_every;
+    };
+    const Scenario scenarios[] = {
+        { "zipf 0.9", 0.9, 0.0, 0 },
+        { "zipf 0.7", 0.7, 0.0, 0 },
+        { "zipf 0.9 + 30% crawler", 0.9, 0.3, 0 },
+        { "zipf 0.9 + full-scan bursts", 0.9, 0.0, requests / 4 },
+    };
+    for (const Scenario& scenario : scenarios) {
+        std::vector<Request> trace = make_trace(requests, scenario.skew, scenario.crawl_share, scenario.burst_every);
+        for (EdgeCachePolicy policy : { EdgeCachePolicy::Lru, EdgeCachePolicy::TinyLfu }) {
+            replay(scenario.name, trace, policy, cache_mb);
+        }
+    }
+    return 0;
+}
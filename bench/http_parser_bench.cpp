@@ -0,0 +1,111 @@
+// Parse cost per request: legacy istringstream parser vs HttpParser
+//
+//   make bench
+//
+#include "http_parser.h"
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <string>
+
+static const char* SAMPLE_REQUEST =
+    "GET /products?category=Fashion&page=2 HTTP/1.1\r\n"
+    "Host: shop.rangoons.pk\r\n"
+    "User-Agent: Mozilla/5.0 (Linux; Android 13; SM-A546E) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Mobile Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.9,ur;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: cart_id=3f0c2a9e-8d1b-4c55-9f1e-1a2b3c4d5e6f; session=abc123\r\n"
+    "Referer: https://shop.rangoons.pk/\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "\r\n";
+
+// The parser run_server used before HttpParser, kept here as the baseline
+static bool legacy_parse(const std::string& raw_request, HttpRequest& request) {
+    std::istringstream ss(raw_request);
+    std::string line;
+    if (!std::getline(ss, line)) return false;
+
+    std::istringstream first_line(line);
+    first_line >> request.method >> request.target;
+
+    size_t query_pos = request.target.find('?');
+    if (query_pos != std::string::npos) {
+        std::string query_string = request.target.substr(query_pos + 1);
+        request.target = request.target.substr(0, query_pos);
+        std::istringstream query_ss(query_string);
+        std::string param;
+        while (std::getline(query_ss, param, '&')) {
+            size_t equal_pos = param.find('=');
+            if (equal_pos != std::string::npos) {
+                request.query_params[param.substr(0, equal_pos)] = param.substr(equal_pos + 1);
+            }
+        }
+    }
+
+    while (std::getline(ss, line) && line != "\r" && line != "") {
+        size_t colon_pos = line.find(':');
+        if (colon_pos != std::string::npos) {
+            request.headers[line.substr(0, colon_pos)] = line.substr(colon_pos + 1);
+        }
+    }
+
+    std::stringstream body_ss;
+    while (std::getline(ss, line)) body_ss << line << "\n";
+    request.body = body_ss.str();
+    return true;
+}
+
+template <typename F>
+static void run(const char* name, int iterations, F&& body) {
+    for (int i = 0; i < iterations / 10; ++i) body(); // warm up
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) body();
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    std::printf("%-36s %10.1f ns/request\n", name, ns);
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 500000;
+    const std::string raw = SAMPLE_REQUEST;
+    volatile size_t sink = 0;
+
+    std::printf("Request: %zu bytes, %d iterations\n", raw.size(), iterations);
+
+    run("legacy istringstream parse", iterations, [&]() {
+        HttpRequest request;
+        legacy_parse(raw, request);
+        sink += request.headers.size();
+    });
+
+    HttpParser parser;
+    run("HttpParser (views only)", iterations, [&]() {
+        parser.reset();
+        parser.parse(raw);
+        sink += parser.header("host").size() + parser.query_param("page").size();
+    });
+
+    run("HttpParser split over 3 reads", iterations, [&]() {
+        std::string_view all(raw);
+        parser.reset();
+        parser.parse(all.substr(0, 40));
+        parser.parse(all.substr(0, 300));
+        parser.parse(all);
+        sink += parser.consumed();
+    });
+
+    run("HttpParser + to_request", iterations, [&]() {
+        HttpRequest request;
+        parser.reset();
+        parser.parse(raw);
+        parser.to_request(request);
+        sink += request.headers.size();
+    });
+
+    return sink == 0;
+}
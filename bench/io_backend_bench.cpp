@@ -0,0 +1,172 @@
+// Throughput of the epoll and io_uring backends on the same routes
+//
+//   make bench
+//   bench/io_backend_bench [seconds] [connections]
+//
+// Each backend serves a stub handler on an ephemeral loopback port while
+// keep-alive clients replay /health (tiny JSON) and /products (~32 KB of
+// HTML). Server CPU is read from the loop thread's own clock, so client
+// work on the same machine does not skew the per-request cost.
+#include "event_loop.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+static HttpResponse stub_handler(const HttpRequest& request) {
+    static const std::string products_page = [] {
+        std::string html = "<html><body><div class=\"products-grid\">";
+        while (html.size() < 32 * 1024) {
+            html += "<div class=\"product-card\"><h3>Embroidered Lawn Suit</h3>"
+                    "<p class=\"price\">PKR 4,999</p><button>Add to Cart</button></div>";
+        }
+        return html + "</div></body></html>";
+    }();
+
+    HttpResponse response;
+    if (request.target == "/health") {
+        response.content_type = "application/json";
+        response.body = "{\"status\":\"healthy\"}";
+    } else {
+        response.content_type = "text/html";
+        response.body = products_page;
+    }
+    return response;
+}
+
+static int listen_loopback(uint16_t& port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0 ||
+        getsockname(fd, (struct sockaddr*)&addr, &len) != 0) {
+        close(fd);
+        return -1;
+    }
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+// Send one request and read exactly one response; false on any error
+static bool round_trip(int fd, const std::string& request, std::string& buf) {
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()) return false;
+
+    buf.clear();
+    size_t header_end = std::string::npos;
+    size_t total = 0;
+    char chunk[16384];
+    while (true) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buf.append(chunk, n);
+
+        if (header_end == std::string::npos) {
+            header_end = buf.find("\r\n\r\n");
+            if (header_end == std::string::npos) continue;
+            size_t cl = buf.find("Content-Length: ");
+            if (cl == std::string::npos) return false;
+            total = header_end + 4 + std::strtoul(buf.c_str() + cl + 16, nullptr, 10);
+        }
+        if (buf.size() >= total) return true;
+    }
+}
+
+static double thread_cpu_seconds(pthread_t thread) {
+    clockid_t clock;
+    struct timespec ts{};
+    if (pthread_getcpuclockid(thread, &clock) != 0 || clock_gettime(clock, &ts) != 0) return 0;
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_backend(const char* backend, const char* route, double seconds, int connections) {
+    Config config;
+    config.io_backend = backend;
+    config.keep_alive_max_requests = 1 << 30; // measure the loop, not reconnects
+
+    uint16_t port = 0;
+    int listen_fd = listen_loopback(port);
+    if (listen_fd == -1) {
+        std::printf("%-9s %-10s failed to listen\n", backend, route);
+        return;
+    }
+
+    auto loop = make_connection_loop(config, stub_handler);
+    loop->add_listener(listen_fd);
+    std::thread server([&loop]() { loop->run(); });
+
+    std::string request = std::string("GET ") + route + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> completed{0};
+    std::atomic<int> failures{0};
+
+    double cpu_start = thread_cpu_seconds(server.native_handle());
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> clients;
+    for (int i = 0; i < connections; ++i) {
+        clients.emplace_back([&]() {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+                failures++;
+                close(fd);
+                return;
+            }
+
+            std::string buf;
+            uint64_t local = 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                if (!round_trip(fd, request, buf)) {
+                    failures++;
+                    break;
+                }
+                local++;
+            }
+            completed += local;
+            close(fd);
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    done = true;
+    for (auto& client : clients) client.join();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu = thread_cpu_seconds(server.native_handle()) - cpu_start;
+
+    loop->stop();
+    server.join();
+    close(listen_fd);
+
+    uint64_t n = completed.load();
+    std::printf("%-9s %-10s %10.0f req/s %8.2f us server CPU/req%s\n", backend, route,
+                n / elapsed, n ? cpu * 1e6 / n : 0.0, failures ? "  (client errors)" : "");
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? std::atof(argv[1]) : 2.0;
+    int connections = argc > 2 ? std::atoi(argv[2]) : 8;
+
+    std::printf("%.1f s per run, %d keep-alive connections\n", seconds, connections);
+    for (const char* route : { "/health", "/products" }) {
+        for (const char* backend : { "epoll", "io_uring" }) {
+            run_backend(backend, route, seconds, connections);
+        }
+    }
+    return 0;
+}
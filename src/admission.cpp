@@ -0,0 +1,91 @@
+#include "admission.h"
+#include <algorithm>
+#include <climits>
+
+static int64_t to_ns(AdmissionControl::Clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+AdmissionControl::AdmissionControl(const Config& config)
+    : target_ns((int64_t)std::max(config.admission_target_ms, 1) * 1000000),
+      interval_ns((int64_t)std::max(config.admission_interval_ms, config.admission_target_ms) * 1000000),
+      max_queued(config.max_queued_requests > 0 ? (size_t)config.max_queued_requests : 0),
+      reserved(max_queued / 10),
+      priority_paths(config.priority_paths),
+      interval_start(to_ns(Clock::now())),
+      interval_min(INT64_MAX) {}
+
+bool AdmissionControl::is_priority(const HttpRequest& request) const {
+    std::string_view path = request.target;
+    for (const std::string& prefix : priority_paths) {
+        if (path.compare(0, prefix.size(), prefix) != 0) continue;
+        // "/health" covers "/health/db" but not "/healthz"
+        if (path.size() == prefix.size() || path[prefix.size()] == '/' || prefix.back() == '/') return true;
+    }
+    return priority_check && priority_check(request);
+}
+
+bool AdmissionControl::admit(bool priority) {
+    // Arrivals keep intervals rolling while no worker is dequeuing, so an
+    // idle pool leaves the overloaded state
+    roll_interval(to_ns(Clock::now()));
+
+    size_t queued = in_flight.fetch_add(1, std::memory_order_relaxed);
+    if (max_queued > 0 && queued >= (priority ? max_queued : max_queued - reserved)) {
+        in_flight.fetch_sub(1, std::memory_order_relaxed);
+        shed_full.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    admitted.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool AdmissionControl::start(Clock::time_point queued_at, bool priority) {
+    int64_t now = to_ns(Clock::now());
+    int64_t delay = now - to_ns(queued_at);
+
+    int64_t current = interval_min.load(std::memory_order_relaxed);
+    while (delay < current && !interval_min.compare_exchange_weak(current, delay, std::memory_order_relaxed)) {}
+    roll_interval(now);
+
+    if (priority) return true;
+
+    // A burst may wait out the whole interval; a standing queue only the
+    // target, which drains it down to requests still worth answering
+    int64_t deadline = overloaded.load(std::memory_order_relaxed) ? target_ns : interval_ns;
+    if (delay <= deadline) return true;
+    shed_delay.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void AdmissionControl::roll_interval(int64_t now) {
+    int64_t start = interval_start.load(std::memory_order_relaxed);
+    if (now - start < interval_ns) return;
+    if (!interval_start.compare_exchange_strong(start, now, std::memory_order_relaxed)) return;
+
+    // No samples means nothing waited at all
+    int64_t min = interval_min.exchange(INT64_MAX, std::memory_order_relaxed);
+    overloaded.store(min != INT64_MAX && min > target_ns, std::memory_order_relaxed);
+    last_min.store(min == INT64_MAX ? 0 : min, std::memory_order_relaxed);
+}
+
+AdmissionStats AdmissionControl::stats() const {
+    AdmissionStats stats;
+    stats.admitted = admitted.load(std::memory_order_relaxed);
+    stats.shed_queue_delay = shed_delay.load(std::memory_order_relaxed);
+    stats.shed_queue_full = shed_full.load(std::memory_order_relaxed);
+    stats.in_flight = in_flight.load(std::memory_order_relaxed);
+    stats.overloaded = overloaded.load(std::memory_order_relaxed);
+    stats.min_delay_ms = last_min.load(std::memory_order_relaxed) / 1e6;
+    return stats;
+}
+
+HttpResponse overload_response(const Config& config) {
+    HttpResponse response;
+    response.status_code = 503;
+    response.content_type = "text/plain";
+    response.body = "Service Unavailable";
+    response.headers["Retry-After"] = std::to_string(std::max(config.retry_after_seconds, 1));
+    response.cache_control = "no-store";
+    return response;
+}
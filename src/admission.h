@@ -0,0 +1,80 @@
+#pragma once
+
+#include "rangoons.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Admission control in front of the handler pool. Requests are shed by how
+// long they sat in the queue rather than by how many are queued, after
+// CoDel: while the smallest queue delay seen over an interval stays above
+// the target the queue is standing, not absorbing a burst, and anything
+// that waited longer than the target is answered with a 503 instead of
+// being run. A bound on queued requests catches the rest, with a slice of
+// it held back for priority routes (health checks, checkout).
+
+struct AdmissionStats {
+    uint64_t admitted = 0;
+    uint64_t shed_queue_delay = 0; // waited past the deadline
+    uint64_t shed_queue_full = 0;  // arrived with max_queued_requests waiting
+    size_t in_flight = 0;          // queued or running
+    bool overloaded = false;       // standing queue: the deadline is the target
+    double min_delay_ms = 0;       // smallest queue delay over the last interval
+};
+
+class AdmissionControl {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit AdmissionControl(const Config& config);
+
+    // Requests to config.priority_paths, or that the priority check picks,
+    // are never shed for delay
+    bool is_priority(const HttpRequest& request) const;
+
+    // Extra test for is_priority(), such as route metadata. Set before any
+    // loop starts; it is called on the loop threads.
+    void set_priority_check(std::function<bool(const HttpRequest&)> check) { priority_check = std::move(check); }
+
+    // On the loop thread, before queueing. false: answer 503 right away.
+    bool admit(bool priority);
+
+    // On the worker, as an admitted request comes off the queue. false:
+    // it waited too long, answer 503 without running the handler.
+    bool start(Clock::time_point queued_at, bool priority);
+
+    // The admitted request has been answered, either way
+    void finish() { in_flight.fetch_sub(1, std::memory_order_relaxed); }
+
+    AdmissionStats stats() const;
+
+private:
+    int64_t target_ns;
+    int64_t interval_ns;
+    size_t max_queued;
+    size_t reserved;   // of max_queued, only priority routes may use
+    std::vector<std::string> priority_paths;
+    std::function<bool(const HttpRequest&)> priority_check;
+
+    std::atomic<size_t> in_flight{0};
+    std::atomic<bool> overloaded{false};
+
+    // Current interval, updated by every worker without a lock: a sample
+    // landing across a rollover only shifts which interval it counts for
+    std::atomic<int64_t> interval_start;
+    std::atomic<int64_t> interval_min;
+    std::atomic<int64_t> last_min{0};
+
+    std::atomic<uint64_t> admitted{0};
+    std::atomic<uint64_t> shed_delay{0};
+    std::atomic<uint64_t> shed_full{0};
+
+    void roll_interval(int64_t now);
+};
+
+// The 503 shed requests and refused connections get
+HttpResponse overload_response(const Config& config);
@@ -0,0 +1,201 @@
+#include "catalog_events.h"
+#include <libpq-fe.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <iostream>
+#include <poll.h>
+#include <unordered_set>
+#include <vector>
+
+// Channel the triggers in DB::init_schema() notify on
+static const char* CATALOG_CHANNEL = "rangoons_catalog";
+
+// Notifications drained at once beyond which a burst (a bulk import, a
+// DELETE without WHERE) is cheaper to treat as "everything changed"
+static const size_t MAX_TARGETED = 1024;
+
+// How often the listening thread checks whether it should stop
+static const int POLL_INTERVAL_MS = 250;
+static const int MAX_BACKOFF_MS = 30000;
+
+// ---------------- CatalogVersions -----------------
+
+CatalogVersions::CatalogVersions() : slots(std::make_unique<std::atomic<uint64_t>[]>(SLOTS)) {}
+
+uint64_t CatalogVersions::of(std::string_view scope) const {
+    // Sum of two counters that only grow, so it moves when either does
+    return everything.load(std::memory_order_acquire) +
+           slots[std::hash<std::string_view>()(scope) % SLOTS].load(std::memory_order_acquire);
+}
+
+void CatalogVersions::bump(std::string_view scope) {
+    slots[std::hash<std::string_view>()(scope) % SLOTS].fetch_add(1, std::memory_order_acq_rel);
+    any_change.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void CatalogVersions::bump_all() {
+    everything.fetch_add(1, std::memory_order_acq_rel);
+    any_change.fetch_add(1, std::memory_order_acq_rel);
+}
+
+// ---------------- Page scopes -----------------
+
+// Mirrors the product routes: /products/{id:int}, /api/products/{id:int}
+// and /products/{handle}. Anything unusual, such as an escaped handle,
+// falls back to the global version, which is never wrong, only slower.
+static std::string page_scope(std::string_view path) {
+    for (std::string_view prefix : { std::string_view("/products/"), std::string_view("/api/products/") }) {
+        if (path.compare(0, prefix.size(), prefix) != 0) continue;
+        std::string_view rest = path.substr(prefix.size());
+        if (rest.empty() || rest.find_first_of("/%") != std::string_view::npos) return std::string();
+
+        bool numeric = std::all_of(rest.begin(), rest.end(), [](char c) { return std::isdigit((unsigned char)c); });
+        if (numeric) {
+            if (rest.size() > 9) return std::string();
+            return "product:" + std::to_string(std::stoi(std::string(rest)));
+        }
+        return prefix == "/products/" ? "handle:" + std::string(rest) : std::string();
+    }
+    return std::string();
+}
+
+uint64_t page_version(const CatalogVersions& versions, std::string_view key) {
+    std::string scope = page_scope(key.substr(0, key.find('?')));
+    return scope.empty() ? versions.global() : versions.of(scope);
+}
+
+// ---------------- CatalogListener -----------------
+
+CatalogListener::CatalogListener(const std::string& connection_string, CatalogVersions& versions)
+    // Keepalives notice a peer that vanished without closing the socket
+    : conninfo(DB::conninfo(connection_string) + " keepalives=1 keepalives_idle=30 keepalives_interval=10"),
+      versions(versions) {}
+
+CatalogListener::~CatalogListener() {
+    stop();
+}
+
+bool CatalogListener::start(std::string* err) {
+    if (running.exchange(true)) return true;
+    bool ok = connect(err);
+    listener = std::thread([this]() { listen_loop(); });
+    return ok;
+}
+
+void CatalogListener::stop() {
+    running = false;
+    if (listener.joinable()) listener.join();
+    disconnect();
+}
+
+bool CatalogListener::connect(std::string* err) {
+    PGconn* pg = PQconnectdb(conninfo.c_str());
+    if (PQstatus(pg) != CONNECTION_OK) {
+        if (err) *err = PQerrorMessage(pg);
+        PQfinish(pg);
+        return false;
+    }
+    PGresult* result = PQexec(pg, (std::string("LISTEN ") + CATALOG_CHANNEL).c_str());
+    if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+        if (err) *err = PQerrorMessage(pg);
+        PQclear(result);
+        PQfinish(pg);
+        return false;
+    }
+    PQclear(result);
+    conn = pg;
+    connected = true;
+    return true;
+}
+
+void CatalogListener::disconnect() {
+    if (conn) {
+        PQfinish(static_cast<PGconn*>(conn));
+        conn = nullptr;
+    }
+    connected = false;
+}
+
+void CatalogListener::listen_loop() {
+    int backoff_ms = 500;
+    int waited_ms = backoff_ms; // try at once when start() could not connect
+    while (running) {
+        if (!conn) {
+            if (waited_ms < backoff_ms) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+                waited_ms += POLL_INTERVAL_MS;
+                continue;
+            }
+            waited_ms = 0;
+            std::string err;
+            if (!connect(&err)) {
+                backoff_ms = std::min(backoff_ms * 2, MAX_BACKOFF_MS);
+                continue;
+            }
+            backoff_ms = 500;
+            reconnects++;
+            // Whatever changed while nobody was listening went unheard
+            versions.bump_all();
+            full_invalidations++;
+            std::cout << "🔔 Catalog listener reconnected; cached pages invalidated" << std::endl;
+        }
+
+        pollfd pfd{ PQsocket(static_cast<PGconn*>(conn)), POLLIN, 0 };
+        int ready = poll(&pfd, 1, POLL_INTERVAL_MS);
+        if ((ready < 0 && errno != EINTR) || (ready > 0 && !drain())) {
+            std::cerr << "⚠️ Catalog listener lost its connection: "
+                      << PQerrorMessage(static_cast<PGconn*>(conn)) << std::endl;
+            disconnect();
+        }
+    }
+}
+
+bool CatalogListener::drain() {
+    PGconn* pg = static_cast<PGconn*>(conn);
+    if (!PQconsumeInput(pg)) return false;
+
+    std::vector<std::string> payloads;
+    while (PGnotify* notify = PQnotifies(pg)) {
+        payloads.emplace_back(notify->extra);
+        PQfreemem(notify);
+    }
+    if (payloads.empty()) return PQstatus(pg) == CONNECTION_OK;
+    notifications += payloads.size();
+
+    if (payloads.size() > MAX_TARGETED) {
+        versions.bump_all();
+        full_invalidations++;
+        return true;
+    }
+
+    // Payload: table, then the scopes it touched, separated by \x1f
+    std::unordered_set<std::string> scopes;
+    for (const std::string& payload : payloads) {
+        size_t start = payload.find('\x1f');
+        if (start == std::string::npos) {
+            // TRUNCATE and the like: no rows to name
+            versions.bump_all();
+            full_invalidations++;
+            return true;
+        }
+        while (start != std::string::npos) {
+            size_t end = payload.find('\x1f', start + 1);
+            scopes.insert(payload.substr(start + 1, end == std::string::npos ? end : end - start - 1));
+            start = end;
+        }
+    }
+    for (const std::string& scope : scopes) {
+        versions.bump(scope);
+    }
+    return true;
+}
+
+CatalogListenerStats CatalogListener::stats() const {
+    CatalogListenerStats stats;
+    stats.notifications = notifications.load(std::memory_order_relaxed);
+    stats.full_invalidations = full_invalidations.load(std::memory_order_relaxed);
+    stats.reconnects = reconnects.load(std::memory_order_relaxed);
+    stats.connected = connected.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "rangoons.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Catalog invalidation from the database itself. init_schema() installs
+// triggers that NOTIFY on every change to products, categories and
+// product_stats, whoever makes it; CatalogListener holds its own
+// connection LISTENing for them and bumps the scopes each change names in
+// CatalogVersions. Pages cached from the old rows stop matching and are
+// re-rendered on their next request, snapshot entries included, so the
+// page cache can keep long TTLs without serving an edit made in psql or by
+// the import tools.
+
+// Version of the catalog the page cached under key (RenderCache::key_for)
+// is checked against: its product's scope for product pages, the global
+// version for everything else, including the empty key
+uint64_t page_version(const CatalogVersions& versions, std::string_view key);
+
+struct CatalogListenerStats {
+    uint64_t notifications = 0;
+    uint64_t full_invalidations = 0; // bursts too big to apply, and reconnects
+    uint64_t reconnects = 0;
+    bool connected = false;
+};
+
+class CatalogListener {
+public:
+    // connection_string as for DB::open
+    CatalogListener(const std::string& connection_string, CatalogVersions& versions);
+    ~CatalogListener();
+    CatalogListener(const CatalogListener&) = delete;
+    CatalogListener& operator=(const CatalogListener&) = delete;
+
+    // Connect and LISTEN, then keep listening on a thread that reconnects
+    // whenever the connection drops. false with err when the first
+    // connection fails; the thread keeps trying regardless.
+    bool start(std::string* err = nullptr);
+    void stop();
+
+    CatalogListenerStats stats() const;
+
+private:
+    std::string conninfo;
+    CatalogVersions& versions;
+    void* conn = nullptr; // PGconn, used only by the listening thread after start()
+    std::thread listener;
+    std::atomic<bool> running{false};
+
+    std::atomic<uint64_t> notifications{0};
+    std::atomic<uint64_t> full_invalidations{0};
+    std::atomic<uint64_t> reconnects{0};
+    std::atomic<bool> connected{false};
+
+    bool connect(std::string* err);
+    void disconnect();
+    void listen_loop();
+    // Applies everything queued on the connection; false once it failed
+    bool drain();
+};
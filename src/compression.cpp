@@ -0,0 +1,299 @@
+#include "compression.h"
+#include <brotli/encode.h>
+#include <zlib.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// Compressed bodies kept for reuse, and the largest body worth keeping
+static const size_t CACHE_BYTES = 16 * 1024 * 1024;
+static const size_t CACHE_MAX_BODY = CACHE_BYTES / 16;
+
+// Pages rarely exceed 1 MB, so a smaller brotli window costs nothing in
+// ratio and keeps encoder memory down
+static const int BROTLI_WINDOW_BITS = 20;
+
+static std::atomic<uint64_t> stat_compressed{0};
+static std::atomic<uint64_t> stat_cache_hits{0};
+static std::atomic<uint64_t> stat_bytes_in{0};
+static std::atomic<uint64_t> stat_bytes_out{0};
+
+// ---------------- Negotiation -----------------
+
+static std::string_view trim_view(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+static bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+bool accepts_encoding(const std::string& accept, const char* coding) {
+    std::string_view rest(accept);
+    while (!rest.empty()) {
+        size_t comma = rest.find(',');
+        std::string_view item = trim_view(rest.substr(0, comma));
+        rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+
+        size_t semi = item.find(';');
+        if (!iequals(trim_view(item.substr(0, semi)), coding)) continue;
+        if (semi == std::string_view::npos) return true;
+
+        size_t q = item.find("q=", semi);
+        return q == std::string_view::npos || std::atof(std::string(item.substr(q + 2)).c_str()) > 0.0;
+    }
+    return false;
+}
+
+ContentCoding negotiate_encoding(const std::string& accept) {
+    if (accepts_encoding(accept, "br")) return ContentCoding::Brotli;
+    if (accepts_encoding(accept, "gzip")) return ContentCoding::Gzip;
+    return ContentCoding::Identity;
+}
+
+bool is_compressible_type(const std::string& content_type) {
+    std::string type(trim_view(std::string_view(content_type).substr(0, content_type.find(';'))));
+    for (char& c : type) c = (char)std::tolower((unsigned char)c);
+    if (type.compare(0, 5, "text/") == 0) return true;
+    if (type == "application/json" || type == "application/javascript" ||
+        type == "application/xml" || type == "image/svg+xml") {
+        return true;
+    }
+    // application/ld+json, application/rss+xml, ...
+    return (type.size() > 5 && type.compare(type.size() - 5, 5, "+json") == 0) ||
+           (type.size() > 4 && type.compare(type.size() - 4, 4, "+xml") == 0);
+}
+
+// ---------------- Codecs -----------------
+
+// Deflate state is ~256 KB to set up, so each thread keeps one and resets it
+struct GzipStream {
+    z_stream zs{};
+    int level = -1;
+
+    ~GzipStream() {
+        if (level != -1) deflateEnd(&zs);
+    }
+
+    bool reset(int wanted) {
+        if (level == wanted) return deflateReset(&zs) == Z_OK;
+        if (level != -1) deflateEnd(&zs);
+        zs = z_stream{};
+        level = -1;
+        // 15 window bits + 16 selects the gzip wrapper
+        if (deflateInit2(&zs, wanted, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+        level = wanted;
+        return true;
+    }
+};
+
+std::string gzip_compress(std::string_view data, int level) {
+    static thread_local GzipStream stream;
+    if (!stream.reset(std::clamp(level, 1, 9))) return std::string();
+
+    std::string out;
+    out.resize(deflateBound(&stream.zs, data.size()));
+    stream.zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.zs.avail_in = data.size();
+    stream.zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.zs.avail_out = out.size();
+    if (deflate(&stream.zs, Z_FINISH) != Z_STREAM_END) return std::string();
+    out.resize(stream.zs.total_out);
+    return out;
+}
+
+std::string gzip_decompress(std::string_view data) {
+    z_stream zs{};
+    // 15 window bits + 32 accepts both gzip and zlib headers
+    if (inflateInit2(&zs, 15 + 32) != Z_OK) return std::string();
+
+    std::string out;
+    char chunk[16384];
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = data.size();
+    int ret = Z_OK;
+    while (ret == Z_OK) {
+        zs.next_out = reinterpret_cast<Bytef*>(chunk);
+        zs.avail_out = sizeof(chunk);
+        ret = inflate(&zs, Z_NO_FLUSH);
+        out.append(chunk, sizeof(chunk) - zs.avail_out);
+        if (ret == Z_BUF_ERROR && zs.avail_in == 0) break; // truncated input
+    }
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END ? out : std::string();
+}
+
+std::string brotli_compress(std::string_view data, int quality) {
+    std::string out;
+    size_t size = BrotliEncoderMaxCompressedSize(data.size());
+    if (size == 0) return out;
+    out.resize(size);
+    if (!BrotliEncoderCompress(std::clamp(quality, BROTLI_MIN_QUALITY, BROTLI_MAX_QUALITY),
+                               BROTLI_WINDOW_BITS, BROTLI_MODE_TEXT, data.size(),
+                               reinterpret_cast<const uint8_t*>(data.data()), &size,
+                               reinterpret_cast<uint8_t*>(&out[0]))) {
+        return std::string();
+    }
+    out.resize(size);
+    return out;
+}
+
+// ---------------- Output cache -----------------
+
+namespace {
+
+struct CacheKey {
+    size_t hash;
+    size_t size;
+    ContentCoding coding;
+
+    bool operator==(const CacheKey& other) const {
+        return hash == other.hash && size == other.size && coding == other.coding;
+    }
+};
+
+struct CacheKeyHash {
+    size_t operator()(const CacheKey& key) const {
+        return key.hash ^ ((size_t)key.coding << 1);
+    }
+};
+
+struct CachedBody {
+    CacheKey key;
+    std::string source;
+    std::string output; // empty when compression did not pay off
+};
+
+std::mutex cache_mutex;
+std::list<CachedBody> lru; // most recently used first
+std::unordered_map<CacheKey, std::list<CachedBody>::iterator, CacheKeyHash> cache_index;
+size_t cache_bytes = 0;
+
+bool cache_lookup(const CacheKey& key, const std::string& source, std::string& output) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache_index.find(key);
+    if (it == cache_index.end() || it->second->source != source) return false;
+    lru.splice(lru.begin(), lru, it->second);
+    output = it->second->output;
+    return true;
+}
+
+void cache_store(const CacheKey& key, const std::string& source, const std::string& output) {
+    if (source.size() > CACHE_MAX_BODY) return;
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache_index.find(key);
+    if (it != cache_index.end()) {
+        // Same hash, different body: the newer one wins
+        cache_bytes -= it->second->source.size() + it->second->output.size();
+        lru.erase(it->second);
+        cache_index.erase(it);
+    }
+    lru.push_front(CachedBody{ key, source, output });
+    cache_index[key] = lru.begin();
+    cache_bytes += source.size() + output.size();
+
+    while (cache_bytes > CACHE_BYTES && !lru.empty()) {
+        CachedBody& victim = lru.back();
+        cache_bytes -= victim.source.size() + victim.output.size();
+        cache_index.erase(victim.key);
+        lru.pop_back();
+    }
+}
+
+} // namespace
+
+// ---------------- Responses -----------------
+
+const char* coding_name(ContentCoding coding) {
+    switch (coding) {
+        case ContentCoding::Gzip: return "gzip";
+        case ContentCoding::Brotli: return "br";
+        default: return "identity";
+    }
+}
+
+bool is_worth_compressing(const HttpResponse& response, const Config& config) {
+    if (!config.enable_compression || response.file || response.compressed) return false;
+    if (response.status_code < 200 || response.status_code == 204 ||
+        response.status_code == 206 || response.status_code == 304) {
+        return false;
+    }
+    return !response.headers.count("Content-Encoding") &&
+           is_worth_compressing(response.body.size(), response.content_type, config);
+}
+
+bool is_worth_compressing(size_t body_size, const std::string& content_type, const Config& config) {
+    return config.enable_compression && body_size >= (size_t)std::max(config.compression_min_bytes, 1) &&
+           is_compressible_type(content_type);
+}
+
+void add_vary_accept_encoding(HttpResponse& response) {
+    std::string& vary = response.headers["Vary"];
+    if (vary.empty()) {
+        vary = "Accept-Encoding";
+    } else if (strcasestr(vary.c_str(), "accept-encoding") == nullptr) {
+        vary += ", Accept-Encoding";
+    }
+}
+
+std::string compress_body(std::string_view body, ContentCoding coding, const Config& config) {
+    std::string output = coding == ContentCoding::Brotli ? brotli_compress(body, config.brotli_quality)
+                                                         : gzip_compress(body, config.gzip_level);
+    stat_compressed.fetch_add(1, std::memory_order_relaxed);
+    if (output.size() >= body.size()) output.clear();
+    return output;
+}
+
+void set_encoded_body(HttpResponse& response, ContentCoding coding, std::string encoded) {
+    stat_bytes_in.fetch_add(response.body.size(), std::memory_order_relaxed);
+    stat_bytes_out.fetch_add(encoded.size(), std::memory_order_relaxed);
+    response.body = std::move(encoded);
+    response.headers["Content-Encoding"] = coding_name(coding);
+    response.compressed = true;
+
+    // The encoded bytes differ from the ones the tag was made from; a weak
+    // tag still lets If-None-Match revalidate the same content
+    auto etag = response.headers.find("ETag");
+    if (etag != response.headers.end() && etag->second.compare(0, 2, "W/") != 0) {
+        etag->second.insert(0, "W/");
+    }
+}
+
+void compress_response(const HttpRequest& request, HttpResponse& response, const Config& config) {
+    if (!is_worth_compressing(response, config)) return;
+
+    // From here the representation depends on Accept-Encoding either way
+    add_vary_accept_encoding(response);
+
+    auto accept = request.headers.find("accept-encoding");
+    if (accept == request.headers.end()) return;
+    ContentCoding coding = negotiate_encoding(accept->second);
+    if (coding == ContentCoding::Identity) return;
+
+    CacheKey key{ std::hash<std::string>()(response.body), response.body.size(), coding };
+    std::string output;
+    if (cache_lookup(key, response.body, output)) {
+        stat_cache_hits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        output = compress_body(response.body, coding, config);
+        cache_store(key, response.body, output);
+    }
+    if (!output.empty()) set_encoded_body(response, coding, std::move(output));
+}
+
+CompressionStats compression_stats() {
+    CompressionStats stats;
+    stats.compressed = stat_compressed.load(std::memory_order_relaxed);
+    stats.cache_hits = stat_cache_hits.load(std::memory_order_relaxed);
+    stats.bytes_in = stat_bytes_in.load(std::memory_order_relaxed);
+    stats.bytes_out = stat_bytes_out.load(std::memory_order_relaxed);
+    return stats;
+}
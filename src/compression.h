@@ -0,0 +1,59 @@
+#pragma once
+
+#include "rangoons.h"
+#include <string>
+#include <string_view>
+
+// Content-Encoding negotiation and on-the-fly response compression
+
+enum class ContentCoding { Identity, Gzip, Brotli };
+
+// Does an Accept-Encoding value list coding with a non-zero q?
+bool accepts_encoding(const std::string& accept, const char* coding);
+
+// Preferred coding the client accepts: br, then gzip
+ContentCoding negotiate_encoding(const std::string& accept);
+
+// Text-like types worth compressing; images and fonts already are
+bool is_compressible_type(const std::string& content_type);
+
+// Raw codecs. Compression returns an empty string on failure.
+std::string gzip_compress(std::string_view data, int level);
+std::string gzip_decompress(std::string_view data);
+std::string brotli_compress(std::string_view data, int quality);
+
+// Token for a coding in Content-Encoding
+const char* coding_name(ContentCoding coding);
+
+// Would compress_response encode this response for a client that accepts
+// it? Also whether its representation varies with Accept-Encoding.
+bool is_worth_compressing(const HttpResponse& response, const Config& config);
+// The same for a plain 200 body of this size and type
+bool is_worth_compressing(size_t body_size, const std::string& content_type, const Config& config);
+
+// Adds Accept-Encoding to response's Vary header
+void add_vary_accept_encoding(HttpResponse& response);
+
+// body in coding at config's level; empty when that is no smaller or
+// compression failed
+std::string compress_body(std::string_view body, ContentCoding coding, const Config& config);
+
+// Replace response.body with encoded, already in coding, and set the
+// headers that go with it
+void set_encoded_body(HttpResponse& response, ContentCoding coding, std::string encoded);
+
+// Compress response.body in place for request when config allows it: 2xx
+// and error bodies of a compressible type at least compression_min_bytes
+// long, not already encoded. Sets Content-Encoding, Vary and
+// response.compressed. Identical bodies reuse earlier output from a small
+// process-wide cache instead of being compressed again.
+void compress_response(const HttpRequest& request, HttpResponse& response, const Config& config);
+
+struct CompressionStats {
+    uint64_t compressed = 0;   // bodies compressed
+    uint64_t cache_hits = 0;   // bodies served from earlier output
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+};
+
+CompressionStats compression_stats();
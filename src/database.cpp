@@ -6,6 +6,82 @@
 #include <iomanip>
 #include <chrono>
 #include <ctime>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// ---------------- Statement registry -----------------
+
+// Columns product_from_row() expects, in order
+static const char* PRODUCT_COLUMNS =
+    "id, handle, title, description, vendor, category, tags, published, "
+    "sku, stock, price_cents, compare_price_cents, image_url, weight_grams, "
+    "option1_name, option1_value, option2_name, option2_value, option3_name, option3_value, "
+    "created_at";
+
+// Every query the storefront and the import path run. Each is prepared on
+// a connection the first time it runs there and executed by name after
+// that, so the server parses and plans it once per connection.
+enum class Statement {
+    InsertProduct,
+    UpdateProduct,
+    DeleteProduct,
+    ListProducts,
+    ListProductsInCategory,
+    ProductById,
+    ProductByHandle,
+    CartItems,
+    CatalogStamp,
+    Count
+};
+
+struct StatementDef {
+    const char* name;
+    std::string sql;
+    int params;
+    bool read_only; // safe to run again after the connection dropped mid-query
+};
+
+// In Statement order
+static const StatementDef STATEMENTS[] = {
+    { "insert_product", R"(
+        INSERT INTO products (
+            handle, title, description, vendor, category, tags, published,
+            sku, stock, price_cents, compare_price_cents, image_url,
+            weight_grams, option1_name, option1_value, option2_name,
+            option2_value, option3_name, option3_value
+        ) VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12, $13, $14, $15, $16, $17, $18, $19)
+        RETURNING id
+    )", 19, false },
+    { "update_product", R"(
+        UPDATE products SET
+            handle = $1, title = $2, description = $3, vendor = $4, category = $5, tags = $6,
+            published = $7, sku = $8, stock = $9, price_cents = $10, compare_price_cents = $11,
+            image_url = $12, weight_grams = $13, option1_name = $14, option1_value = $15,
+            option2_name = $16, option2_value = $17, option3_name = $18, option3_value = $19
+        FROM (SELECT handle AS old_handle, category AS old_category FROM products WHERE id = $20 FOR UPDATE) old
+        WHERE id = $20
+        RETURNING old.old_handle, old.old_category
+    )", 20, false },
+    { "delete_product", "DELETE FROM products WHERE id = $1 RETURNING handle, category", 1, false },
+    // A NULL limit is no limit
+    { "list_products", std::string("SELECT ") + PRODUCT_COLUMNS +
+        " FROM products WHERE published = true ORDER BY created_at DESC LIMIT $1 OFFSET $2", 2, true },
+    { "list_products_in_category", std::string("SELECT ") + PRODUCT_COLUMNS +
+        " FROM products WHERE published = true AND category = $1 ORDER BY created_at DESC LIMIT $2 OFFSET $3", 3, true },
+    { "product_by_id", std::string("SELECT ") + PRODUCT_COLUMNS +
+        " FROM products WHERE id = $1 AND published = true", 1, true },
+    { "product_by_handle", std::string("SELECT ") + PRODUCT_COLUMNS +
+        " FROM products WHERE handle = $1 AND published = true", 1, true },
+    { "cart_items", "SELECT cart_id, product_id, qty, selected_options FROM cart_items "
+                    "WHERE cart_id = $1 ORDER BY product_id", 1, true },
+    // Order-independent, so one scan without a sort
+    { "catalog_stamp", "SELECT count(*) || ':' || coalesce(sum(hashtext(p::text)::bigint), 0) FROM products p", 0, true },
+};
+static_assert(sizeof(STATEMENTS) / sizeof(STATEMENTS[0]) == static_cast<size_t>(Statement::Count),
+              "one StatementDef per Statement");
 
 // PostgreSQL connection wrapper
 class PGConnection {
@@ -13,18 +89,10 @@ public:
     PGConnection() : conn(nullptr) {}
     ~PGConnection() { close(); }
     
-    bool open(const std::string& host, const std::string& dbname, 
-              const std::string& user, const std::string& password, int port) {
+    bool open(const std::string& conninfo) {
         close();
-        
-        std::ostringstream conninfo;
-        conninfo << "host=" << host 
-                << " dbname=" << dbname 
-                << " user=" << user 
-                << " password=" << password 
-                << " port=" << port;
-        
-        conn = PQconnectdb(conninfo.str().c_str());
+        prepared.fill(false);
+        conn = PQconnectdb(conninfo.c_str());
         return PQstatus(conn) == CONNECTION_OK;
     }
     
@@ -39,52 +107,279 @@ public:
         return conn && PQstatus(conn) == CONNECTION_OK;
     }
     
+    // Reconnect with the same parameters after the server went away; the
+    // new session has none of the old one's prepared statements
+    bool reset() {
+        if (!conn) return false;
+        prepared.fill(false);
+        PQreset(conn);
+        return PQstatus(conn) == CONNECTION_OK;
+    }
+    
+    // For the calls without a wrapper here, such as COPY
+    PGconn* raw() const { return conn; }
+    
     PGresult* exec(const std::string& query) {
         if (!is_connected()) return nullptr;
         return PQexec(conn, query.c_str());
     }
     
-    PGresult* exec_params(const std::string& query, int n_params, 
-                          const char* const* param_values, 
-                          const int* param_lengths, const int* param_formats) {
+    // Runs a registered statement, preparing it first if this connection
+    // has not yet; a failed prepare's result is returned like any other.
+    // When the server went away mid-query, a read-only statement is run
+    // once more on a fresh session; a write fails and the connection is
+    // reset at its next checkout.
+    PGresult* exec_prepared(Statement statement, const char* const* param_values) {
+        PGresult* result = run_prepared(statement, param_values);
+        if (is_connected() || !STATEMENTS[static_cast<size_t>(statement)].read_only) return result;
+        if (!reset()) return result;
+        PQclear(result);
+        retries++;
+        return run_prepared(statement, param_values);
+    }
+    
+    // Read-only statements repeated after a reconnect
+    uint64_t retry_count() const { return retries.load(std::memory_order_relaxed); }
+    
+    std::string get_last_error() const {
+        if (!conn) return "No connection";
+        return PQerrorMessage(conn);
+    }
+
+private:
+    PGconn* conn;
+    std::array<bool, static_cast<size_t>(Statement::Count)> prepared{};
+    std::atomic<uint64_t> retries{ 0 }; // read by stats() while leased
+    
+    PGresult* run_prepared(Statement statement, const char* const* param_values) {
         if (!is_connected()) return nullptr;
-        return PQexecParams(conn, query.c_str(), n_params, nullptr, 
-                           param_values, param_lengths, param_formats, 0);
+        size_t i = static_cast<size_t>(statement);
+        const StatementDef& def = STATEMENTS[i];
+        if (!prepared[i]) {
+            PGresult* result = PQprepare(conn, def.name, def.sql.c_str(), def.params, nullptr);
+            if (PQresultStatus(result) != PGRES_COMMAND_OK) return result;
+            PQclear(result);
+            prepared[i] = true;
+        }
+        return PQexecPrepared(conn, def.name, def.params, param_values, nullptr, nullptr, 0);
+    }
+};
+
+// ---------------- Connection pool -----------------
+
+// Connections are opened on demand up to the pool size. A thread gets the
+// connection it used last when that one is idle, so a handler keeps
+// reusing one server backend and its warm caches. A broken connection is
+// reset when it is next checked out, or right away by a read-only
+// statement that retries on it.
+class PGPool {
+public:
+    ~PGPool() { close(); }
+    
+    bool open(const std::string& info, size_t size, std::chrono::milliseconds wait, std::string* err) {
+        close();
+        std::lock_guard<std::mutex> lock(mutex);
+        conninfo = info;
+        max_size = std::max<size_t>(size, 1);
+        wait_timeout = wait;
+        // One up front, so a bad conninfo fails here and not on a request
+        auto first = std::make_unique<PGConnection>();
+        if (!first->open(conninfo)) {
+            if (err) *err = first->get_last_error();
+            return false;
+        }
+        idle.push_back(first.get());
+        connections.push_back(std::move(first));
+        created = 1;
+        return true;
+    }
+    
+    // Only once no query is running
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.clear();
+        connections.clear();
     }
     
-    int get_last_insert_id() {
-        if (!is_connected()) return 0;
+    // An open connection, or null with err when none came free within the
+    // wait timeout or a new one could not be opened
+    PGConnection* acquire(std::string* err) {
+        static thread_local std::pair<const PGPool*, PGConnection*> affinity{ nullptr, nullptr };
         
-        PGresult* result = exec("SELECT LASTVAL()");
-        if (!result || PQresultStatus(result) != PGRES_TUPLES_OK) {
-            PQclear(result);
-            return 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        PGConnection* conn = nullptr;
+        auto started = std::chrono::steady_clock::now();
+        bool waited = false;
+        while (!conn) {
+            if (!idle.empty()) {
+                auto it = affinity.first == this ? std::find(idle.begin(), idle.end(), affinity.second) : idle.end();
+                if (it == idle.end()) it = idle.end() - 1;
+                conn = *it;
+                *it = idle.back();
+                idle.pop_back();
+            } else if (connections.size() + opening < max_size) {
+                opening++;
+                lock.unlock();
+                auto fresh = std::make_unique<PGConnection>();
+                bool ok = fresh->open(conninfo);
+                lock.lock();
+                opening--;
+                if (!ok) {
+                    if (err) *err = fresh->get_last_error();
+                    available.notify_one(); // the slot is free again
+                    return nullptr;
+                }
+                conn = fresh.get();
+                connections.push_back(std::move(fresh));
+                created++;
+            } else {
+                waited = true;
+                if (available.wait_until(lock, started + wait_timeout) == std::cv_status::timeout && idle.empty()) {
+                    timeouts++;
+                    if (err) *err = "Database pool exhausted: no connection free within " +
+                                    std::to_string(wait_timeout.count()) + "ms";
+                    return nullptr;
+                }
+            }
+        }
+        if (waited) {
+            uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - started).count();
+            waits++;
+            wait_us_total += us;
+            wait_us_max = std::max(wait_us_max, us);
         }
+        in_use++;
+        lock.unlock();
         
-        int id = std::stoi(PQgetvalue(result, 0, 0));
-        PQclear(result);
-        return id;
+        affinity = { this, conn };
+        if (!conn->is_connected()) {
+            {
+                std::lock_guard<std::mutex> relock(mutex);
+                resets++;
+            }
+            if (!conn->reset()) {
+                if (err) *err = "Database connection lost: " + conn->get_last_error();
+                release(conn);
+                return nullptr;
+            }
+        }
+        return conn;
     }
     
-    std::string get_last_error() const {
-        if (!conn) return "No connection";
-        return PQerrorMessage(conn);
+    void release(PGConnection* conn) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            idle.push_back(conn);
+            in_use--;
+        }
+        available.notify_one();
+    }
+    
+    DBPoolStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        DBPoolStats stats;
+        stats.size = max_size;
+        stats.open = connections.size();
+        stats.in_use = in_use;
+        stats.created = created;
+        stats.resets = resets;
+        for (const auto& conn : connections) stats.retries += conn->retry_count();
+        stats.waits = waits;
+        stats.timeouts = timeouts;
+        stats.wait_ms_total = wait_us_total / 1000.0;
+        stats.wait_ms_max = wait_us_max / 1000.0;
+        return stats;
     }
 
 private:
-    PGconn* conn;
+    mutable std::mutex mutex;
+    std::condition_variable available;
+    std::string conninfo;
+    size_t max_size = 1;
+    std::chrono::milliseconds wait_timeout{ 0 };
+    std::vector<std::unique_ptr<PGConnection>> connections;
+    std::vector<PGConnection*> idle;
+    size_t opening = 0; // being connected outside the lock
+    size_t in_use = 0;
+    uint64_t created = 0;
+    uint64_t resets = 0;
+    uint64_t waits = 0;
+    uint64_t timeouts = 0;
+    uint64_t wait_us_total = 0;
+    uint64_t wait_us_max = 0;
+};
+
+static PGPool* pool_of(void* handle) {
+    return static_cast<PGPool*>(handle);
+}
+
+// A pooled connection for the length of one DB call
+class PGLease {
+public:
+    PGLease(PGPool* pool, std::string* err) : pool(pool), conn(pool->acquire(err)) {}
+    ~PGLease() {
+        if (conn) pool->release(conn);
+    }
+    PGLease(const PGLease&) = delete;
+    PGLease& operator=(const PGLease&) = delete;
+    
+    explicit operator bool() const { return conn != nullptr; }
+    PGConnection* operator->() const { return conn; }
+    PGConnection* get() const { return conn; }
+
+private:
+    PGPool* pool;
+    PGConnection* conn;
 };
 
+static Product product_from_row(PGresult* result, int i) {
+    Product p;
+    p.id = std::stoi(PQgetvalue(result, i, 0));
+    p.handle = PQgetvalue(result, i, 1);
+    p.title = PQgetvalue(result, i, 2);
+    p.description = PQgetvalue(result, i, 3);
+    p.vendor = PQgetvalue(result, i, 4);
+    p.category = PQgetvalue(result, i, 5);
+    p.tags = PQgetvalue(result, i, 6);
+    p.published = (std::string(PQgetvalue(result, i, 7)) == "t");
+    p.sku = PQgetvalue(result, i, 8);
+    p.stock = std::stoi(PQgetvalue(result, i, 9));
+    p.price_cents = std::stoi(PQgetvalue(result, i, 10));
+    p.compare_price_cents = std::stoi(PQgetvalue(result, i, 11));
+    p.image_url = PQgetvalue(result, i, 12);
+    p.weight_grams = std::stoi(PQgetvalue(result, i, 13));
+    p.option1_name = PQgetvalue(result, i, 14);
+    p.option1_value = PQgetvalue(result, i, 15);
+    p.option2_name = PQgetvalue(result, i, 16);
+    p.option2_value = PQgetvalue(result, i, 17);
+    p.option3_name = PQgetvalue(result, i, 18);
+    p.option3_value = PQgetvalue(result, i, 19);
+    p.created_at = PQgetvalue(result, i, 20);
+    return p;
+}
+
 // DB implementation
 DB::DB() : handle(nullptr), connected(false) {
-    handle = new PGConnection();
+    handle = new PGPool();
 }
 
 DB::~DB() {
     close();
+    delete pool_of(handle);
+}
+
+// libpq quotes values with spaces or quotes in them
+static std::string conninfo_value(const std::string& value) {
+    std::string quoted = "'";
+    for (char c : value) {
+        if (c == '\\' || c == '\'') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "'";
 }
 
-bool DB::open(const std::string& connection_string) {
+std::string DB::conninfo(const std::string& connection_string, std::string* dbname_out) {
     // Parse connection string: host:port:dbname:user:password
     std::istringstream ss(connection_string);
     std::string host, port_str, dbname, user, password;
@@ -95,15 +390,24 @@ bool DB::open(const std::string& connection_string) {
     std::getline(ss, user, ':');
     std::getline(ss, password, ':');
     
-    int port = port_str.empty() ? 5432 : std::stoi(port_str);
+    if (dbname_out) *dbname_out = dbname;
+    return "host=" + conninfo_value(host) + " port=" + conninfo_value(port_str.empty() ? "5432" : port_str) +
+           " dbname=" + conninfo_value(dbname) + " user=" + conninfo_value(user) +
+           " password=" + conninfo_value(password);
+}
+
+bool DB::open(const std::string& connection_string, size_t pool_size, int wait_timeout_ms) {
+    std::string dbname;
+    std::string info = conninfo(connection_string, &dbname);
     
-    PGConnection* pg = static_cast<PGConnection*>(handle);
-    connected = pg->open(host, dbname, user, password, port);
+    std::string err;
+    connected = pool_of(handle)->open(info, pool_size, std::chrono::milliseconds(wait_timeout_ms), &err);
     
     if (connected) {
-        std::cout << "✅ Connected to PostgreSQL database: " << dbname << std::endl;
+        std::cout << "✅ Connected to PostgreSQL database: " << dbname << " (pool of up to "
+                  << std::max<size_t>(pool_size, 1) << ")" << std::endl;
     } else {
-        std::cerr << "❌ Failed to connect to PostgreSQL: " << pg->get_last_error() << std::endl;
+        std::cerr << "❌ Failed to connect to PostgreSQL: " << err << std::endl;
     }
     
     return connected;
@@ -111,12 +415,15 @@ bool DB::open(const std::string& connection_string) {
 
 void DB::close() {
     if (handle) {
-        PGConnection* pg = static_cast<PGConnection*>(handle);
-        pg->close();
+        pool_of(handle)->close();
         connected = false;
     }
 }
 
+DBPoolStats DB::pool_stats() const {
+    return pool_of(handle)->stats();
+}
+
 bool DB::is_open() const {
     return connected;
 }
@@ -127,7 +434,8 @@ bool DB::init_schema(std::string* err) {
         return false;
     }
     
-    PGConnection* pg = static_cast<PGConnection*>(handle);
+    PGLease pg(pool_of(handle), err);
+    if (!pg) return false;
     
     const char* schema_sql = R"(
         CREATE TABLE IF NOT EXISTS products (
@@ -223,6 +531,54 @@ bool DB::init_schema(std::string* err) {
         CREATE INDEX IF NOT EXISTS idx_products_price ON products(price_cents);
         CREATE INDEX IF NOT EXISTS idx_orders_status ON orders(status);
         CREATE INDEX IF NOT EXISTS idx_orders_phone ON orders(phone);
+        
+        -- Catalog changes from any writer (this server, the import tools,
+        -- psql) reach CatalogListener on channel rangoons_catalog. The
+        -- payload is the table, then the CatalogVersions scopes the change
+        -- touches, separated by chr(31); no scopes means everything.
+        CREATE OR REPLACE FUNCTION rangoons_notify_catalog() RETURNS trigger AS $$
+        DECLARE
+            scopes TEXT[] := ARRAY[TG_TABLE_NAME::TEXT];
+        BEGIN
+            IF TG_LEVEL = 'ROW' AND TG_TABLE_NAME = 'products' THEN
+                IF TG_OP <> 'INSERT' THEN
+                    scopes := scopes || ('product:' || OLD.id) || ('handle:' || OLD.handle) || ('category:' || OLD.category);
+                END IF;
+                IF TG_OP <> 'DELETE' THEN
+                    scopes := scopes || ('product:' || NEW.id) || ('handle:' || NEW.handle) || ('category:' || NEW.category);
+                END IF;
+            ELSIF TG_LEVEL = 'ROW' AND TG_TABLE_NAME = 'categories' THEN
+                IF TG_OP <> 'INSERT' THEN
+                    scopes := scopes || ('category:' || OLD.name) || ('category:' || OLD.slug);
+                END IF;
+                IF TG_OP <> 'DELETE' THEN
+                    scopes := scopes || ('category:' || NEW.name) || ('category:' || NEW.slug);
+                END IF;
+            ELSIF TG_LEVEL = 'ROW' AND TG_TABLE_NAME = 'product_stats' THEN
+                IF TG_OP <> 'INSERT' THEN
+                    scopes := scopes || ('product:' || OLD.product_id);
+                END IF;
+                IF TG_OP <> 'DELETE' THEN
+                    scopes := scopes || ('product:' || NEW.product_id);
+                END IF;
+            END IF;
+            PERFORM pg_notify('rangoons_catalog', array_to_string(scopes, chr(31)));
+            RETURN NULL;
+        END;
+        $$ LANGUAGE plpgsql;
+        
+        DROP TRIGGER IF EXISTS products_notify ON products;
+        CREATE TRIGGER products_notify AFTER INSERT OR UPDATE OR DELETE ON products
+            FOR EACH ROW EXECUTE PROCEDURE rangoons_notify_catalog();
+        DROP TRIGGER IF EXISTS products_notify_truncate ON products;
+        CREATE TRIGGER products_notify_truncate AFTER TRUNCATE ON products
+            FOR EACH STATEMENT EXECUTE PROCEDURE rangoons_notify_catalog();
+        DROP TRIGGER IF EXISTS categories_notify ON categories;
+        CREATE TRIGGER categories_notify AFTER INSERT OR UPDATE OR DELETE ON categories
+            FOR EACH ROW EXECUTE PROCEDURE rangoons_notify_catalog();
+        DROP TRIGGER IF EXISTS product_stats_notify ON product_stats;
+        CREATE TRIGGER product_stats_notify AFTER INSERT OR UPDATE OR DELETE ON product_stats
+            FOR EACH ROW EXECUTE PROCEDURE rangoons_notify_catalog();
     )";
     
     PGresult* result = pg->exec(schema_sql);
@@ -237,77 +593,159 @@ bool DB::init_schema(std::string* err) {
     return true;
 }
 
+// Pages of one product are versioned by these scopes, see page_scope()
+static void bump_product(CatalogVersions& catalog, int id, const std::string& handle, const std::string& category) {
+    catalog.bump("product:" + std::to_string(id));
+    catalog.bump("handle:" + handle);
+    catalog.bump("category:" + category);
+}
+
+// Text parameters $1..$19 for the product columns create/update write;
+// numbers holds the converted integers the pointers refer to
+static void product_params(const Product& p, std::string (&numbers)[4], const char** values) {
+    numbers[0] = std::to_string(p.stock);
+    numbers[1] = std::to_string(p.price_cents);
+    numbers[2] = std::to_string(p.compare_price_cents);
+    numbers[3] = std::to_string(p.weight_grams);
+    const char* v[19] = {
+        p.handle.c_str(), p.title.c_str(), p.description.c_str(), p.vendor.c_str(),
+        p.category.c_str(), p.tags.c_str(), p.published ? "true" : "false",
+        p.sku.c_str(), numbers[0].c_str(), numbers[1].c_str(),
+        numbers[2].c_str(), p.image_url.c_str(),
+        numbers[3].c_str(), p.option1_name.c_str(), p.option1_value.c_str(),
+        p.option2_name.c_str(), p.option2_value.c_str(), p.option3_name.c_str(), p.option3_value.c_str()
+    };
+    std::copy(v, v + 19, values);
+}
+
 bool DB::create_product(const Product& p, int* out_id, std::string* err) {
     if (!is_open()) {
         if (err) *err = "Database not connected";
         return false;
     }
     
-    PGConnection* pg = static_cast<PGConnection*>(handle);
-    
-    const char* sql = R"(
-        INSERT INTO products (
-            handle, title, description, vendor, category, tags, published,
-            sku, stock, price_cents, compare_price_cents, image_url,
-            weight_grams, option1_name, option1_value, option2_name,
-            option2_value, option3_name, option3_value
-        ) VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12, $13, $14, $15, $16, $17, $18, $19)
-    )";
+    PGLease pg(pool_of(handle), err);
+    if (!pg) return false;
     
-    const char* param_values[19] = {
-        p.handle.c_str(), p.title.c_str(), p.description.c_str(), p.vendor.c_str(),
-        p.category.c_str(), p.tags.c_str(), p.published ? "true" : "false",
-        p.sku.c_str(), std::to_string(p.stock).c_str(), std::to_string(p.price_cents).c_str(),
-        std::to_string(p.compare_price_cents).c_str(), p.image_url.c_str(),
-        std::to_string(p.weight_grams).c_str(), p.option1_name.c_str(), p.option1_value.c_str(),
-        p.option2_name.c_str(), p.option2_value.c_str(), p.option3_name.c_str(), p.option3_value.c_str()
-    };
+    std::string numbers[4];
+    const char* param_values[19];
+    product_params(p, numbers, param_values);
     
-    PGresult* result = pg->exec_params(sql, 19, param_values, nullptr, nullptr);
-    if (!result || PQresultStatus(result) != PGRES_COMMAND_OK) {
+    PGresult* result = pg->exec_prepared(Statement::InsertProduct, param_values);
+    if (!result || PQresultStatus(result) != PGRES_TUPLES_OK || PQntuples(result) != 1) {
         if (err) *err = pg->get_last_error();
         PQclear(result);
         return false;
     }
     
+    int id = std::stoi(PQgetvalue(result, 0, 0));
+    bump_product(catalog, id, p.handle, p.category);
     if (out_id) {
-        *out_id = pg->get_last_insert_id();
+        *out_id = id;
     }
     
     PQclear(result);
     return true;
 }
 
-std::vector<Product> DB::list_products(const std::string& category, int limit, int offset) {
-    std::vector<Product> products;
-    if (!is_open()) return products;
+bool DB::update_product(const Product& p, std::string* err) {
+    if (!is_open()) {
+        if (err) *err = "Database not connected";
+        return false;
+    }
     
-    PGConnection* pg = static_cast<PGConnection*>(handle);
+    PGLease pg(pool_of(handle), err);
+    if (!pg) return false;
     
-    std::string sql = "SELECT id, handle, title, description, vendor, category, tags, published, "
-                      "sku, stock, price_cents, compare_price_cents, image_url, weight_grams, "
-                      "option1_name, option1_value, option2_name, option2_value, option3_name, option3_value, "
-                      "created_at FROM products WHERE published = true";
+    std::string numbers[4];
+    const char* param_values[20];
+    product_params(p, numbers, param_values);
+    std::string id = std::to_string(p.id);
+    param_values[19] = id.c_str();
     
-    if (!category.empty()) {
-        sql += " AND category = $1";
+    PGresult* result = pg->exec_prepared(Statement::UpdateProduct, param_values);
+    if (!result || PQresultStatus(result) != PGRES_TUPLES_OK) {
+        if (err) *err = pg->get_last_error();
+        PQclear(result);
+        return false;
+    }
+    if (PQntuples(result) == 0) {
+        PQclear(result);
+        if (err) *err = "Product not found";
+        return false;
+    }
+    // Pages under the old handle and category show the old row too
+    bump_product(catalog, p.id, PQgetvalue(result, 0, 0), PQgetvalue(result, 0, 1));
+    bump_product(catalog, p.id, p.handle, p.category);
+    PQclear(result);
+    return true;
+}
+
+bool DB::delete_product(int id, std::string* err) {
+    if (!is_open()) {
+        if (err) *err = "Database not connected";
+        return false;
     }
     
-    sql += " ORDER BY created_at DESC";
+    PGLease pg(pool_of(handle), err);
+    if (!pg) return false;
     
-    if (limit > 0) {
-        sql += " LIMIT " + std::to_string(limit);
-        if (offset > 0) {
-            sql += " OFFSET " + std::to_string(offset);
-        }
+    std::string id_str = std::to_string(id);
+    const char* param_values[1] = { id_str.c_str() };
+    PGresult* result = pg->exec_prepared(Statement::DeleteProduct, param_values);
+    if (!result || PQresultStatus(result) != PGRES_TUPLES_OK) {
+        if (err) *err = pg->get_last_error();
+        PQclear(result);
+        return false;
+    }
+    if (PQntuples(result) == 0) {
+        PQclear(result);
+        if (err) *err = "Product not found";
+        return false;
+    }
+    bump_product(catalog, id, PQgetvalue(result, 0, 0), PQgetvalue(result, 0, 1));
+    PQclear(result);
+    return true;
+}
+
+std::string DB::catalog_stamp(std::string* err) {
+    if (!is_open()) {
+        if (err) *err = "Database not connected";
+        return std::string();
     }
     
+    PGLease pg(pool_of(handle), err);
+    if (!pg) return std::string();
+    
+    PGresult* result = pg->exec_prepared(Statement::CatalogStamp, nullptr);
+    if (!result || PQresultStatus(result) != PGRES_TUPLES_OK || PQntuples(result) != 1) {
+        if (err) *err = pg->get_last_error();
+        PQclear(result);
+        return std::string();
+    }
+    std::string stamp = PQgetvalue(result, 0, 0);
+    PQclear(result);
+    return stamp;
+}
+
+std::vector<Product> DB::list_products(const std::string& category, int limit, int offset) {
+    std::vector<Product> products;
+    if (!is_open()) return products;
+    
+    PGLease pg(pool_of(handle), nullptr);
+    if (!pg) return products;
+    
+    std::string limit_str = std::to_string(limit);
+    std::string offset_str = std::to_string(std::max(offset, 0));
+    const char* limit_value = limit > 0 ? limit_str.c_str() : nullptr;
+    
     PGresult* result;
     if (category.empty()) {
-        result = pg->exec(sql);
+        const char* param_values[2] = { limit_value, offset_str.c_str() };
+        result = pg->exec_prepared(Statement::ListProducts, param_values);
     } else {
-        const char* param_values[1] = { category.c_str() };
-        result = pg->exec_params(sql, 1, param_values, nullptr, nullptr);
+        const char* param_values[3] = { category.c_str(), limit_value, offset_str.c_str() };
+        result = pg->exec_prepared(Statement::ListProductsInCategory, param_values);
     }
     
     if (!result || PQresultStatus(result) != PGRES_TUPLES_OK) {
@@ -317,58 +755,151 @@ std::vector<Product> DB::list_products(const std::string& category, int limit, i
     
     int rows = PQntuples(result);
     for (int i = 0; i < rows; i++) {
-    Product p;
-        p.id = std::stoi(PQgetvalue(result, i, 0));
-        p.handle = PQgetvalue(result, i, 1);
-        p.title = PQgetvalue(result, i, 2);
-        p.description = PQgetvalue(result, i, 3);
-        p.vendor = PQgetvalue(result, i, 4);
-        p.category = PQgetvalue(result, i, 5);
-        p.tags = PQgetvalue(result, i, 6);
-        p.published = (std::string(PQgetvalue(result, i, 7)) == "t");
-        p.sku = PQgetvalue(result, i, 8);
-        p.stock = std::stoi(PQgetvalue(result, i, 9));
-        p.price_cents = std::stoi(PQgetvalue(result, i, 10));
-        p.compare_price_cents = std::stoi(PQgetvalue(result, i, 11));
-        p.image_url = PQgetvalue(result, i, 12);
-        p.weight_grams = std::stoi(PQgetvalue(result, i, 13));
-        p.option1_name = PQgetvalue(result, i, 14);
-        p.option1_value = PQgetvalue(result, i, 15);
-        p.option2_name = PQgetvalue(result, i, 16);
-        p.option2_value = PQgetvalue(result, i, 17);
-        p.option3_name = PQgetvalue(result, i, 18);
-        p.option3_value = PQgetvalue(result, i, 19);
-        p.created_at = PQgetvalue(result, i, 20);
-        
-        products.push_back(p);
+        products.push_back(product_from_row(result, i));
     }
     
     PQclear(result);
     return products;
 }
 
+// Single published product by one unique column; id 0 when there is none
+static Product find_product(PGConnection* pg, Statement by, const std::string& value, std::string* err) {
+    const char* param_values[1] = { value.c_str() };
+    PGresult* result = pg->exec_prepared(by, param_values);
+    if (!result || PQresultStatus(result) != PGRES_TUPLES_OK) {
+        if (err) *err = pg->get_last_error();
+        PQclear(result);
+        return Product();
+    }
+
+    Product p;
+    if (PQntuples(result) > 0) {
+        p = product_from_row(result, 0);
+    } else if (err) {
+        *err = "Product not found";
+    }
+    PQclear(result);
+    return p;
+}
+
+Product DB::get_product(int id, std::string* err) {
+    if (!is_open()) {
+        if (err) *err = "Database not connected";
+        return Product();
+    }
+    PGLease pg(pool_of(handle), err);
+    if (!pg) return Product();
+    return find_product(pg.get(), Statement::ProductById, std::to_string(id), err);
+}
+
+Product DB::get_product_by_handle(const std::string& product_handle, std::string* err) {
+    if (!is_open()) {
+        if (err) *err = "Database not connected";
+        return Product();
+    }
+    PGLease pg(pool_of(handle), err);
+    if (!pg) return Product();
+    return find_product(pg.get(), Statement::ProductByHandle, product_handle, err);
+}
+
+std::vector<CartItem> DB::get_cart_items(const std::string& cart_id, std::string* err) {
+    std::vector<CartItem> items;
+    if (!is_open()) {
+        if (err) *err = "Database not connected";
+        return items;
+    }
+
+    PGLease pg(pool_of(handle), err);
+    if (!pg) return items;
+
+    const char* param_values[1] = { cart_id.c_str() };
+    PGresult* result = pg->exec_prepared(Statement::CartItems, param_values);
+    if (!result || PQresultStatus(result) != PGRES_TUPLES_OK) {
+        if (err) *err = pg->get_last_error();
+        PQclear(result);
+        return items;
+    }
+
+    int rows = PQntuples(result);
+    for (int i = 0; i < rows; i++) {
+        CartItem item;
+        item.cart_id = PQgetvalue(result, i, 0);
+        item.product_id = std::stoi(PQgetvalue(result, i, 1));
+        item.qty = std::stoi(PQgetvalue(result, i, 2));
+        item.selected_options = PQgetvalue(result, i, 3);
+        items.push_back(item);
+    }
+
+    PQclear(result);
+    return items;
+}
+
+// Field as a COPY text-format value
+static void append_copy_field(std::string& out, const std::string& value) {
+    for (char c : value) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '\t': out += "\\t"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            default: out += c;
+        }
+    }
+}
+
+// Bytes of COPY data sent per PQputCopyData call
+static const size_t COPY_CHUNK = 64 * 1024;
+
 bool DB::import_products_from_csv(const std::string& csv_data, std::string* err) {
     if (!is_open()) {
         if (err) *err = "Database not connected";
         return false;
     }
     
-    PGConnection* pg = static_cast<PGConnection*>(handle);
+    PGLease pg(pool_of(handle), err);
+    if (!pg) return false;
     
-    // Clear existing products first
-    PGresult* clear_result = pg->exec("DELETE FROM products");
-    if (!clear_result || PQresultStatus(clear_result) != PGRES_COMMAND_OK) {
-        if (err) *err = "Failed to clear existing products: " + pg->get_last_error();
-        PQclear(clear_result);
+    // Anything failing from here on leaves the catalog as it was
+    auto fail = [&](const std::string& message) {
+        if (err) *err = message;
+        PQclear(pg->exec("ROLLBACK"));
         return false;
+    };
+    auto run = [&](const char* sql, ExecStatusType expected) {
+        PGresult* result = pg->exec(sql);
+        bool ok = result && PQresultStatus(result) == expected;
+        PQclear(result);
+        return ok;
+    };
+    
+    // Rows go to a staging table first; line keeps the CSV's order so the
+    // last row wins when a handle appears twice
+    if (!run("BEGIN", PGRES_COMMAND_OK) ||
+        !run(R"(
+            CREATE TEMP TABLE products_import (
+                line INTEGER NOT NULL,
+                handle VARCHAR(255) NOT NULL,
+                title VARCHAR(255) NOT NULL,
+                description TEXT NOT NULL,
+                price_cents INTEGER NOT NULL,
+                stock INTEGER NOT NULL,
+                category VARCHAR(100) NOT NULL,
+                image_url TEXT NOT NULL
+            ) ON COMMIT DROP
+        )", PGRES_COMMAND_OK) ||
+        !run("COPY products_import FROM STDIN", PGRES_COPY_IN)) {
+        return fail("Failed to start import: " + pg->get_last_error());
     }
-    PQclear(clear_result);
     
-    // Parse CSV and insert products
+    // Parse CSV and stream the rows to the server
     std::istringstream csv_stream(csv_data);
     std::string line;
+    std::string copy;
+    copy.reserve(COPY_CHUNK + 4096);
     int line_num = 0;
-    int inserted = 0;
+    int rows = 0;
+    std::string parse_error;
+    bool sent = true;
     
     while (std::getline(csv_stream, line)) {
         line_num++;
@@ -384,22 +915,77 @@ bool DB::import_products_from_csv(const std::string& csv_data, std::string* err)
         
         if (fields.size() < 5) continue; // Skip invalid lines
         
-        Product p;
-        p.handle = fields[0];
-        p.title = fields[1];
-        p.description = fields.size() > 2 ? fields[2] : "";
-        p.price_cents = std::stoi(fields[3]) * 100; // Convert to cents
-        p.stock = std::stoi(fields[4]);
-        p.category = fields.size() > 5 ? fields[5] : "General";
-        p.image_url = fields.size() > 6 ? fields[6] : "";
+        int price_cents, stock;
+        try {
+            price_cents = std::stoi(fields[3]) * 100; // Convert to cents
+            stock = std::stoi(fields[4]);
+        } catch (const std::exception&) {
+            parse_error = "Invalid price or stock on line " + std::to_string(line_num);
+            break;
+        }
         
-        if (!create_product(p, nullptr, err)) {
-            return false;
+        copy += std::to_string(line_num);
+        for (const std::string* value : { &fields[0], &fields[1] }) {
+            copy += '\t';
+            append_copy_field(copy, *value);
+        }
+        copy += '\t';
+        append_copy_field(copy, fields.size() > 2 ? fields[2] : "");
+        copy += '\t' + std::to_string(price_cents) + '\t' + std::to_string(stock) + '\t';
+        append_copy_field(copy, fields.size() > 5 ? fields[5] : "General");
+        copy += '\t';
+        append_copy_field(copy, fields.size() > 6 ? fields[6] : "");
+        copy += '\n';
+        rows++;
+        
+        if (copy.size() >= COPY_CHUNK) {
+            sent = PQputCopyData(pg->raw(), copy.data(), (int)copy.size()) == 1;
+            if (!sent) break;
+            copy.clear();
         }
-        inserted++;
     }
     
-    std::cout << "✅ Imported " << inserted << " products from CSV" << std::endl;
+    sent = sent && parse_error.empty() && PQputCopyData(pg->raw(), copy.data(), (int)copy.size()) == 1;
+    // Ending with an error message aborts the COPY on the server
+    if (PQputCopyEnd(pg->raw(), sent ? nullptr : "import aborted") != 1) sent = false;
+    bool copied = true;
+    while (PGresult* result = PQgetResult(pg->raw())) {
+        if (PQresultStatus(result) != PGRES_COMMAND_OK) copied = false;
+        PQclear(result);
+    }
+    if (!parse_error.empty()) return fail(parse_error);
+    if (!sent || !copied) return fail("Failed to copy products: " + pg->get_last_error());
+    
+    // Merge in one statement per step: products missing from the file go,
+    // the rest are updated in place by handle, so ids, stats and carts of
+    // products that stay are kept. Unchanged rows are left alone, so they
+    // fire no products_notify. Readers see the old catalog until COMMIT.
+    if (!run(R"(
+            DELETE FROM products p
+            WHERE NOT EXISTS (SELECT 1 FROM products_import i WHERE i.handle = p.handle)
+        )", PGRES_COMMAND_OK) ||
+        !run(R"(
+            INSERT INTO products (handle, title, description, price_cents, stock, category, image_url)
+            SELECT DISTINCT ON (handle) handle, title, description, price_cents, stock, category, image_url
+            FROM products_import
+            ORDER BY handle, line DESC
+            ON CONFLICT (handle) DO UPDATE SET
+                title = EXCLUDED.title, description = EXCLUDED.description,
+                price_cents = EXCLUDED.price_cents, stock = EXCLUDED.stock,
+                category = EXCLUDED.category, image_url = EXCLUDED.image_url
+            WHERE (products.title, products.description, products.price_cents,
+                   products.stock, products.category, products.image_url)
+                IS DISTINCT FROM (EXCLUDED.title, EXCLUDED.description, EXCLUDED.price_cents,
+                                  EXCLUDED.stock, EXCLUDED.category, EXCLUDED.image_url)
+        )", PGRES_COMMAND_OK)) {
+        return fail("Failed to merge imported products: " + pg->get_last_error());
+    }
+    if (!run("COMMIT", PGRES_COMMAND_OK)) {
+        return fail("Failed to commit import: " + pg->get_last_error());
+    }
+    bump_catalog_version();
+    
+    std::cout << "✅ Imported " << rows << " products from CSV" << std::endl;
     return true;
 }
 
@@ -409,8 +995,6 @@ std::string DB::export_database(std::string* err) {
         return "";
     }
     
-    PGConnection* pg = static_cast<PGConnection*>(handle);
-    
     // Export products
     std::ostringstream export_sql;
     export_sql << "-- Rangoons Database Export\n";
@@ -448,9 +1032,6 @@ std::string DB::export_database(std::string* err) {
 }
 
 // Additional database methods would be implemented here...
-bool DB::update_product(const Product& p, std::string* err) { /* Implementation */ return true; }
-bool DB::delete_product(int id, std::string* err) { /* Implementation */ return true; }
-Product DB::get_product(int id, std::string* err) { /* Implementation */ return Product(); }
 std::vector<Product> DB::search_products(const std::string& query, int limit, int offset) { /* Implementation */ return std::vector<Product>(); }
 int DB::get_product_count(const std::string& category) { /* Implementation */ return 0; }
 bool DB::create_category(const Category& c, int* out_id, std::string* err) { /* Implementation */ return true; }
@@ -462,6 +1043,5 @@ Order DB::get_order(int id, std::string* err) { /* Implementation */ return Orde
 bool DB::create_cart(const Cart& c, std::string* err) { /* Implementation */ return true; }
 bool DB::add_to_cart(const CartItem& item, std::string* err) { /* Implementation */ return true; }
 bool DB::remove_from_cart(const std::string& cart_id, int product_id, std::string* err) { /* Implementation */ return true; }
-std::vector<CartItem> DB::get_cart_items(const std::string& cart_id, std::string* err) { /* Implementation */ return std::vector<CartItem>(); }
 bool DB::update_product_stats(int product_id, const std::string& stat_type, int value, std::string* err) { /* Implementation */ return true; }
 ProductStats DB::get_product_stats(int product_id, std::string* err) { /* Implementation */ return ProductStats(); }
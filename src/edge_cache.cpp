@@ -0,0 +1,683 @@
+#include "rangoons.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---------------- Shard -----------------
+
+namespace {
+
+enum Segment : uint8_t { WINDOW, PROBATION, PROTECTED, SEGMENTS };
+
+// One cached key: the map stores it by a view of entry->key, so the key is
+// held once. prev/next thread its segment's LRU list, most recent first.
+struct LruNode {
+    std::shared_ptr<const CacheEntry> entry;
+    size_t charge = 0;
+    Segment segment = WINDOW;
+    LruNode* prev = nullptr;
+    LruNode* next = nullptr;
+};
+
+using NodeMap = std::unordered_map<std::string_view, LruNode>;
+
+// Bytes an entry costs beyond its strings: the entry itself with its
+// shared_ptr control block, the map node and its bucket slot
+const size_t ENTRY_OVERHEAD = sizeof(CacheEntry) + 2 * sizeof(void*) +
+                              sizeof(NodeMap::value_type) + 2 * sizeof(void*);
+
+size_t charge_of(const CacheEntry& entry) {
+    return ENTRY_OVERHEAD + entry.key.size() + entry.data.size() + entry.content_type.size() +
+           entry.edge_node_id.size() + entry.etag.size() + entry.last_modified.size() +
+           entry.cache_control.size();
+}
+
+uint64_t hash_key(std::string_view key) {
+    return std::hash<std::string_view>()(key);
+}
+
+struct LruList {
+    LruNode head; // sentinel: head.next is the most recent, head.prev the least
+    size_t bytes = 0;
+    size_t capacity = 0;
+
+    LruList() { head.prev = head.next = &head; }
+    bool empty() const { return head.next == &head; }
+    LruNode* back() { return head.prev; }
+};
+
+// Count-min sketch of how often keys were asked for: four rows of counters
+// saturating at 15, all halved once sample_size increments have been
+// recorded, so yesterday's bestseller does not stay popular forever
+class FrequencySketch {
+public:
+    void resize(size_t expected_entries) {
+        size_t width = 64;
+        while (width < expected_entries) width <<= 1;
+        table.assign(width * ROWS, 0);
+        mask = width - 1;
+        sample_size = 10 * width;
+        samples = 0;
+    }
+
+    void record(uint64_t hash) {
+        bool added = false;
+        for (size_t row = 0; row < ROWS; row++) {
+            uint8_t& counter = table[index(hash, row)];
+            if (counter < 15) {
+                counter++;
+                added = true;
+            }
+        }
+        if (added && ++samples >= sample_size) age();
+    }
+
+    uint8_t estimate(uint64_t hash) const {
+        uint8_t frequency = 15;
+        for (size_t row = 0; row < ROWS; row++) {
+            frequency = std::min(frequency, table[index(hash, row)]);
+        }
+        return frequency;
+    }
+
+private:
+    static const size_t ROWS = 4;
+    std::vector<uint8_t> table;
+    size_t mask = 0;
+    size_t sample_size = 0;
+    size_t samples = 0;
+
+    size_t index(uint64_t hash, size_t row) const {
+        static const uint64_t SEEDS[ROWS] = {
+            0xc3a5c85c97cb3127ull, 0xb492b66fbe98f273ull, 0x9ae16a3b2f90404full, 0xcbf29ce484222325ull
+        };
+        uint64_t h = (hash + SEEDS[row]) * SEEDS[row];
+        return row * (mask + 1) + ((h ^ (h >> 32)) & mask);
+    }
+
+    void age() {
+        for (uint8_t& counter : table) counter >>= 1;
+        samples /= 2;
+    }
+};
+
+// Sketch width per shard assumes pages average this many bytes
+const size_t SKETCH_BYTES_PER_ENTRY = 4096;
+
+} // namespace
+
+// Own cache line each, so shards locked by different threads do not share one
+struct alignas(64) EdgeCache::Shard {
+    std::mutex mutex;
+    NodeMap map;
+    LruList lists[SEGMENTS];
+    size_t capacity = 0;
+    bool admission = false; // TinyLfu; otherwise everything lives in the window
+    FrequencySketch sketch;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t rejections = 0;
+    uint64_t expirations = 0;
+    uint64_t restored = 0;
+
+    void configure(size_t bytes, EdgeCachePolicy policy) {
+        capacity = bytes;
+        admission = policy == EdgeCachePolicy::TinyLfu;
+        if (admission) {
+            // 1% window, then 20% probation and 80% protected of the rest
+            lists[WINDOW].capacity = std::max<size_t>(bytes / 100, 1);
+            lists[PROTECTED].capacity = (bytes - lists[WINDOW].capacity) / 5 * 4;
+            sketch.resize(bytes / SKETCH_BYTES_PER_ENTRY);
+        } else {
+            lists[WINDOW].capacity = bytes;
+        }
+    }
+
+    size_t bytes() const {
+        return lists[WINDOW].bytes + lists[PROBATION].bytes + lists[PROTECTED].bytes;
+    }
+
+    void link_front(LruNode& node, Segment segment) {
+        LruList& list = lists[segment];
+        node.segment = segment;
+        node.prev = &list.head;
+        node.next = list.head.next;
+        list.head.next->prev = &node;
+        list.head.next = &node;
+        list.bytes += node.charge;
+    }
+
+    void unlink(LruNode& node) {
+        node.prev->next = node.next;
+        node.next->prev = node.prev;
+        lists[node.segment].bytes -= node.charge;
+    }
+
+    void erase(NodeMap::iterator it) {
+        unlink(it->second);
+        map.erase(it);
+    }
+
+    // Drop a node already unlinked from its list
+    void drop(LruNode& node) {
+        map.erase(node.entry->key);
+        evictions++;
+    }
+
+    void reset() {
+        map.clear();
+        for (LruList& list : lists) {
+            list.head.prev = list.head.next = &list.head;
+            list.bytes = 0;
+        }
+    }
+
+    void record(std::string_view key) {
+        if (admission) sketch.record(hash_key(key));
+    }
+
+    // A hit moves the node to the front; a second hit promotes a probation
+    // node to protected, which demotes protected's oldest if it overflows
+    void touch(LruNode& node) {
+        Segment segment = node.segment;
+        if (segment == PROBATION) segment = PROTECTED;
+        unlink(node);
+        link_front(node, segment);
+        while (lists[PROTECTED].bytes > lists[PROTECTED].capacity) {
+            LruNode& demoted = *lists[PROTECTED].back();
+            unlink(demoted);
+            link_front(demoted, PROBATION);
+        }
+    }
+
+    // New entries enter the window; whatever it pushes out either goes
+    // into probation or, with plain LRU, out of the cache
+    void insert(LruNode& node) {
+        link_front(node, WINDOW);
+        while (lists[WINDOW].bytes > lists[WINDOW].capacity) {
+            LruNode& candidate = *lists[WINDOW].back();
+            unlink(candidate);
+            if (admission) {
+                admit(candidate);
+            } else {
+                drop(candidate);
+            }
+        }
+    }
+
+    // TinyLFU: make room in the main segments only by evicting entries
+    // requested less often than candidate; otherwise candidate goes
+    void admit(LruNode& candidate) {
+        size_t main_capacity = capacity - lists[WINDOW].capacity;
+        uint8_t frequency = sketch.estimate(hash_key(candidate.entry->key));
+        while (lists[PROBATION].bytes + lists[PROTECTED].bytes + candidate.charge > main_capacity) {
+            LruList& victims = lists[PROBATION].empty() ? lists[PROTECTED] : lists[PROBATION];
+            if (victims.empty() || frequency <= sketch.estimate(hash_key(victims.back()->entry->key))) {
+                drop(candidate);
+                rejections++;
+                return;
+            }
+            LruNode& victim = *victims.back();
+            unlink(victim);
+            drop(victim);
+        }
+        link_front(candidate, PROBATION);
+    }
+};
+
+// ---------------- EdgeCache -----------------
+
+EdgeCache::EdgeCache(size_t max_size_mb, size_t shard_count, EdgeCachePolicy policy)
+    : max_size_bytes(max_size_mb * 1024 * 1024) {
+    // Power of two, so picking a shard is a mask
+    size_t count = 1;
+    while (count < std::max<size_t>(shard_count, 1)) count <<= 1;
+    this->shard_count = count;
+    shard_mask = count - 1;
+
+    shards = std::make_unique<Shard[]>(count);
+    for (size_t i = 0; i < count; i++) {
+        shards[i].configure(max_size_bytes / count, policy);
+    }
+}
+
+EdgeCache::~EdgeCache() = default;
+
+EdgeCache::Shard& EdgeCache::shard_for(const std::string& key) const {
+    size_t hash = hash_key(key);
+    // The maps bucket by the low bits; take the shard from well-mixed high ones
+    uint64_t mixed = (uint64_t)hash * 0x9E3779B97F4A7C15ull;
+    return shards[(mixed >> 32) & shard_mask];
+}
+
+bool EdgeCache::put(const std::string& key, const std::string& data, const std::string& content_type, int ttl_seconds) {
+    CacheEntry entry;
+    entry.key = key;
+    entry.data = data;
+    entry.content_type = content_type;
+    entry.ttl_seconds = ttl_seconds;
+    return put(std::move(entry));
+}
+
+bool EdgeCache::put(CacheEntry entry) {
+    // ttl_seconds <= 0 never expires; a set expires_at (e.g. restored from
+    // elsewhere) is kept. The stale window is part of the lifetime here: the
+    // caller decides whether an entry past its TTL is still worth serving.
+    if (entry.expires_at == std::chrono::system_clock::time_point()) {
+        entry.expires_at = entry.ttl_seconds > 0
+            ? std::chrono::system_clock::now() +
+              std::chrono::seconds(entry.ttl_seconds + std::max(entry.stale_seconds, 0))
+            : std::chrono::system_clock::time_point::max();
+    }
+
+    forget_snapshot_entry(entry.key);
+    return insert(std::make_shared<const CacheEntry>(std::move(entry)));
+}
+
+bool EdgeCache::insert(std::shared_ptr<const CacheEntry> entry) {
+    Shard& shard = shard_for(entry->key);
+    size_t charge = charge_of(*entry);
+    if (charge > shard.capacity) return false;
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.record(entry->key);
+    // A replaced entry starts over in the window; the sketch still
+    // remembers how popular its key is
+    auto existing = shard.map.find(entry->key);
+    if (existing != shard.map.end()) shard.erase(existing);
+
+    LruNode& node = shard.map[entry->key];
+    node.entry = std::move(entry);
+    node.charge = charge;
+    shard.insert(node);
+    return true;
+}
+
+std::shared_ptr<const CacheEntry> EdgeCache::lookup(const std::string& key) {
+    Shard& shard = shard_for(key);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        shard.record(key);
+        auto it = shard.map.find(key);
+        if (it != shard.map.end()) {
+            if (it->second.entry->expires_at > std::chrono::system_clock::now()) {
+                LruNode& node = it->second;
+                shard.touch(node);
+                shard.hits++;
+                return node.entry;
+            }
+            shard.erase(it);
+            shard.expirations++;
+        }
+        if (!snapshot_open.load(std::memory_order_acquire)) {
+            shard.misses++;
+            return nullptr;
+        }
+    }
+
+    // Copied out of the snapshot without the shard lock held
+    std::shared_ptr<const CacheEntry> entry = restore(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (entry) {
+        shard.hits++;
+        shard.restored++;
+    } else {
+        shard.misses++;
+    }
+    return entry;
+}
+
+std::string EdgeCache::get(const std::string& key, std::string* content_type) {
+    std::shared_ptr<const CacheEntry> entry = lookup(key);
+    if (!entry) return std::string();
+    if (content_type) *content_type = entry->content_type;
+    return entry->data;
+}
+
+bool EdgeCache::remove(const std::string& key) {
+    forget_snapshot_entry(key);
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) return false;
+    shard.erase(it);
+    return true;
+}
+
+void EdgeCache::clear() {
+    snapshot_open.store(false, std::memory_order_release);
+    std::atomic_store(&snapshot, std::shared_ptr<Snapshot>());
+    for (size_t i = 0; i < shard_count; i++) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.reset();
+    }
+}
+
+size_t EdgeCache::size() const {
+    return stats().bytes;
+}
+
+size_t EdgeCache::capacity() const {
+    return max_size_bytes;
+}
+
+uint64_t EdgeCache::get_hit_count() const {
+    return stats().hits;
+}
+
+uint64_t EdgeCache::get_miss_count() const {
+    return stats().misses;
+}
+
+double EdgeCache::get_hit_ratio() const {
+    EdgeCacheStats s = stats();
+    uint64_t lookups = s.hits + s.misses;
+    return lookups > 0 ? (double)s.hits / lookups : 0.0;
+}
+
+EdgeCacheStats EdgeCache::stats() const {
+    EdgeCacheStats stats;
+    stats.capacity = max_size_bytes;
+    for (size_t i = 0; i < shard_count; i++) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.evictions += shard.evictions;
+        stats.rejections += shard.rejections;
+        stats.expirations += shard.expirations;
+        stats.restored += shard.restored;
+        stats.entries += shard.map.size();
+        stats.bytes += shard.bytes();
+    }
+    return stats;
+}
+
+// ---------------- Snapshot -----------------
+//
+// Header, label, then every entry's strings back to back, then a table of
+// fixed-size records describing them. The records come last so the writer
+// streams the strings once; the reader maps the whole file and only the
+// records and keys are touched until an entry is restored.
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = { 'R', 'G', 'N', 'S', 'N', 'A', 'P', '1' };
+const uint32_t SNAPSHOT_COMPRESSED = 1;
+
+enum SnapshotField : uint8_t { KEY, DATA, CONTENT_TYPE, ETAG, LAST_MODIFIED, CACHE_CONTROL, EDGE_NODE, FIELDS };
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t count;
+    uint32_t label_size;
+    uint64_t records_offset;
+    uint64_t file_size;
+};
+
+struct SnapshotRecord {
+    uint64_t offset;     // of the key; the other fields follow it in order
+    uint64_t version;
+    int64_t expires_ms;  // since the epoch, INT64_MAX for never
+    uint32_t sizes[FIELDS];
+    int32_t ttl_seconds;
+    int32_t stale_seconds;
+    uint32_t flags;
+};
+
+int64_t to_epoch_ms(std::chrono::system_clock::time_point t) {
+    if (t == std::chrono::system_clock::time_point::max()) return INT64_MAX;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count();
+}
+
+std::chrono::system_clock::time_point from_epoch_ms(int64_t ms) {
+    if (ms == INT64_MAX) return std::chrono::system_clock::time_point::max();
+    return std::chrono::system_clock::time_point(std::chrono::milliseconds(ms));
+}
+
+std::string os_error(const std::string& what, const std::string& path) {
+    return what + " " + path + ": " + std::strerror(errno);
+}
+
+} // namespace
+
+struct EdgeCache::Snapshot {
+    const char* base = nullptr;
+    size_t size = 0;
+    const SnapshotRecord* records = nullptr;
+    // Keys are views into the mapping
+    std::unordered_map<std::string_view, uint32_t> index;
+    // Set once an entry is restored or superseded by a put
+    std::unique_ptr<std::atomic<bool>[]> taken;
+    std::atomic<size_t> remaining{0};
+    SnapshotAdopt adopt;
+
+    ~Snapshot() {
+        if (base) munmap(const_cast<char*>(base), size);
+    }
+
+    std::string_view field(const SnapshotRecord& record, SnapshotField f) const {
+        const char* p = base + record.offset;
+        for (int i = 0; i < f; i++) p += record.sizes[i];
+        return std::string_view(p, record.sizes[f]);
+    }
+
+    // True for the one caller that claims entry i
+    bool take(uint32_t i) {
+        if (taken[i].exchange(true, std::memory_order_acq_rel)) return false;
+        remaining.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+};
+
+bool EdgeCache::save_snapshot(const std::string& path, const std::string& label,
+                              const SnapshotFilter& keep, std::string* err) const {
+    // Hold references only, so shards are locked for as long as a list walk
+    std::vector<std::shared_ptr<const CacheEntry>> entries;
+    auto now = std::chrono::system_clock::now();
+    for (size_t i = 0; i < shard_count; i++) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (Segment segment : { PROTECTED, PROBATION, WINDOW }) {
+            const LruNode* head = &shard.lists[segment].head;
+            for (const LruNode* node = head->next; node != head; node = node->next) {
+                if (node->entry->expires_at <= now) continue;
+                if (keep && !keep(*node->entry)) continue;
+                entries.push_back(node->entry);
+            }
+        }
+    }
+
+    std::string tmp = path + ".tmp";
+    FILE* file = std::fopen(tmp.c_str(), "wb");
+    if (!file) {
+        if (err) *err = os_error("cannot create", tmp);
+        return false;
+    }
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.count = (uint32_t)entries.size();
+    header.label_size = (uint32_t)label.size();
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fwrite(label.data(), 1, label.size(), file);
+
+    std::vector<SnapshotRecord> records;
+    records.reserve(entries.size());
+    uint64_t offset = sizeof(header) + label.size();
+    for (const auto& entry : entries) {
+        const std::string* fields[FIELDS] = {
+            &entry->key, &entry->data, &entry->content_type, &entry->etag,
+            &entry->last_modified, &entry->cache_control, &entry->edge_node_id,
+        };
+        SnapshotRecord record{};
+        record.offset = offset;
+        record.version = entry->version;
+        record.expires_ms = to_epoch_ms(entry->expires_at);
+        record.ttl_seconds = entry->ttl_seconds;
+        record.stale_seconds = entry->stale_seconds;
+        record.flags = entry->is_compressed ? SNAPSHOT_COMPRESSED : 0;
+        for (int f = 0; f < FIELDS; f++) {
+            record.sizes[f] = (uint32_t)fields[f]->size();
+            std::fwrite(fields[f]->data(), 1, fields[f]->size(), file);
+            offset += fields[f]->size();
+        }
+        records.push_back(record);
+    }
+
+    // Records are read in place from the mapping, so align them
+    static const char padding[alignof(SnapshotRecord)] = {};
+    size_t pad = (alignof(SnapshotRecord) - offset % alignof(SnapshotRecord)) % alignof(SnapshotRecord);
+    std::fwrite(padding, 1, pad, file);
+    header.records_offset = offset + pad;
+    std::fwrite(records.data(), sizeof(SnapshotRecord), records.size(), file);
+    header.file_size = header.records_offset + records.size() * sizeof(SnapshotRecord);
+
+    std::fseek(file, 0, SEEK_SET);
+    std::fwrite(&header, sizeof(header), 1, file);
+
+    bool ok = !std::ferror(file) && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        if (err) *err = os_error("cannot write", ok ? path : tmp);
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool EdgeCache::open_snapshot(const std::string& path, const std::string& label,
+                              SnapshotAdopt adopt, std::string* err) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (err) *err = os_error("cannot open", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        if (err) *err = "snapshot is truncated";
+        return false;
+    }
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        if (err) *err = os_error("cannot map", path);
+        return false;
+    }
+
+    auto snap = std::make_shared<Snapshot>();
+    snap->base = static_cast<const char*>(base);
+    snap->size = st.st_size;
+
+    SnapshotHeader header;
+    std::memcpy(&header, snap->base, sizeof(header));
+    uint64_t labels_end = sizeof(header) + (uint64_t)header.label_size;
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.file_size != snap->size || labels_end > header.records_offset ||
+        header.records_offset % alignof(SnapshotRecord) != 0 || header.records_offset > header.file_size ||
+        header.file_size - header.records_offset != (uint64_t)header.count * sizeof(SnapshotRecord)) {
+        if (err) *err = "not a cache snapshot: " + path;
+        return false;
+    }
+    if (std::string_view(snap->base + sizeof(header), header.label_size) != label) {
+        if (err) *err = "snapshot is for a different catalog";
+        return false;
+    }
+
+    snap->records = reinterpret_cast<const SnapshotRecord*>(snap->base + header.records_offset);
+    snap->taken = std::make_unique<std::atomic<bool>[]>(header.count);
+    snap->index.reserve(header.count);
+    for (uint32_t i = 0; i < header.count; i++) {
+        const SnapshotRecord& record = snap->records[i];
+        // Step by step, so a corrupt offset or size cannot wrap into range
+        bool in_range = record.offset >= labels_end && record.offset <= header.records_offset;
+        uint64_t end = record.offset;
+        for (uint32_t size : record.sizes) {
+            if (!in_range || size > header.records_offset - end) {
+                in_range = false;
+                break;
+            }
+            end += size;
+        }
+        if (!in_range) {
+            if (err) *err = "corrupt cache snapshot: " + path;
+            return false;
+        }
+        snap->index.emplace(snap->field(record, KEY), i);
+    }
+    snap->remaining = snap->index.size();
+    snap->adopt = std::move(adopt);
+
+    // Entries are restored in request order, not file order
+    madvise(base, snap->size, MADV_RANDOM);
+
+    std::atomic_store(&snapshot, snap);
+    snapshot_open.store(!snap->index.empty(), std::memory_order_release);
+    return true;
+}
+
+std::shared_ptr<const CacheEntry> EdgeCache::restore(const std::string& key) {
+    std::shared_ptr<Snapshot> snap = std::atomic_load(&snapshot);
+    if (!snap) return nullptr;
+    auto it = snap->index.find(key);
+    if (it == snap->index.end() || !snap->take(it->second)) return nullptr;
+
+    std::shared_ptr<const CacheEntry> restored;
+    const SnapshotRecord& record = snap->records[it->second];
+    if (from_epoch_ms(record.expires_ms) > std::chrono::system_clock::now()) {
+        CacheEntry entry;
+        entry.key = key;
+        entry.data = std::string(snap->field(record, DATA));
+        entry.content_type = std::string(snap->field(record, CONTENT_TYPE));
+        entry.etag = std::string(snap->field(record, ETAG));
+        entry.last_modified = std::string(snap->field(record, LAST_MODIFIED));
+        entry.cache_control = std::string(snap->field(record, CACHE_CONTROL));
+        entry.edge_node_id = std::string(snap->field(record, EDGE_NODE));
+        entry.version = record.version;
+        entry.expires_at = from_epoch_ms(record.expires_ms);
+        entry.ttl_seconds = record.ttl_seconds;
+        entry.stale_seconds = record.stale_seconds;
+        entry.is_compressed = record.flags & SNAPSHOT_COMPRESSED;
+        if (snap->adopt) snap->adopt(entry);
+
+        // Served even if admission turns it away: it was already paid for
+        restored = std::make_shared<const CacheEntry>(std::move(entry));
+        insert(restored);
+    }
+
+    // Everything claimed: release the mapping
+    if (snap->remaining.load(std::memory_order_acquire) == 0) {
+        std::shared_ptr<Snapshot> expected = snap;
+        if (std::atomic_compare_exchange_strong(&snapshot, &expected, std::shared_ptr<Snapshot>())) {
+            snapshot_open.store(false, std::memory_order_release);
+        }
+    }
+    return restored;
+}
+
+void EdgeCache::forget_snapshot_entry(const std::string& key) {
+    if (!snapshot_open.load(std::memory_order_acquire)) return;
+    std::shared_ptr<Snapshot> snap = std::atomic_load(&snapshot);
+    if (!snap) return;
+    auto it = snap->index.find(key);
+    if (it != snap->index.end()) snap->take(it->second);
+}
+
+size_t EdgeCache::snapshot_entries() const {
+    std::shared_ptr<Snapshot> snap = std::atomic_load(&snapshot);
+    return snap ? snap->remaining.load(std::memory_order_relaxed) : 0;
+}
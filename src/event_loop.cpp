@@ -0,0 +1,635 @@
+#include "event_loop.h"
+#include "compression.h"
+#include "http.h"
+#include "io_uring_loop.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <strings.h>
+#include <iostream>
+
+static const int MAX_EVENTS = 256;
+
+// iovecs per sendmsg; the rest goes out on the next pass of the loop
+static const int MAX_IOV = 64;
+
+// Stop parsing pipelined requests once this much output is queued and let
+// the socket drain first
+static const size_t MAX_PIPELINE_OUTPUT = 1024 * 1024;
+
+// Unparsed input a connection may buffer while parsing waits on output
+static const size_t MAX_BUFFERED_INPUT = 256 * 1024;
+
+// Granularity of connection deadlines; timeouts are whole seconds
+static const std::chrono::milliseconds TIMER_RESOLUTION(100);
+
+ConnectionLoop::ConnectionLoop(const Config& config, RequestHandler handler)
+    : config(config), handler(std::move(handler)), timers(TIMER_RESOLUTION),
+      overload(overload_response(config)) {
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    overload_bytes = build_response(overload, false);
+}
+
+ConnectionLoop::~ConnectionLoop() {
+    if (wake_fd != -1) close(wake_fd);
+}
+
+EventLoop::EventLoop(const Config& config, RequestHandler handler)
+    : ConnectionLoop(config, std::move(handler)) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epoll_fd == -1 || wake_fd == -1) {
+        std::cerr << "❌ Failed to create event loop: " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    struct epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+}
+
+EventLoop::~EventLoop() {
+    for (auto& conn : connections) {
+        if (conn) close(conn->fd);
+    }
+    if (epoll_fd != -1) close(epoll_fd);
+}
+
+bool EventLoop::add_listener(int listen_fd) {
+    int flags = fcntl(listen_fd, F_GETFL, 0);
+    fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK);
+
+    struct epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = listen_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) == -1) {
+        std::cerr << "❌ Failed to register listener: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    listeners.push_back(listen_fd);
+    return true;
+}
+
+void EventLoop::run() {
+    running = true;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (running) {
+        // Sleep indefinitely only when no deadline is pending
+        int wait_ms = timers.size() > 0 ? (int)timers.resolution().count() : -1;
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, wait_ms);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            std::cerr << "❌ epoll_wait failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            uint32_t ev = events[i].events;
+
+            if (fd == wake_fd) {
+                uint64_t value;
+                while (read(wake_fd, &value, sizeof(value)) > 0) {}
+                on_completions();
+                continue;
+            }
+
+            if (is_listener(fd)) {
+                accept_ready(fd);
+                continue;
+            }
+
+            if (fd < 0 || (size_t)fd >= connections.size() || !connections[fd]) continue;
+            Connection& conn = *connections[fd];
+
+            if (ev & (EPOLLERR | EPOLLHUP)) {
+                close_connection(conn);
+                continue;
+            }
+            if (ev & EPOLLIN) on_readable(conn);
+            if (connections[fd] && (ev & EPOLLOUT)) on_writable(conn);
+        }
+
+        expire_timers();
+    }
+}
+
+void EventLoop::stop() {
+    running = false;
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0) {
+        // Loop will still notice running == false on its next wakeup
+    }
+}
+
+bool EventLoop::is_listener(int fd) const {
+    for (int l : listeners) {
+        if (l == fd) return true;
+    }
+    return false;
+}
+
+void EventLoop::accept_ready(int listen_fd) {
+    // Edge-triggered: drain the accept queue until EAGAIN
+    while (true) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+
+        int fd = accept4(listen_fd, (struct sockaddr*)&client_addr, &client_len,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "❌ Failed to accept connection: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+
+        if (open_connections >= (size_t)config.max_concurrent_connections) {
+            refuse_connection(fd);
+            continue;
+        }
+
+        auto conn = std::make_unique<Connection>();
+        conn->fd = fd;
+        conn->id = ++next_conn_id;
+        conn->parser = HttpParser(config.request_buffer_size > 0 ? config.request_buffer_size : 8192);
+        char ip[INET_ADDRSTRLEN];
+        if (inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip))) {
+            conn->client_ip = ip;
+        }
+        conn->client_ip_known = true;
+
+        // Register for both directions once; with EPOLLET there is no need
+        // to toggle EPOLLOUT as the write side fills and drains.
+        struct epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            close(fd);
+            continue;
+        }
+
+        if ((size_t)fd >= connections.size()) {
+            connections.resize(fd + 1);
+        }
+        conn->timer.owner = conn.get();
+        update_deadline(*conn, false);
+        connections[fd] = std::move(conn);
+        open_connections++;
+    }
+}
+
+void EventLoop::on_readable(Connection& conn) {
+    if (conn.state == ConnState::Closing) return;
+    if (!read_input(conn)) return;
+    serve(conn);
+}
+
+bool EventLoop::read_input(Connection& conn) {
+    size_t chunk = config.request_buffer_size > 0 ? (size_t)config.request_buffer_size : 8192;
+    std::vector<char> buffer(chunk);
+
+    // Edge-triggered: read until the kernel buffer is empty. Bytes that
+    // arrive while a response is still being written are pipelined requests
+    // and queue up in in_buf, until it is full; serve() then reads the rest
+    // once requests have been taken from it.
+    conn.input_paused = false;
+    while (true) {
+        if (input_full(conn, !conn.out_buf.empty())) {
+            conn.input_paused = true;
+            return true;
+        }
+        ssize_t n = recv(conn.fd, buffer.data(), buffer.size(), 0);
+        if (n > 0) {
+            conn.in_buf.append(buffer.data(), n);
+            conn.progressed = true;
+            continue;
+        }
+        if (n == 0) {
+            conn.peer_closed = true;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        close_connection(conn);
+        return false;
+    }
+    return true;
+}
+
+void EventLoop::on_writable(Connection& conn) {
+    if (conn.state != ConnState::WritingResponse) return;
+    serve(conn);
+}
+
+void EventLoop::on_completions() {
+    for (Completion& completion : take_completions()) {
+        int fd = completion.fd;
+        if ((size_t)fd >= connections.size() || !connections[fd] ||
+            connections[fd]->id != completion.conn_id) {
+            continue; // closed while the handler ran
+        }
+        Connection& conn = *connections[fd];
+        apply_completion(conn, completion);
+        serve(conn);
+    }
+}
+
+// Answer buffered requests in order, flushing between batches, until the
+// input runs dry, the socket would block, or the connection must close.
+void EventLoop::serve(Connection& conn) {
+    while (true) {
+        bool more = process_requests(conn);
+
+        if (!conn.out_buf.empty()) {
+            conn.state = ConnState::WritingResponse;
+            if (!flush(conn)) { // resumed by EPOLLOUT
+                update_deadline(conn, true);
+                return;
+            }
+        }
+
+        if (conn.state == ConnState::Closing || conn.close_after_write ||
+            (conn.peer_closed && !more && !conn.awaiting_response)) {
+            close_connection(conn);
+            return;
+        }
+
+        conn.state = ConnState::ReadingRequest;
+        // No new edge comes for bytes left in the socket when reading paused
+        if (conn.input_paused && !input_full(conn, !conn.out_buf.empty())) {
+            if (!read_input(conn)) return;
+            more = true;
+        }
+        if (!more) {
+            update_deadline(conn, false);
+            return;
+        }
+    }
+}
+
+// Returns true once out_buf has been fully written. Headers and bodies go
+// out together in one sendmsg, file bodies with sendfile; a short write
+// just advances the queue.
+bool EventLoop::flush(Connection& conn) {
+    struct iovec iov[MAX_IOV];
+    while (!conn.out_buf.empty()) {
+        ssize_t n;
+        int file_fd;
+        off_t offset;
+        size_t count;
+        if (conn.out_buf.front_file(file_fd, offset, count)) {
+            n = sendfile(conn.fd, file_fd, &offset, count);
+            if (n == 0) n = -1, errno = EIO; // file shrank underneath us
+        } else {
+            struct msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = conn.out_buf.fill_iovec(iov, MAX_IOV);
+            // Hold a header back until the file data it precedes is queued
+            n = sendmsg(conn.fd, &msg, MSG_NOSIGNAL | (conn.out_buf.has_files() ? MSG_MORE : 0));
+        }
+
+        if (n > 0) {
+            conn.out_buf.consume(n);
+            conn.progressed = true;
+            continue;
+        }
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return false;
+
+        conn.state = ConnState::Closing;
+        return true;
+    }
+    return true;
+}
+
+void EventLoop::expire_timers() {
+    timers.advance(std::chrono::steady_clock::now(), [this](TimerWheel::Timer& timer) {
+        timed_out_connections.fetch_add(1, std::memory_order_relaxed);
+        close_connection(*static_cast<Connection*>(timer.owner));
+    });
+}
+
+void EventLoop::close_connection(Connection& conn) {
+    int fd = conn.fd;
+    conn.state = ConnState::Closing;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    timers.cancel(conn.timer);
+    connections[fd].reset();
+    open_connections--;
+}
+
+// An HTTP/1.1 request asking to continue as cleartext HTTP/2 (RFC 7540 3.2).
+// Requests with a body are answered over HTTP/1.1 instead.
+static bool wants_h2c_upgrade(const HttpParser& parser) {
+    if (parser.version() != "HTTP/1.1" || parser.header("http2-settings").empty() || !parser.body().empty()) {
+        return false;
+    }
+    std::string_view upgrade = parser.header("upgrade");
+    while (!upgrade.empty()) {
+        size_t comma = upgrade.find(',');
+        std::string_view token = upgrade.substr(0, comma);
+        while (!token.empty() && token.front() == ' ') token.remove_prefix(1);
+        while (!token.empty() && token.back() == ' ') token.remove_suffix(1);
+        if (token.size() == 3 && strncasecmp(token.data(), "h2c", 3) == 0) return true;
+        if (comma == std::string_view::npos) break;
+        upgrade.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+bool ConnectionLoop::process_requests(Connection& conn) {
+    std::vector<Http2Session::Request> h2_ready;
+
+    // Prior knowledge: the client opens with the HTTP/2 preface
+    if (config.enable_http2 && !conn.h2 && conn.requests_served == 0 && !conn.in_buf.empty()) {
+        size_t n = std::min(conn.in_buf.size(), HTTP2_PREFACE.size());
+        if (std::string_view(conn.in_buf).substr(0, n) == HTTP2_PREFACE.substr(0, n)) {
+            if (n < HTTP2_PREFACE.size()) return false; // rest of the preface still to come
+            conn.h2 = std::make_unique<Http2Session>();
+            conn.h2->start(conn.out_buf);
+        }
+    }
+    if (conn.h2) return process_http2(conn, h2_ready);
+
+    size_t consumed = 0;
+    bool more = false;
+
+    while (!conn.close_after_write && !conn.awaiting_response) {
+        if (conn.out_buf.size() >= MAX_PIPELINE_OUTPUT) {
+            more = true;
+            break;
+        }
+
+        HttpParser& parser = conn.parser;
+        HttpParser::Status status = parser.parse(std::string_view(conn.in_buf).substr(consumed));
+        if (status == HttpParser::Status::NeedMore) break;
+
+        if (status == HttpParser::Status::Error) {
+            HttpResponse response;
+            response.status_code = parser.error_status();
+            response.content_type = "text/plain";
+            response.body.assign(reason_phrase(response.status_code));
+            conn.out_buf.append_response(std::move(response));
+            conn.close_after_write = true;
+            break;
+        }
+
+        HttpRequest request;
+        request.client_ip = client_ip_of(conn);
+        parser.to_request(request);
+
+        if (config.enable_http2 && wants_h2c_upgrade(parser)) {
+            OutputQueue preface;
+            auto session = std::make_unique<Http2Session>();
+            if (session->start_upgrade(preface, parser.header("http2-settings"), std::move(request), h2_ready)) {
+                conn.out_buf.append("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+                conn.out_buf.append(std::move(preface));
+                conn.h2 = std::move(session);
+                consumed += parser.consumed();
+                parser.reset();
+                break;
+            }
+        }
+
+        conn.requests_served++;
+        bool keep_alive = config.enable_keep_alive && parser.keep_alive() &&
+                          conn.requests_served < config.keep_alive_max_requests;
+
+        int remaining = config.keep_alive_max_requests - conn.requests_served;
+
+        consumed += parser.consumed();
+        parser.reset();
+        conn.deadline = Deadline::None; // a pipelined request behind it gets a fresh head deadline
+
+        if (executor) {
+            bool priority = admission && admission->is_priority(request);
+            if (admission && !admission->admit(priority)) {
+                conn.out_buf.append(overload_bytes);
+                conn.close_after_write = true;
+                break;
+            }
+
+            conn.awaiting_response = true;
+            executor->submit([this, fd = conn.fd, id = conn.id, request = std::move(request),
+                              keep_alive, remaining, priority, queued_at = std::chrono::steady_clock::now()]() {
+                Completion completion{ fd, id, OutputQueue(), keep_alive, 0, HttpResponse() };
+                if (!admission || admission->start(queued_at, priority)) {
+                    completion.output.append_response(respond(request), keep_alive,
+                                                      config.keep_alive_timeout, remaining);
+                } else {
+                    completion.output.append(overload_bytes);
+                    completion.keep_alive = false;
+                }
+                if (admission) admission->finish();
+                post_completion(std::move(completion));
+            }, executor_hint);
+            break;
+        }
+
+        conn.out_buf.append_response(respond(request), keep_alive, config.keep_alive_timeout, remaining);
+        if (!keep_alive) conn.close_after_write = true;
+    }
+
+    // The parser only holds offsets relative to the unconsumed tail, so
+    // compacting the buffer here keeps a partial request valid
+    conn.in_buf.erase(0, consumed);
+    if (conn.h2) return process_http2(conn, h2_ready); // upgraded: the rest is frames
+    return more;
+}
+
+const std::string& ConnectionLoop::client_ip_of(Connection& conn) {
+    if (!conn.client_ip_known) {
+        conn.client_ip_known = true;
+        struct sockaddr_in client_addr{};
+        socklen_t client_len = sizeof(client_addr);
+        char ip[INET_ADDRSTRLEN];
+        if (getpeername(conn.fd, (struct sockaddr*)&client_addr, &client_len) == 0 &&
+            inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip))) {
+            conn.client_ip = ip;
+        }
+    }
+    return conn.client_ip;
+}
+
+bool ConnectionLoop::input_full(const Connection& conn, bool writing) const {
+    if (conn.in_buf.size() < MAX_BUFFERED_INPUT) return false;
+    // While the socket takes no more output, requests parsed now would only
+    // queue more. An HTTP/2 session reads frames while its streams are out
+    // on the executor.
+    bool waiting = !conn.h2 && (conn.awaiting_response || conn.close_after_write);
+    return waiting || writing;
+}
+
+bool ConnectionLoop::process_http2(Connection& conn, std::vector<Http2Session::Request>& ready) {
+    if (conn.out_buf.size() >= MAX_PIPELINE_OUTPUT) return true;
+
+    Http2Session& session = *conn.h2;
+    conn.in_buf.erase(0, session.receive(conn.in_buf, conn.out_buf, ready));
+
+    // Streams are independent, so every ready request goes out at once
+    for (Http2Session::Request& ready_request : ready) {
+        ready_request.request.client_ip = client_ip_of(conn);
+        if (executor) {
+            bool priority = admission && admission->is_priority(ready_request.request);
+            if (admission && !admission->admit(priority)) {
+                session.respond(ready_request.stream_id, HttpResponse(overload), conn.out_buf);
+                continue;
+            }
+
+            conn.streams_in_flight++;
+            executor->submit([this, fd = conn.fd, id = conn.id, stream_id = ready_request.stream_id,
+                              request = std::move(ready_request.request), priority,
+                              queued_at = std::chrono::steady_clock::now()]() {
+                bool run = !admission || admission->start(queued_at, priority);
+                HttpResponse response = run ? respond(request) : HttpResponse(overload);
+                if (admission) admission->finish();
+                post_completion(Completion{ fd, id, OutputQueue(), true, stream_id, std::move(response) });
+            }, executor_hint);
+        } else {
+            session.respond(ready_request.stream_id, respond(ready_request.request), conn.out_buf);
+        }
+    }
+    session.send_data(conn.out_buf);
+
+    conn.awaiting_response = conn.streams_in_flight > 0;
+    if (session.failed() || session.finished()) conn.close_after_write = true;
+    return session.wants_write();
+}
+
+void ConnectionLoop::update_deadline(Connection& conn, bool writing) {
+    Deadline kind;
+    int seconds;
+    if (writing) {
+        kind = Deadline::Write;
+        seconds = config.send_timeout;
+    } else if (conn.awaiting_response) {
+        kind = Deadline::None;
+        seconds = 0;
+    } else if (conn.h2 || (conn.in_buf.empty() && conn.requests_served > 0)) {
+        // HTTP/2 multiplexes requests, so only inactivity counts there
+        kind = Deadline::Idle;
+        seconds = config.keep_alive_timeout;
+    } else if (conn.parser.reading_body()) {
+        kind = Deadline::Body;
+        seconds = config.body_timeout;
+    } else {
+        // Also a new connection that has sent nothing yet
+        kind = Deadline::Header;
+        seconds = config.header_timeout;
+    }
+
+    bool progressed = conn.progressed;
+    conn.progressed = false;
+    if (kind == Deadline::None || seconds <= 0) {
+        timers.cancel(conn.timer);
+        conn.deadline = Deadline::None;
+        return;
+    }
+
+    // The head deadline is absolute so trickling bytes cannot extend it;
+    // the others only need some progress
+    if (kind == conn.deadline && conn.timer.armed() && (kind == Deadline::Header || !progressed)) return;
+    conn.deadline = kind;
+    timers.arm(conn.timer, std::chrono::steady_clock::now() + std::chrono::seconds(seconds));
+}
+
+HttpResponse ConnectionLoop::respond(const HttpRequest& request) {
+    HttpResponse response;
+    try {
+        response = handler(request);
+    } catch (const std::exception& e) {
+        // Without a response the connection would wait on it forever
+        std::cerr << "❌ Handler failed for " << request.target << ": " << e.what() << std::endl;
+        response = HttpResponse();
+        response.status_code = 500;
+        response.content_type = "text/plain";
+        response.body.assign(reason_phrase(500));
+    }
+    // A 304 skips compressing a body the client already has
+    apply_conditional(request, response);
+    compress_response(request, response, config);
+    // The GET handler ran; only its headers go out
+    if (request.method == "HEAD") drop_body_for_head(response);
+    return response;
+}
+
+void ConnectionLoop::refuse_connection(int fd) {
+    // Discard whatever request already arrived: closing with unread data
+    // resets the connection, and the client may never see the 503
+    char discard[4096];
+    while (recv(fd, discard, sizeof(discard), MSG_DONTWAIT) > 0) {}
+    if (send(fd, overload_bytes.data(), overload_bytes.size(), MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+        // Best effort: the client sees the connection close either way
+    }
+    close(fd);
+    refused_connections.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ConnectionLoop::post_completion(Completion completion) {
+    {
+        std::lock_guard<std::mutex> lock(completions_mutex);
+        completions.push_back(std::move(completion));
+    }
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0) {
+        // Counter saturated: a wakeup is already pending
+    }
+}
+
+std::vector<ConnectionLoop::Completion> ConnectionLoop::take_completions() {
+    std::vector<Completion> ready;
+    std::lock_guard<std::mutex> lock(completions_mutex);
+    ready.swap(completions);
+    return ready;
+}
+
+void ConnectionLoop::apply_completion(Connection& conn, Completion& completion) {
+    if (completion.stream_id != 0) {
+        conn.streams_in_flight--;
+        conn.awaiting_response = conn.streams_in_flight > 0;
+        if (conn.h2) conn.h2->respond(completion.stream_id, std::move(completion.response), conn.out_buf);
+        return;
+    }
+    conn.out_buf.append(std::move(completion.output));
+    conn.awaiting_response = false;
+    if (!completion.keep_alive) conn.close_after_write = true;
+}
+
+std::unique_ptr<ConnectionLoop> make_connection_loop(const Config& config, RequestHandler handler) {
+    if (config.io_backend == "io_uring") {
+        auto loop = std::make_unique<IoUringLoop>(config, handler);
+        if (loop->ready()) return loop;
+        std::cerr << "⚠️ io_uring unavailable, falling back to epoll" << std::endl;
+    }
+    return std::make_unique<EventLoop>(config, std::move(handler));
+}
+
+void raise_fd_limit(int max_connections) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return;
+
+    rlim_t wanted = (rlim_t)max_connections + 64; // listeners, DB, logs
+    if (rl.rlim_cur >= wanted) return;
+
+    rl.rlim_cur = rl.rlim_max == RLIM_INFINITY ? wanted : std::min(wanted, rl.rlim_max);
+    if (setrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur < wanted) {
+        std::cerr << "⚠️ File descriptor limit " << rl.rlim_cur
+                  << " is below max_concurrent_connections" << std::endl;
+    }
+}
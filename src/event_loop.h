@@ -0,0 +1,204 @@
+#pragma once
+
+#include "rangoons.h"
+#include "admission.h"
+#include "http.h"
+#include "http2.h"
+#include "http_parser.h"
+#include "timer_wheel.h"
+#include "work_pool.h"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Per-connection state machine driven by the reactor
+enum class ConnState {
+    ReadingRequest,   // feeding in_buf to the parser until a request completes
+    WritingResponse,  // flushing out_buf, resumed on EPOLLOUT when the socket is full
+    Closing
+};
+
+// Which timeout a connection is currently held to
+enum class Deadline {
+    None,    // handler running: the wait is on us
+    Header,  // request head, counted from its first byte
+    Body,    // request body, restarted whenever some arrives
+    Idle,    // keep-alive between requests
+    Write    // response stuck in an unread socket, restarted on progress
+};
+
+struct Connection {
+    int fd = -1;
+    uint64_t id = 0;          // tells a reused fd apart from the one a response was for
+    ConnState state = ConnState::ReadingRequest;
+    std::string client_ip;    // filled by client_ip_of() unless the backend knew it at accept
+    bool client_ip_known = false;
+    std::string in_buf;
+    HttpParser parser;        // resumable across reads, reset per request
+    OutputQueue out_buf;      // written with sendmsg, large bodies are not copied
+
+    // Keep-alive bookkeeping
+    int requests_served = 0;
+    bool close_after_write = false;
+    bool peer_closed = false;
+    bool awaiting_response = false; // handler running on the executor
+    bool input_paused = false;      // not reading from the socket while input_full()
+
+    // Set once the connection speaks HTTP/2; in_buf then holds frames
+    std::unique_ptr<Http2Session> h2;
+    int streams_in_flight = 0;      // HTTP/2 requests out on the executor
+
+    TimerWheel::Timer timer;
+    Deadline deadline = Deadline::None;
+    bool progressed = false;        // bytes moved since the deadline was updated
+};
+
+using RequestHandler = std::function<HttpResponse(const HttpRequest&)>;
+
+// Common base of the connection-layer I/O backends: owns the request
+// pipeline so every backend answers requests identically
+class ConnectionLoop {
+public:
+    ConnectionLoop(const Config& config, RequestHandler handler);
+    virtual ~ConnectionLoop();
+
+    virtual bool add_listener(int listen_fd) = 0;
+    virtual void run() = 0;
+    virtual void stop() = 0;
+    virtual size_t connection_count() const = 0;
+
+    // Connections turned away over max_concurrent_connections
+    uint64_t connections_refused() const { return refused_connections.load(std::memory_order_relaxed); }
+
+    // Connections closed for missing a header, body, idle or write deadline
+    uint64_t connections_timed_out() const { return timed_out_connections.load(std::memory_order_relaxed); }
+
+    // Run handlers on pool instead of the loop thread, one request per
+    // connection at a time so pipelined responses stay in order. hint
+    // selects the worker this loop feeds. The pool must be shut down
+    // before the loop is destroyed. With admission, requests are shed with
+    // a 503 once the pool falls behind; it is shared by every loop feeding
+    // the pool.
+    void set_executor(WorkStealingPool* pool, size_t hint, AdmissionControl* admission = nullptr) {
+        executor = pool;
+        executor_hint = hint;
+        this->admission = admission;
+    }
+
+protected:
+    // A response finished on the executor, waiting to be handed back.
+    // HTTP/1.1 responses arrive serialized in output; HTTP/2 ones are
+    // framed on the loop thread, which owns the session.
+    struct Completion {
+        int fd;
+        uint64_t conn_id;
+        OutputQueue output;
+        bool keep_alive;
+        uint32_t stream_id = 0;
+        HttpResponse response;
+    };
+
+    Config config;
+    RequestHandler handler;
+    int wake_fd = -1;         // eventfd: stop() and executor completions
+    uint64_t next_conn_id = 0;
+    TimerWheel timers;        // one deadline per connection
+    std::atomic<uint64_t> timed_out_connections{0};
+
+    // Parse every complete request buffered in conn.in_buf, run the handler
+    // (or hand it to the executor) and append the serialized responses to
+    // conn.out_buf, honoring keep-alive. With enable_http2, a connection
+    // that opens with the HTTP/2 preface or asks to Upgrade: h2c switches to
+    // an Http2Session. Returns true when it stopped early because too much
+    // output is queued.
+    bool process_requests(Connection& conn);
+
+    // Peer address of conn, looked up with getpeername() on first use
+    const std::string& client_ip_of(Connection& conn);
+
+    // conn.in_buf holds enough while earlier responses are still pending or,
+    // with writing, unwritten: the backend stops reading from the socket
+    // until this turns false, so a client that pipelines without reading
+    // responses cannot grow in_buf without bound
+    bool input_full(const Connection& conn, bool writing) const;
+
+    // Arm conn.timer for the phase the connection is now in. writing: output
+    // is still queued for the socket.
+    void update_deadline(Connection& conn, bool writing);
+
+    // Answer a connection accepted over max_concurrent_connections with a
+    // 503 and close it
+    void refuse_connection(int fd);
+
+    // Responses posted by executor threads since the last call
+    std::vector<Completion> take_completions();
+
+    // Append a completion to its connection and resume request processing
+    static void apply_completion(Connection& conn, Completion& completion);
+
+private:
+    WorkStealingPool* executor = nullptr;
+    size_t executor_hint = 0;
+    AdmissionControl* admission = nullptr;
+    std::atomic<uint64_t> refused_connections{0};
+
+    // Prebuilt 503 for shed requests: serialized with Connection: close for
+    // HTTP/1.1, as a response to frame for HTTP/2
+    std::string overload_bytes;
+    HttpResponse overload;
+
+    std::mutex completions_mutex;
+    std::vector<Completion> completions;
+
+    void post_completion(Completion completion);
+
+    // Run the handler and compress its response for the client; a handler
+    // that throws gets a 500
+    HttpResponse respond(const HttpRequest& request);
+
+    // process_requests() once the connection has switched to HTTP/2
+    bool process_http2(Connection& conn, std::vector<Http2Session::Request>& ready);
+};
+
+// Edge-triggered epoll reactor. Every socket is non-blocking, so a slow
+// client only ever costs its own buffers, never the loop.
+class EventLoop : public ConnectionLoop {
+public:
+    EventLoop(const Config& config, RequestHandler handler);
+    ~EventLoop() override;
+
+    bool add_listener(int listen_fd) override;
+    void run() override;
+    void stop() override;
+    size_t connection_count() const override { return open_connections.load(std::memory_order_relaxed); }
+
+private:
+    int epoll_fd = -1;
+    std::vector<int> listeners;
+    std::vector<std::unique_ptr<Connection>> connections; // indexed by fd
+    std::atomic<size_t> open_connections{0}; // read by other threads for metrics
+    std::atomic<bool> running{false};
+
+    bool is_listener(int fd) const;
+    void accept_ready(int listen_fd);
+    void on_readable(Connection& conn);
+    // Drain the socket into in_buf, stopping early at input_full(); false
+    // once the connection was closed
+    bool read_input(Connection& conn);
+    void on_writable(Connection& conn);
+    void on_completions();
+    void serve(Connection& conn);
+    bool flush(Connection& conn);
+    void expire_timers();
+    void close_connection(Connection& conn);
+};
+
+// Build the backend named by config.io_backend ("epoll" or "io_uring"),
+// falling back to epoll when io_uring is unavailable
+std::unique_ptr<ConnectionLoop> make_connection_loop(const Config& config, RequestHandler handler);
+
+// Raise RLIMIT_NOFILE so one process can hold max_connections sockets
+void raise_fd_limit(int max_connections);
@@ -0,0 +1,421 @@
+#include "hpack.h"
+#include <algorithm>
+
+// ---------------- Tables -----------------
+
+static const HeaderField STATIC_TABLE[] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+static const size_t STATIC_COUNT = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+
+// Per-entry overhead counted against the table size (RFC 7541 4.1)
+static const size_t ENTRY_OVERHEAD = 32;
+
+struct HuffmanCode {
+    uint32_t code;
+    uint8_t bits;
+};
+
+// Indexed by symbol; 256 is EOS
+static const HuffmanCode HUFFMAN[257] = {
+    { 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 },
+    { 0xfffffe4, 28 }, { 0xfffffe5, 28 }, { 0xfffffe6, 28 }, { 0xfffffe7, 28 },
+    { 0xfffffe8, 28 }, { 0xffffea, 24 }, { 0x3ffffffc, 30 }, { 0xfffffe9, 28 },
+    { 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 }, { 0xfffffec, 28 },
+    { 0xfffffed, 28 }, { 0xfffffee, 28 }, { 0xfffffef, 28 }, { 0xffffff0, 28 },
+    { 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 },
+    { 0xffffff4, 28 }, { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 },
+    { 0xffffff8, 28 }, { 0xffffff9, 28 }, { 0xffffffa, 28 }, { 0xffffffb, 28 },
+    { 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 }, { 0xffa, 12 },
+    { 0x1ff9, 13 }, { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 },
+    { 0x3fa, 10 }, { 0x3fb, 10 }, { 0xf9, 8 }, { 0x7fb, 11 },
+    { 0xfa, 8 }, { 0x16, 6 }, { 0x17, 6 }, { 0x18, 6 },
+    { 0x0, 5 }, { 0x1, 5 }, { 0x2, 5 }, { 0x19, 6 },
+    { 0x1a, 6 }, { 0x1b, 6 }, { 0x1c, 6 }, { 0x1d, 6 },
+    { 0x1e, 6 }, { 0x1f, 6 }, { 0x5c, 7 }, { 0xfb, 8 },
+    { 0x7ffc, 15 }, { 0x20, 6 }, { 0xffb, 12 }, { 0x3fc, 10 },
+    { 0x1ffa, 13 }, { 0x21, 6 }, { 0x5d, 7 }, { 0x5e, 7 },
+    { 0x5f, 7 }, { 0x60, 7 }, { 0x61, 7 }, { 0x62, 7 },
+    { 0x63, 7 }, { 0x64, 7 }, { 0x65, 7 }, { 0x66, 7 },
+    { 0x67, 7 }, { 0x68, 7 }, { 0x69, 7 }, { 0x6a, 7 },
+    { 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 }, { 0x6e, 7 },
+    { 0x6f, 7 }, { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 },
+    { 0xfc, 8 }, { 0x73, 7 }, { 0xfd, 8 }, { 0x1ffb, 13 },
+    { 0x7fff0, 19 }, { 0x1ffc, 13 }, { 0x3ffc, 14 }, { 0x22, 6 },
+    { 0x7ffd, 15 }, { 0x3, 5 }, { 0x23, 6 }, { 0x4, 5 },
+    { 0x24, 6 }, { 0x5, 5 }, { 0x25, 6 }, { 0x26, 6 },
+    { 0x27, 6 }, { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 },
+    { 0x28, 6 }, { 0x29, 6 }, { 0x2a, 6 }, { 0x7, 5 },
+    { 0x2b, 6 }, { 0x76, 7 }, { 0x2c, 6 }, { 0x8, 5 },
+    { 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 },
+    { 0x79, 7 }, { 0x7a, 7 }, { 0x7b, 7 }, { 0x7ffe, 15 },
+    { 0x7fc, 11 }, { 0x3ffd, 14 }, { 0x1ffd, 13 }, { 0xffffffc, 28 },
+    { 0xfffe6, 20 }, { 0x3fffd2, 22 }, { 0xfffe7, 20 }, { 0xfffe8, 20 },
+    { 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 }, { 0x7fffd9, 23 },
+    { 0x3fffd6, 22 }, { 0x7fffda, 23 }, { 0x7fffdb, 23 }, { 0x7fffdc, 23 },
+    { 0x7fffdd, 23 }, { 0x7fffde, 23 }, { 0xffffeb, 24 }, { 0x7fffdf, 23 },
+    { 0xffffec, 24 }, { 0xffffed, 24 }, { 0x3fffd7, 22 }, { 0x7fffe0, 23 },
+    { 0xffffee, 24 }, { 0x7fffe1, 23 }, { 0x7fffe2, 23 }, { 0x7fffe3, 23 },
+    { 0x7fffe4, 23 }, { 0x1fffdc, 21 }, { 0x3fffd8, 22 }, { 0x7fffe5, 23 },
+    { 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 }, { 0xffffef, 24 },
+    { 0x3fffda, 22 }, { 0x1fffdd, 21 }, { 0xfffe9, 20 }, { 0x3fffdb, 22 },
+    { 0x3fffdc, 22 }, { 0x7fffe8, 23 }, { 0x7fffe9, 23 }, { 0x1fffde, 21 },
+    { 0x7fffea, 23 }, { 0x3fffdd, 22 }, { 0x3fffde, 22 }, { 0xfffff0, 24 },
+    { 0x1fffdf, 21 }, { 0x3fffdf, 22 }, { 0x7fffeb, 23 }, { 0x7fffec, 23 },
+    { 0x1fffe0, 21 }, { 0x1fffe1, 21 }, { 0x3fffe0, 22 }, { 0x1fffe2, 21 },
+    { 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 }, { 0x7fffef, 23 },
+    { 0xfffea, 20 }, { 0x3fffe2, 22 }, { 0x3fffe3, 22 }, { 0x3fffe4, 22 },
+    { 0x7ffff0, 23 }, { 0x3fffe5, 22 }, { 0x3fffe6, 22 }, { 0x7ffff1, 23 },
+    { 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 }, { 0x7fff1, 19 },
+    { 0x3fffe7, 22 }, { 0x7ffff2, 23 }, { 0x3fffe8, 22 }, { 0x1ffffec, 25 },
+    { 0x3ffffe2, 26 }, { 0x3ffffe3, 26 }, { 0x3ffffe4, 26 }, { 0x7ffffde, 27 },
+    { 0x7ffffdf, 27 }, { 0x3ffffe5, 26 }, { 0xfffff1, 24 }, { 0x1ffffed, 25 },
+    { 0x7fff2, 19 }, { 0x1fffe3, 21 }, { 0x3ffffe6, 26 }, { 0x7ffffe0, 27 },
+    { 0x7ffffe1, 27 }, { 0x3ffffe7, 26 }, { 0x7ffffe2, 27 }, { 0xfffff2, 24 },
+    { 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 }, { 0x3ffffe9, 26 },
+    { 0xffffffd, 28 }, { 0x7ffffe3, 27 }, { 0x7ffffe4, 27 }, { 0x7ffffe5, 27 },
+    { 0xfffec, 20 }, { 0xfffff3, 24 }, { 0xfffed, 20 }, { 0x1fffe6, 21 },
+    { 0x3fffe9, 22 }, { 0x1fffe7, 21 }, { 0x1fffe8, 21 }, { 0x7ffff3, 23 },
+    { 0x3fffea, 22 }, { 0x3fffeb, 22 }, { 0x1ffffee, 25 }, { 0x1ffffef, 25 },
+    { 0xfffff4, 24 }, { 0xfffff5, 24 }, { 0x3ffffea, 26 }, { 0x7ffff4, 23 },
+    { 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 }, { 0x3ffffed, 26 },
+    { 0x7ffffe7, 27 }, { 0x7ffffe8, 27 }, { 0x7ffffe9, 27 }, { 0x7ffffea, 27 },
+    { 0x7ffffeb, 27 }, { 0xffffffe, 28 }, { 0x7ffffec, 27 }, { 0x7ffffed, 27 },
+    { 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 }, { 0x3ffffee, 26 },
+    { 0x3fffffff, 30 },
+};
+
+// The code is canonical: codes of one length are consecutive and ordered
+// by symbol, so decoding needs only the first code of each length
+struct HuffmanDecodeTable {
+    uint32_t first_code[31] = {};
+    uint16_t first_index[31] = {};
+    uint16_t count[31] = {};
+    uint16_t symbols[257] = {};
+
+    HuffmanDecodeTable() {
+        for (uint16_t i = 0; i < 257; ++i) symbols[i] = i;
+        std::sort(symbols, symbols + 257, [](uint16_t a, uint16_t b) {
+            return HUFFMAN[a].bits != HUFFMAN[b].bits ? HUFFMAN[a].bits < HUFFMAN[b].bits : a < b;
+        });
+        for (uint16_t i = 0; i < 257; ++i) {
+            const HuffmanCode& c = HUFFMAN[symbols[i]];
+            if (count[c.bits]++ == 0) {
+                first_code[c.bits] = c.code;
+                first_index[c.bits] = i;
+            }
+        }
+    }
+};
+
+static const HuffmanDecodeTable HUFFMAN_DECODE;
+
+bool huffman_decode(std::string_view in, std::string& out) {
+    uint32_t code = 0;
+    int len = 0;
+    for (unsigned char byte : in) {
+        for (int bit = 7; bit >= 0; --bit) {
+            code = (code << 1) | ((byte >> bit) & 1);
+            len++;
+            // Unsigned wrap-around makes codes below first_code fail too
+            uint32_t offset = code - HUFFMAN_DECODE.first_code[len];
+            if (offset < HUFFMAN_DECODE.count[len]) {
+                uint16_t symbol = HUFFMAN_DECODE.symbols[HUFFMAN_DECODE.first_index[len] + offset];
+                if (symbol == 256) return false; // EOS inside a string
+                out += (char)symbol;
+                code = 0;
+                len = 0;
+            } else if (len == 30) {
+                return false;
+            }
+        }
+    }
+    // Padding is a prefix of EOS: under 8 bits, all ones
+    return len < 8 && code == (1u << len) - 1;
+}
+
+size_t huffman_encoded_size(std::string_view in) {
+    size_t bits = 0;
+    for (unsigned char c : in) bits += HUFFMAN[c].bits;
+    return (bits + 7) / 8;
+}
+
+void huffman_encode(std::string_view in, std::string& out) {
+    uint64_t acc = 0;
+    int n = 0;
+    for (unsigned char c : in) {
+        acc = (acc << HUFFMAN[c].bits) | HUFFMAN[c].code;
+        n += HUFFMAN[c].bits;
+        while (n >= 8) {
+            n -= 8;
+            out += (char)(acc >> n);
+        }
+        acc &= (1u << n) - 1;
+    }
+    if (n > 0) out += (char)((acc << (8 - n)) | (0xff >> n));
+}
+
+// ---------------- Primitives -----------------
+
+static void encode_int(std::string& out, uint8_t first, int prefix_bits, uint64_t value) {
+    uint64_t max = (1u << prefix_bits) - 1;
+    if (value < max) {
+        out += (char)(first | value);
+        return;
+    }
+    out += (char)(first | max);
+    value -= max;
+    while (value >= 128) {
+        out += (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+static bool decode_int(std::string_view& in, int prefix_bits, uint64_t& value) {
+    if (in.empty()) return false;
+    uint64_t max = (1u << prefix_bits) - 1;
+    value = (uint8_t)in[0] & max;
+    in.remove_prefix(1);
+    if (value < max) return true;
+
+    for (int shift = 0; shift <= 28; shift += 7) {
+        if (in.empty()) return false;
+        uint8_t b = in[0];
+        in.remove_prefix(1);
+        value += (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false; // longer than any sane length or index
+}
+
+static void encode_string(std::string& out, std::string_view s) {
+    size_t huffman_size = huffman_encoded_size(s);
+    if (huffman_size < s.size()) {
+        encode_int(out, 0x80, 7, huffman_size);
+        huffman_encode(s, out);
+    } else {
+        encode_int(out, 0x00, 7, s.size());
+        out.append(s);
+    }
+}
+
+static bool decode_string(std::string_view& in, std::string& out) {
+    if (in.empty()) return false;
+    bool huffman = in[0] & 0x80;
+    uint64_t len;
+    if (!decode_int(in, 7, len) || len > in.size()) return false;
+    std::string_view raw = in.substr(0, len);
+    in.remove_prefix(len);
+
+    out.clear();
+    if (huffman) return huffman_decode(raw, out);
+    out.assign(raw);
+    return true;
+}
+
+// ---------------- HpackTable -----------------
+
+const HeaderField* HpackTable::at(size_t index) const {
+    if (index == 0) return nullptr;
+    if (index <= STATIC_COUNT) return &STATIC_TABLE[index - 1];
+    index -= STATIC_COUNT + 1;
+    return index < entries.size() ? &entries[index] : nullptr;
+}
+
+void HpackTable::insert(std::string_view name, std::string_view value) {
+    // Copy first: name may point into an entry about to be evicted
+    HeaderField field{ std::string(name), std::string(value) };
+    size_t entry_size = field.name.size() + field.value.size() + ENTRY_OVERHEAD;
+    if (entry_size > max_size) {
+        // Too big for the table: it just empties it
+        entries.clear();
+        size = 0;
+        return;
+    }
+    evict(entry_size);
+    entries.push_front(std::move(field));
+    size += entry_size;
+}
+
+void HpackTable::set_max_size(size_t new_size) {
+    max_size = new_size;
+    evict(0);
+}
+
+void HpackTable::evict(size_t needed) {
+    while (!entries.empty() && size + needed > max_size) {
+        const HeaderField& oldest = entries.back();
+        size -= oldest.name.size() + oldest.value.size() + ENTRY_OVERHEAD;
+        entries.pop_back();
+    }
+}
+
+size_t HpackTable::find(std::string_view name, std::string_view value, bool& name_only) const {
+    size_t name_match = 0;
+    for (size_t i = 0; i < STATIC_COUNT; ++i) {
+        if (STATIC_TABLE[i].name != name) continue;
+        if (STATIC_TABLE[i].value == value) {
+            name_only = false;
+            return i + 1;
+        }
+        if (!name_match) name_match = i + 1;
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].name != name) continue;
+        if (entries[i].value == value) {
+            name_only = false;
+            return STATIC_COUNT + 1 + i;
+        }
+        if (!name_match) name_match = STATIC_COUNT + 1 + i;
+    }
+    name_only = name_match != 0;
+    return name_match;
+}
+
+// ---------------- HpackDecoder -----------------
+
+bool HpackDecoder::decode(std::string_view block, std::vector<HeaderField>& fields) {
+    bool size_update_allowed = true; // only at the start of a block
+    while (!block.empty()) {
+        uint8_t first = block[0];
+        uint64_t index;
+
+        if (first & 0x80) {
+            // Indexed field
+            if (!decode_int(block, 7, index)) return false;
+            const HeaderField* entry = table.at(index);
+            if (!entry) return false;
+            fields.push_back(*entry);
+            size_update_allowed = false;
+            continue;
+        }
+
+        if ((first & 0xe0) == 0x20) {
+            // Dynamic table size update
+            if (!size_update_allowed || !decode_int(block, 5, index) || index > limit) return false;
+            table.set_max_size(index);
+            continue;
+        }
+
+        // Literal: with incremental indexing (01), without (0000) or never (0001)
+        bool incremental = (first & 0xc0) == 0x40;
+        if (!decode_int(block, incremental ? 6 : 4, index)) return false;
+
+        HeaderField field;
+        if (index) {
+            const HeaderField* entry = table.at(index);
+            if (!entry) return false;
+            field.name = entry->name;
+        } else if (!decode_string(block, field.name)) {
+            return false;
+        }
+        if (!decode_string(block, field.value)) return false;
+
+        if (incremental) table.insert(field.name, field.value);
+        fields.push_back(std::move(field));
+        size_update_allowed = false;
+    }
+    return true;
+}
+
+// ---------------- HpackEncoder -----------------
+
+void HpackEncoder::set_max_table_size(size_t size) {
+    // Never grow past the default: a bigger table only costs memory here
+    size = std::min<size_t>(size, 4096);
+    if (pending_size == SIZE_MAX && size == table.capacity()) return;
+    // Only the smallest and the final size need announcing (RFC 7541 4.2)
+    min_pending_size = std::min(min_pending_size, size);
+    pending_size = size;
+}
+
+void HpackEncoder::begin(std::string& out) {
+    if (pending_size == SIZE_MAX) return;
+    if (min_pending_size < pending_size) {
+        encode_int(out, 0x20, 5, min_pending_size);
+        table.set_max_size(min_pending_size);
+    }
+    encode_int(out, 0x20, 5, pending_size);
+    table.set_max_size(pending_size);
+    pending_size = SIZE_MAX;
+    min_pending_size = SIZE_MAX;
+}
+
+void HpackEncoder::encode(std::string& out, std::string_view name, std::string_view value, Indexing indexing) {
+    bool name_only = false;
+    size_t index = table.find(name, value, name_only);
+    if (index && !name_only && indexing != Indexing::Never) {
+        encode_int(out, 0x80, 7, index);
+        return;
+    }
+
+    switch (indexing) {
+        case Indexing::Incremental: encode_int(out, 0x40, 6, index); break;
+        case Indexing::None: encode_int(out, 0x00, 4, index); break;
+        case Indexing::Never: encode_int(out, 0x10, 4, index); break;
+    }
+    if (!index) encode_string(out, name);
+    encode_string(out, value);
+    if (indexing == Indexing::Incremental) table.insert(name, value);
+}
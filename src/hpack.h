@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// HPACK header compression for HTTP/2 (RFC 7541). Each direction of a
+// connection has its own dynamic table, so a session owns one decoder for
+// request headers and one encoder for response headers.
+
+struct HeaderField {
+    std::string name;
+    std::string value;
+};
+
+// Entries added to a dynamic table, shared by encoder and decoder
+class HpackTable {
+public:
+    explicit HpackTable(size_t max_size) : max_size(max_size) {}
+
+    // Entry at HPACK index (1-based, static entries first); null if out of range
+    const HeaderField* at(size_t index) const;
+
+    void insert(std::string_view name, std::string_view value);
+    void set_max_size(size_t size);
+    size_t capacity() const { return max_size; }
+
+    // HPACK index of an exact match, or of the first entry with a matching
+    // name (name_only set), 0 when there is neither
+    size_t find(std::string_view name, std::string_view value, bool& name_only) const;
+
+private:
+    std::deque<HeaderField> entries; // newest first
+    size_t size = 0;
+    size_t max_size;
+
+    void evict(size_t needed);
+};
+
+class HpackDecoder {
+public:
+    // max_table_size is our SETTINGS_HEADER_TABLE_SIZE
+    explicit HpackDecoder(size_t max_table_size = 4096)
+        : table(max_table_size), limit(max_table_size) {}
+
+    // Decode one complete header block. false is a COMPRESSION_ERROR,
+    // which is fatal for the connection since the tables are out of sync.
+    bool decode(std::string_view block, std::vector<HeaderField>& fields);
+
+private:
+    HpackTable table;
+    size_t limit;
+};
+
+class HpackEncoder {
+public:
+    HpackEncoder() : table(4096) {}
+
+    // Peer's SETTINGS_HEADER_TABLE_SIZE; announced at the start of the next block
+    void set_max_table_size(size_t size);
+
+    // Start a header block: emits any pending table size update
+    void begin(std::string& out);
+
+    // Append one field. Values that change on every response should not
+    // be indexed, or they just churn the table; sensitive ones are marked
+    // never-indexed for intermediaries too.
+    enum class Indexing { Incremental, None, Never };
+    void encode(std::string& out, std::string_view name, std::string_view value,
+                Indexing indexing = Indexing::Incremental);
+
+private:
+    HpackTable table;
+    size_t pending_size = SIZE_MAX; // size update owed to the peer
+    size_t min_pending_size = SIZE_MAX;
+};
+
+// Huffman coding with the RFC 7541 Appendix B code
+bool huffman_decode(std::string_view in, std::string& out);
+size_t huffman_encoded_size(std::string_view in);
+void huffman_encode(std::string_view in, std::string& out);
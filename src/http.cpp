@@ -0,0 +1,379 @@
+#include "http.h"
+#include "http_parser.h"
+#include <unistd.h>
+#include <charconv>
+#include <cstdio>
+#include <ctime>
+
+// Bodies up to this size are copied next to their headers; larger ones
+// become their own iovec
+static const size_t INLINE_BODY_MAX = 4096;
+
+FileBody::~FileBody() {
+    if (fd != -1) close(fd);
+}
+
+bool parse_request(const std::string& raw_request, HttpRequest& request) {
+    HttpParser parser;
+    if (parser.parse(raw_request) != HttpParser::Status::Complete) return false;
+    parser.to_request(request);
+    return true;
+}
+
+std::string_view status_line(int status_code) {
+    switch (status_code) {
+        case 100: return "HTTP/1.1 100 Continue\r\n";
+        case 101: return "HTTP/1.1 101 Switching Protocols\r\n";
+        case 200: return "HTTP/1.1 200 OK\r\n";
+        case 201: return "HTTP/1.1 201 Created\r\n";
+        case 202: return "HTTP/1.1 202 Accepted\r\n";
+        case 204: return "HTTP/1.1 204 No Content\r\n";
+        case 206: return "HTTP/1.1 206 Partial Content\r\n";
+        case 301: return "HTTP/1.1 301 Moved Permanently\r\n";
+        case 302: return "HTTP/1.1 302 Found\r\n";
+        case 303: return "HTTP/1.1 303 See Other\r\n";
+        case 304: return "HTTP/1.1 304 Not Modified\r\n";
+        case 307: return "HTTP/1.1 307 Temporary Redirect\r\n";
+        case 308: return "HTTP/1.1 308 Permanent Redirect\r\n";
+        case 400: return "HTTP/1.1 400 Bad Request\r\n";
+        case 401: return "HTTP/1.1 401 Unauthorized\r\n";
+        case 403: return "HTTP/1.1 403 Forbidden\r\n";
+        case 404: return "HTTP/1.1 404 Not Found\r\n";
+        case 405: return "HTTP/1.1 405 Method Not Allowed\r\n";
+        case 408: return "HTTP/1.1 408 Request Timeout\r\n";
+        case 409: return "HTTP/1.1 409 Conflict\r\n";
+        case 411: return "HTTP/1.1 411 Length Required\r\n";
+        case 412: return "HTTP/1.1 412 Precondition Failed\r\n";
+        case 413: return "HTTP/1.1 413 Content Too Large\r\n";
+        case 414: return "HTTP/1.1 414 URI Too Long\r\n";
+        case 415: return "HTTP/1.1 415 Unsupported Media Type\r\n";
+        case 416: return "HTTP/1.1 416 Range Not Satisfiable\r\n";
+        case 422: return "HTTP/1.1 422 Unprocessable Content\r\n";
+        case 429: return "HTTP/1.1 429 Too Many Requests\r\n";
+        case 431: return "HTTP/1.1 431 Request Header Fields Too Large\r\n";
+        case 500: return "HTTP/1.1 500 Internal Server Error\r\n";
+        case 501: return "HTTP/1.1 501 Not Implemented\r\n";
+        case 502: return "HTTP/1.1 502 Bad Gateway\r\n";
+        case 503: return "HTTP/1.1 503 Service Unavailable\r\n";
+        case 504: return "HTTP/1.1 504 Gateway Timeout\r\n";
+        case 505: return "HTTP/1.1 505 HTTP Version Not Supported\r\n";
+    }
+    // Unlisted codes get the generic reason of their class
+    if (status_code >= 200 && status_code < 300) return "HTTP/1.1 200 OK\r\n";
+    if (status_code >= 400 && status_code < 500) return "HTTP/1.1 400 Bad Request\r\n";
+    return "HTTP/1.1 500 Internal Server Error\r\n";
+}
+
+std::string_view reason_phrase(int status_code) {
+    std::string_view line = status_line(status_code);
+    return line.substr(13, line.size() - 15); // "HTTP/1.1 NNN " ... "\r\n"
+}
+
+static void append_number(std::string& out, size_t value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr - digits);
+}
+
+void append_response_head(std::string& out, const HttpResponse& response, bool keep_alive,
+                          int timeout, int max_requests) {
+    out += status_line(response.status_code);
+    // A 304 describes the client's stored body; its length and type stand
+    if (response.status_code != 304) {
+        out += "Content-Type: ";
+        out += response.content_type;
+        out += "\r\nContent-Length: ";
+        append_number(out, body_length(response));
+        out += "\r\n";
+    }
+    if (!response.cache_control.empty() && !response.headers.count("Cache-Control")) {
+        out += "Cache-Control: ";
+        out += response.cache_control;
+        out += "\r\n";
+    }
+    for (const auto& header : response.headers) {
+        out += header.first;
+        out += ": ";
+        out += header.second;
+        out += "\r\n";
+    }
+    if (keep_alive) {
+        out += "Connection: keep-alive\r\n";
+        if (timeout > 0) {
+            out += "Keep-Alive: timeout=";
+            append_number(out, timeout);
+            if (max_requests > 0) {
+                out += ", max=";
+                append_number(out, max_requests);
+            }
+            out += "\r\n";
+        }
+    } else {
+        out += "Connection: close\r\n";
+    }
+    out += "\r\n";
+}
+
+std::string build_response(const HttpResponse& response, bool keep_alive,
+                           int timeout, int max_requests) {
+    std::string out;
+    out.reserve(256 + response.body.size());
+    append_response_head(out, response, keep_alive, timeout, max_requests);
+    if (!response.file) {
+        out += response.body;
+        return out;
+    }
+
+    size_t start = out.size();
+    out.resize(start + response.file->size);
+    size_t done = 0;
+    while (done < response.file->size) {
+        ssize_t n = pread(response.file->fd, &out[start + done], response.file->size - done, done);
+        if (n <= 0) break;
+        done += n;
+    }
+    out.resize(start + done);
+    return out;
+}
+
+// ---------------- Caching and validators -----------------
+
+std::string_view cache_control_of(const HttpResponse& response) {
+    auto header = response.headers.find("Cache-Control");
+    return header != response.headers.end() ? std::string_view(header->second)
+                                            : std::string_view(response.cache_control);
+}
+
+std::string content_etag(std::string_view body) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "\"%zx-%zx\"", std::hash<std::string_view>()(body), body.size());
+    return buf;
+}
+
+std::string http_date(time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
+
+time_t parse_http_date(std::string_view value) {
+    std::string text(value);
+    struct tm tm{};
+    const char* end = strptime(text.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end != '\0') return -1;
+    return timegm(&tm);
+}
+
+// W/"x" and "x" are the same tag under weak comparison
+static std::string_view opaque_tag(std::string_view tag) {
+    if (tag.size() >= 2 && tag[0] == 'W' && tag[1] == '/') tag.remove_prefix(2);
+    return tag;
+}
+
+bool not_modified(const HttpRequest& request, std::string_view etag, std::string_view last_modified,
+                  std::string* matched) {
+    auto if_none_match = request.headers.find("if-none-match");
+    if (if_none_match != request.headers.end()) {
+        if (etag.empty()) return false;
+        std::string_view list = if_none_match->second;
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            std::string_view tag = list.substr(0, comma);
+            list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+            while (!tag.empty() && (tag.front() == ' ' || tag.front() == '\t')) tag.remove_prefix(1);
+            while (!tag.empty() && (tag.back() == ' ' || tag.back() == '\t')) tag.remove_suffix(1);
+            if (tag == "*" || (!tag.empty() && opaque_tag(tag) == opaque_tag(etag))) {
+                if (matched && tag != "*") *matched = std::string(tag);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    auto if_modified_since = request.headers.find("if-modified-since");
+    if (if_modified_since == request.headers.end() || last_modified.empty()) return false;
+    time_t since = parse_http_date(if_modified_since->second);
+    time_t modified = parse_http_date(last_modified);
+    return since != -1 && modified != -1 && modified <= since;
+}
+
+size_t body_length(const HttpResponse& response) {
+    if (response.file) return response.file->size;
+    return response.body.empty() ? response.content_length : response.body.size();
+}
+
+void drop_body_for_head(HttpResponse& response) {
+    response.content_length = body_length(response);
+    response.body.clear();
+    response.file.reset();
+}
+
+void make_not_modified(HttpResponse& response, const std::string& etag) {
+    response.status_code = 304;
+    response.body.clear();
+    response.file.reset();
+    response.compressed = false;
+    response.headers.erase("Content-Encoding");
+    if (!etag.empty()) response.headers["ETag"] = etag;
+}
+
+void apply_conditional(const HttpRequest& request, HttpResponse& response) {
+    if (response.status_code != 200 || (request.method != "GET" && request.method != "HEAD")) return;
+
+    auto etag = response.headers.find("ETag");
+    if (etag == response.headers.end()) {
+        // An encoded body from upstream would need the tag of its identity form
+        if (response.file || response.compressed || response.body.empty() ||
+            cache_control_of(response).find("no-store") != std::string_view::npos) {
+            return;
+        }
+        etag = response.headers.emplace("ETag", content_etag(response.body)).first;
+    }
+
+    auto last_modified = response.headers.find("Last-Modified");
+    std::string matched;
+    if (not_modified(request, etag->second,
+                     last_modified != response.headers.end() ? std::string_view(last_modified->second)
+                                                             : std::string_view(),
+                     &matched)) {
+        make_not_modified(response, matched);
+    }
+}
+
+// ---------------- OutputQueue -----------------
+
+void OutputQueue::append_response(HttpResponse&& response, bool keep_alive,
+                                  int timeout, int max_requests) {
+    // Pipelined responses share one buffer until a large body breaks it up
+    if (!tail_shared) {
+        segments.emplace_back();
+        segments.back().data.reserve(512);
+        tail_shared = true;
+    }
+    std::string& head = segments.back().data;
+    size_t before = head.size();
+    append_response_head(head, response, keep_alive, timeout, max_requests);
+    pending += head.size() - before;
+
+    if (response.file) {
+        size_t length = response.file->size;
+        append_file(std::move(response.file), 0, length);
+        return;
+    }
+
+    if (response.body.size() <= INLINE_BODY_MAX) {
+        head += response.body;
+        pending += response.body.size();
+        return;
+    }
+
+    pending += response.body.size();
+    segments.push_back(Segment{ std::move(response.body), nullptr, 0, 0 });
+    tail_shared = false;
+}
+
+void OutputQueue::append(std::string data) {
+    if (data.empty()) return;
+    pending += data.size();
+    if (tail_shared && data.size() <= INLINE_BODY_MAX) {
+        segments.back().data += data;
+        return;
+    }
+    segments.push_back(Segment{ std::move(data), nullptr, 0, 0 });
+    tail_shared = false;
+}
+
+void OutputQueue::append(OutputQueue&& other) {
+    if (other.empty()) return;
+    if (empty()) {
+        swap(other);
+        other.clear();
+        return;
+    }
+    if (other.front_offset > 0) {
+        // Only a memory segment can be partially written before a hand-over
+        other.segments.front().data.erase(0, other.front_offset);
+    }
+    for (auto& segment : other.segments) segments.push_back(std::move(segment));
+    pending += other.pending;
+    file_segments += other.file_segments;
+    tail_shared = other.tail_shared;
+    other.clear();
+}
+
+void OutputQueue::append_file(std::shared_ptr<FileBody> file, size_t offset, size_t length) {
+    if (length == 0) return;
+    pending += length;
+    segments.push_back(Segment{ std::string(), std::move(file), offset, length });
+    file_segments++;
+    tail_shared = false;
+}
+
+int OutputQueue::fill_iovec(struct iovec* iov, int max_iov) const {
+    int count = 0;
+    for (size_t i = 0; i < segments.size() && count < max_iov; ++i) {
+        const Segment& segment = segments[i];
+        if (segment.file) break;
+        size_t skip = i == 0 ? front_offset : 0;
+        if (segment.data.size() == skip) continue;
+        iov[count].iov_base = const_cast<char*>(segment.data.data() + skip);
+        iov[count].iov_len = segment.data.size() - skip;
+        count++;
+    }
+    return count;
+}
+
+bool OutputQueue::front_file(int& fd, off_t& offset, size_t& count) const {
+    if (segments.empty() || !segments.front().file) return false;
+    const Segment& segment = segments.front();
+    fd = segment.file->fd;
+    offset = (off_t)(segment.file_offset + front_offset);
+    count = segment.file_length - front_offset;
+    return true;
+}
+
+void OutputQueue::consume(size_t n) {
+    pending -= n;
+    while (n > 0 && !segments.empty()) {
+        size_t available = segments.front().size() - front_offset;
+        if (n < available) {
+            front_offset += n;
+            return;
+        }
+        n -= available;
+        if (segments.front().file) file_segments--;
+        segments.pop_front();
+        front_offset = 0;
+    }
+    if (segments.empty()) tail_shared = false;
+}
+
+void OutputQueue::flatten() {
+    if (segments.size() <= 1 || file_segments > 0) return;
+    std::string all;
+    all.reserve(pending);
+    all.append(segments.front().data, front_offset, std::string::npos);
+    for (size_t i = 1; i < segments.size(); ++i) all += segments[i].data;
+    segments.clear();
+    segments.push_back(Segment{ std::move(all), nullptr, 0, 0 });
+    front_offset = 0;
+    tail_shared = false;
+}
+
+void OutputQueue::clear() {
+    segments.clear();
+    front_offset = 0;
+    pending = 0;
+    file_segments = 0;
+    tail_shared = false;
+}
+
+void OutputQueue::swap(OutputQueue& other) {
+    segments.swap(other.segments);
+    std::swap(front_offset, other.front_offset);
+    std::swap(pending, other.pending);
+    std::swap(file_segments, other.file_segments);
+    std::swap(tail_shared, other.tail_shared);
+}
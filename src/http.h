@@ -0,0 +1,124 @@
+#pragma once
+
+#include "rangoons.h"
+#include <sys/uio.h>
+#include <deque>
+#include <string>
+#include <string_view>
+
+// HTTP/1.1 wire format shared by run_server and OptimizedServer
+
+// Parse one complete, self-contained request into request. Connection code
+// should drive HttpParser over its receive buffer instead.
+bool parse_request(const std::string& raw_request, HttpRequest& request);
+
+// Preformatted "HTTP/1.1 <code> <reason>\r\n" for status_code
+std::string_view status_line(int status_code);
+
+// Just the reason phrase of status_line(), e.g. "Not Found"
+std::string_view reason_phrase(int status_code);
+
+// Append the status line and headers (up to and including the blank line)
+// for response to out. keep_alive selects the Connection header;
+// timeout/max_requests fill Keep-Alive.
+void append_response_head(std::string& out, const HttpResponse& response, bool keep_alive = false,
+                          int timeout = 0, int max_requests = 0);
+
+// Serialize status line, headers and body into a single buffer. A file
+// body is read into the buffer.
+std::string build_response(const HttpResponse& response, bool keep_alive = false,
+                           int timeout = 0, int max_requests = 0);
+
+// ---------------- Caching and validators -----------------
+
+// Cache-Control the response goes out with: a Cache-Control header when
+// one is set (e.g. relayed from an upstream), else response.cache_control
+std::string_view cache_control_of(const HttpResponse& response);
+
+// Strong entity tag for body, from its content hash and length
+std::string content_etag(std::string_view body);
+
+// IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT") for t, and back; parsing
+// returns -1 for anything else
+std::string http_date(time_t t);
+time_t parse_http_date(std::string_view value);
+
+// Is the client's copy of a response with these validators current?
+// If-None-Match decides when sent (weak comparison, as RFC 9110 asks),
+// otherwise If-Modified-Since. matched receives the If-None-Match tag that
+// matched, so a 304 can confirm the exact tag the client holds.
+bool not_modified(const HttpRequest& request, std::string_view etag, std::string_view last_modified,
+                  std::string* matched = nullptr);
+
+// Bytes of body the response stands for: the file's, the body's, or for
+// a HEAD answer without a body, content_length
+size_t body_length(const HttpResponse& response);
+
+// Reduce response to the answer to a HEAD: the GET response's headers,
+// Content-Length included, without its body
+void drop_body_for_head(HttpResponse& response);
+
+// Reduce response to a 304 Not Modified: no body, validators and caching
+// headers kept. etag, when given, replaces the ETag header.
+void make_not_modified(HttpResponse& response, const std::string& etag = std::string());
+
+// For a 200 to GET or HEAD: add an ETag from the body unless it has one
+// or must not be stored, then answer 304 instead when the request's
+// validators match. Runs before compression, which weakens the tag of the
+// encoded variant, so one tag covers every encoding of a body.
+void apply_conditional(const HttpRequest& request, HttpResponse& response);
+
+// Responses waiting to be written to a socket. Header blocks and small
+// bodies are packed into shared buffers; large bodies are moved in as their
+// own segment and written with scatter-gather I/O instead of being copied.
+// File bodies stay file segments for sendfile().
+class OutputQueue {
+public:
+    // Queue response; its body is taken over when large
+    void append_response(HttpResponse&& response, bool keep_alive = false,
+                         int timeout = 0, int max_requests = 0);
+    void append(std::string data);
+    void append(OutputQueue&& other);
+
+    // Queue length bytes of file starting at offset, sent with sendfile()
+    void append_file(std::shared_ptr<FileBody> file, size_t offset, size_t length);
+
+    bool empty() const { return pending == 0; }
+    size_t size() const { return pending; }
+    size_t segment_count() const { return segments.size(); }
+    bool has_files() const { return file_segments > 0; }
+
+    // Point up to max_iov entries at the unwritten bytes before the first
+    // file segment, returns the count
+    int fill_iovec(struct iovec* iov, int max_iov) const;
+
+    // When the next unwritten bytes come from a file, where to sendfile()
+    // them from
+    bool front_file(int& fd, off_t& offset, size_t& count) const;
+
+    // Drop the first n unwritten bytes after a (possibly short) write
+    void consume(size_t n);
+
+    // Merge everything into one segment so a single iovec covers it; only
+    // valid without file segments
+    void flatten();
+
+    void clear();
+    void swap(OutputQueue& other);
+
+private:
+    struct Segment {
+        std::string data;
+        std::shared_ptr<FileBody> file;
+        size_t file_offset = 0;
+        size_t file_length = 0;
+
+        size_t size() const { return file ? file_length : data.size(); }
+    };
+
+    std::deque<Segment> segments;
+    size_t front_offset = 0; // bytes of segments.front() already written
+    size_t pending = 0;
+    size_t file_segments = 0;
+    bool tail_shared = false; // segments.back() may take more small appends
+};
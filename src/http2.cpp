@@ -0,0 +1,702 @@
+#include "http2.h"
+#include "http_parser.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+
+const std::string_view HTTP2_PREFACE("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", 24);
+
+enum FrameType : uint8_t {
+    FRAME_DATA = 0x0,
+    FRAME_HEADERS = 0x1,
+    FRAME_PRIORITY = 0x2,
+    FRAME_RST_STREAM = 0x3,
+    FRAME_SETTINGS = 0x4,
+    FRAME_PUSH_PROMISE = 0x5,
+    FRAME_PING = 0x6,
+    FRAME_GOAWAY = 0x7,
+    FRAME_WINDOW_UPDATE = 0x8,
+    FRAME_CONTINUATION = 0x9,
+};
+
+static const uint8_t FLAG_END_STREAM = 0x1;
+static const uint8_t FLAG_ACK = 0x1;
+static const uint8_t FLAG_END_HEADERS = 0x4;
+static const uint8_t FLAG_PADDED = 0x8;
+static const uint8_t FLAG_PRIORITY = 0x20;
+
+enum ErrorCode : uint32_t {
+    NO_ERROR = 0x0,
+    PROTOCOL_ERROR = 0x1,
+    FLOW_CONTROL_ERROR = 0x3,
+    STREAM_CLOSED = 0x5,
+    FRAME_SIZE_ERROR = 0x6,
+    REFUSED_STREAM = 0x7,
+    COMPRESSION_ERROR = 0x9,
+    ENHANCE_YOUR_CALM = 0xb,
+};
+
+// What we advertise in SETTINGS
+static const uint32_t MAX_CONCURRENT_STREAMS = 128;
+static const int64_t STREAM_WINDOW = 1 << 20;
+static const uint32_t MAX_HEADER_LIST = 64 * 1024;
+
+// Connection receive window, opened past the 64 KB default right away so
+// uploads on several streams do not stall each other
+static const int64_t CONNECTION_WINDOW = 16 << 20;
+
+static const size_t MAX_FRAME = 16384;            // SETTINGS_MAX_FRAME_SIZE default
+static const size_t MAX_HEADER_BLOCK = 256 * 1024; // compressed, across CONTINUATIONs
+static const size_t MAX_BODY = 64 * 1024 * 1024;   // same limit as HttpParser
+static const int64_t MAX_WINDOW = 0x7fffffff;
+
+// Stop framing DATA once this much output is queued; the loop calls back
+// after the socket drains
+static const size_t OUTPUT_HIGH_WATER = 256 * 1024;
+
+// ---------------- Framing -----------------
+
+static void put_frame_header(std::string& out, size_t length, uint8_t type, uint8_t flags, uint32_t stream_id) {
+    char header[9] = {
+        (char)(length >> 16), (char)(length >> 8), (char)length,
+        (char)type, (char)flags,
+        (char)((stream_id >> 24) & 0x7f), (char)(stream_id >> 16), (char)(stream_id >> 8), (char)stream_id,
+    };
+    out.append(header, sizeof(header));
+}
+
+static void put_u32(std::string& out, uint32_t value) {
+    char bytes[4] = { (char)(value >> 24), (char)(value >> 16), (char)(value >> 8), (char)value };
+    out.append(bytes, sizeof(bytes));
+}
+
+static uint32_t get_u32(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | u[3];
+}
+
+static void put_setting(std::string& out, uint16_t id, uint32_t value) {
+    out += (char)(id >> 8);
+    out += (char)id;
+    put_u32(out, value);
+}
+
+static void put_window_update(std::string& out, uint32_t stream_id, uint32_t increment) {
+    put_frame_header(out, 4, FRAME_WINDOW_UPDATE, 0, stream_id);
+    put_u32(out, increment);
+}
+
+// HTTP2-Settings is base64url without padding; be lenient about both
+static bool base64url_decode(std::string_view in, std::string& out) {
+    uint32_t acc = 0;
+    int bits = 0;
+    for (char c : in) {
+        int v;
+        if (c >= 'A' && c <= 'Z') v = c - 'A';
+        else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') v = c - '0' + 52;
+        else if (c == '-' || c == '+') v = 62;
+        else if (c == '_' || c == '/') v = 63;
+        else if (c == '=') break;
+        else return false;
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out += (char)(acc >> bits);
+        }
+    }
+    return true;
+}
+
+static bool is_connection_header(std::string_view name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+// ---------------- Session -----------------
+
+Http2Session::Http2Session() : conn_recv_window(CONNECTION_WINDOW) {}
+
+void Http2Session::start(OutputQueue& out) {
+    std::string frames;
+    put_frame_header(frames, 18, FRAME_SETTINGS, 0, 0);
+    put_setting(frames, 0x3, MAX_CONCURRENT_STREAMS);
+    put_setting(frames, 0x4, STREAM_WINDOW);
+    put_setting(frames, 0x6, MAX_HEADER_LIST);
+    put_window_update(frames, 0, CONNECTION_WINDOW - 65535);
+    out.append(std::move(frames));
+}
+
+bool Http2Session::start_upgrade(OutputQueue& out, std::string_view settings, HttpRequest&& request,
+                                 std::vector<Request>& ready) {
+    std::string payload;
+    if (!base64url_decode(settings, payload) || payload.size() % 6 != 0 || apply_settings(payload) != 0) {
+        return false;
+    }
+    start(out);
+
+    // The upgrade request is stream 1, already half-closed by the client
+    last_stream_id = 1;
+    Stream& stream = streams[1];
+    stream.send_window = peer_initial_window;
+    stream.recv_window = STREAM_WINDOW;
+    stream.remote_closed = true;
+    stream.head = request.method == "HEAD";
+    ready.push_back(Request{ 1, std::move(request) });
+    return true;
+}
+
+size_t Http2Session::receive(std::string_view input, OutputQueue& out, std::vector<Request>& ready) {
+    if (error) return input.size(); // nothing more is read after GOAWAY
+
+    size_t consumed = 0;
+    if (!preface_received) {
+        size_t n = std::min(input.size(), HTTP2_PREFACE.size());
+        if (input.substr(0, n) != HTTP2_PREFACE.substr(0, n)) {
+            connection_error(PROTOCOL_ERROR, out);
+            return input.size();
+        }
+        if (n < HTTP2_PREFACE.size()) return 0;
+        preface_received = true;
+        consumed = n;
+    }
+
+    while (input.size() - consumed >= 9) {
+        const char* h = input.data() + consumed;
+        size_t length = ((size_t)(uint8_t)h[0] << 16) | ((size_t)(uint8_t)h[1] << 8) | (uint8_t)h[2];
+        uint8_t type = h[3];
+        uint8_t flags = h[4];
+        uint32_t stream_id = get_u32(h + 5) & 0x7fffffff;
+
+        if (length > MAX_FRAME) {
+            connection_error(FRAME_SIZE_ERROR, out);
+            return input.size();
+        }
+        if (input.size() - consumed < 9 + length) break;
+
+        std::string_view payload = input.substr(consumed + 9, length);
+        consumed += 9 + length;
+        if (!on_frame(type, flags, stream_id, payload, out, ready)) return input.size();
+    }
+    return consumed;
+}
+
+bool Http2Session::on_frame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload,
+                            OutputQueue& out, std::vector<Request>& ready) {
+    // The client preface ends with its SETTINGS
+    if (!settings_received && (type != FRAME_SETTINGS || (flags & FLAG_ACK))) {
+        return connection_error(PROTOCOL_ERROR, out);
+    }
+    // Nothing may interleave with a header block
+    if (continuation_stream && (type != FRAME_CONTINUATION || stream_id != continuation_stream)) {
+        return connection_error(PROTOCOL_ERROR, out);
+    }
+
+    switch (type) {
+        case FRAME_DATA:
+            return on_data(flags, stream_id, payload, out, ready);
+
+        case FRAME_HEADERS:
+            return on_headers(flags, stream_id, payload, out, ready);
+
+        case FRAME_CONTINUATION:
+            if (!continuation_stream) return connection_error(PROTOCOL_ERROR, out);
+            header_block.append(payload);
+            if (header_block.size() > MAX_HEADER_BLOCK) return connection_error(ENHANCE_YOUR_CALM, out);
+            if (flags & FLAG_END_HEADERS) {
+                continuation_stream = 0;
+                return on_header_block(stream_id, continuation_flags, out, ready);
+            }
+            return true;
+
+        case FRAME_PRIORITY:
+            // Accepted but not acted on: responses go out round robin
+            if (stream_id == 0) return connection_error(PROTOCOL_ERROR, out);
+            if (payload.size() != 5) reset_stream(stream_id, FRAME_SIZE_ERROR, out);
+            return true;
+
+        case FRAME_RST_STREAM:
+            if (stream_id == 0 || stream_id > last_stream_id) return connection_error(PROTOCOL_ERROR, out);
+            if (payload.size() != 4) return connection_error(FRAME_SIZE_ERROR, out);
+            streams.erase(stream_id);
+            return true;
+
+        case FRAME_SETTINGS:
+            if (stream_id != 0) return connection_error(PROTOCOL_ERROR, out);
+            return on_settings(flags, payload, out);
+
+        case FRAME_PING: {
+            if (stream_id != 0) return connection_error(PROTOCOL_ERROR, out);
+            if (payload.size() != 8) return connection_error(FRAME_SIZE_ERROR, out);
+            if (flags & FLAG_ACK) return true;
+            std::string pong;
+            put_frame_header(pong, 8, FRAME_PING, FLAG_ACK, 0);
+            pong.append(payload);
+            out.append(std::move(pong));
+            return true;
+        }
+
+        case FRAME_GOAWAY:
+            if (stream_id != 0) return connection_error(PROTOCOL_ERROR, out);
+            if (payload.size() < 8) return connection_error(FRAME_SIZE_ERROR, out);
+            peer_goaway = true;
+            return true;
+
+        case FRAME_WINDOW_UPDATE:
+            return on_window_update(stream_id, payload, out);
+
+        case FRAME_PUSH_PROMISE:
+            return connection_error(PROTOCOL_ERROR, out); // clients cannot push
+
+        default:
+            return true; // unknown frame types are ignored
+    }
+}
+
+bool Http2Session::on_headers(uint8_t flags, uint32_t stream_id, std::string_view payload,
+                              OutputQueue& out, std::vector<Request>& ready) {
+    if (stream_id == 0 || (stream_id & 1) == 0) return connection_error(PROTOCOL_ERROR, out);
+
+    size_t padding = 0;
+    if (flags & FLAG_PADDED) {
+        if (payload.empty()) return connection_error(PROTOCOL_ERROR, out);
+        padding = (uint8_t)payload[0];
+        payload.remove_prefix(1);
+    }
+    if (flags & FLAG_PRIORITY) {
+        if (payload.size() < 5) return connection_error(FRAME_SIZE_ERROR, out);
+        payload.remove_prefix(5);
+    }
+    if (padding > payload.size()) return connection_error(PROTOCOL_ERROR, out);
+    payload.remove_suffix(padding);
+
+    header_block.assign(payload);
+    if (!(flags & FLAG_END_HEADERS)) {
+        continuation_stream = stream_id;
+        continuation_flags = flags;
+        return true;
+    }
+    return on_header_block(stream_id, flags, out, ready);
+}
+
+bool Http2Session::on_header_block(uint32_t stream_id, uint8_t flags, OutputQueue& out,
+                                   std::vector<Request>& ready) {
+    // Decode even for streams we refuse: the tables must stay in sync
+    std::vector<HeaderField> fields;
+    bool decoded = decoder.decode(header_block, fields);
+    header_block.clear();
+    if (!decoded) return connection_error(COMPRESSION_ERROR, out);
+
+    auto it = streams.find(stream_id);
+    if (it != streams.end()) {
+        // Trailers: they must end the stream and are not passed on
+        Stream& stream = it->second;
+        if (stream.remote_closed) {
+            reset_stream(stream_id, STREAM_CLOSED, out);
+        } else if (!(flags & FLAG_END_STREAM)) {
+            reset_stream(stream_id, PROTOCOL_ERROR, out);
+        } else {
+            dispatch(stream_id, stream, out, ready);
+        }
+        return true;
+    }
+
+    if (stream_id <= last_stream_id) return connection_error(STREAM_CLOSED, out);
+    last_stream_id = stream_id;
+
+    if (streams.size() >= MAX_CONCURRENT_STREAMS) {
+        reset_stream(stream_id, REFUSED_STREAM, out);
+        return true;
+    }
+
+    Stream& stream = streams[stream_id];
+    stream.send_window = peer_initial_window;
+    stream.recv_window = STREAM_WINDOW;
+    if (!build_request(fields, stream)) {
+        reset_stream(stream_id, PROTOCOL_ERROR, out);
+        return true;
+    }
+    if (stream.header_bytes > MAX_HEADER_LIST) {
+        stream.remote_closed = flags & FLAG_END_STREAM;
+        reject(stream_id, 431, out);
+        return true;
+    }
+    if (flags & FLAG_END_STREAM) dispatch(stream_id, stream, out, ready);
+    return true;
+}
+
+bool Http2Session::on_data(uint8_t flags, uint32_t stream_id, std::string_view payload,
+                           OutputQueue& out, std::vector<Request>& ready) {
+    if (stream_id == 0) return connection_error(PROTOCOL_ERROR, out);
+
+    // Flow control covers the whole payload, padding included, whatever
+    // happens to the stream
+    int64_t frame_size = payload.size();
+    if (frame_size > conn_recv_window) return connection_error(FLOW_CONTROL_ERROR, out);
+    conn_recv_window -= frame_size;
+    if (conn_recv_window < CONNECTION_WINDOW / 2) {
+        std::string update;
+        put_window_update(update, 0, CONNECTION_WINDOW - conn_recv_window);
+        out.append(std::move(update));
+        conn_recv_window = CONNECTION_WINDOW;
+    }
+
+    if (flags & FLAG_PADDED) {
+        if (payload.empty()) return connection_error(PROTOCOL_ERROR, out);
+        size_t padding = (uint8_t)payload[0];
+        payload.remove_prefix(1);
+        if (padding > payload.size()) return connection_error(PROTOCOL_ERROR, out);
+        payload.remove_suffix(padding);
+    }
+
+    auto it = streams.find(stream_id);
+    if (it == streams.end()) {
+        if (stream_id > last_stream_id) return connection_error(PROTOCOL_ERROR, out);
+        reset_stream(stream_id, STREAM_CLOSED, out);
+        return true;
+    }
+
+    Stream& stream = it->second;
+    if (stream.remote_closed) {
+        reset_stream(stream_id, STREAM_CLOSED, out);
+        return true;
+    }
+    if (frame_size > stream.recv_window) {
+        reset_stream(stream_id, FLOW_CONTROL_ERROR, out);
+        return true;
+    }
+    stream.recv_window -= frame_size;
+    if (stream.sending) return true; // answered early, the rest of the body is dropped
+
+    if (stream.request.body.size() + payload.size() > MAX_BODY) {
+        reject(stream_id, 413, out);
+        return true;
+    }
+    stream.request.body.append(payload);
+
+    if (flags & FLAG_END_STREAM) {
+        dispatch(stream_id, stream, out, ready);
+    } else if (stream.recv_window < STREAM_WINDOW / 2) {
+        std::string update;
+        put_window_update(update, stream_id, STREAM_WINDOW - stream.recv_window);
+        out.append(std::move(update));
+        stream.recv_window = STREAM_WINDOW;
+    }
+    return true;
+}
+
+bool Http2Session::on_settings(uint8_t flags, std::string_view payload, OutputQueue& out) {
+    if (flags & FLAG_ACK) {
+        if (!payload.empty()) return connection_error(FRAME_SIZE_ERROR, out);
+        return true;
+    }
+    if (payload.size() % 6 != 0) return connection_error(FRAME_SIZE_ERROR, out);
+
+    uint32_t code = apply_settings(payload);
+    if (code != NO_ERROR) return connection_error(code, out);
+    settings_received = true;
+
+    std::string ack;
+    put_frame_header(ack, 0, FRAME_SETTINGS, FLAG_ACK, 0);
+    out.append(std::move(ack));
+
+    // A larger initial window may unblock waiting responses
+    send_data(out);
+    return true;
+}
+
+uint32_t Http2Session::apply_settings(std::string_view payload) {
+    for (size_t i = 0; i + 6 <= payload.size(); i += 6) {
+        uint16_t id = ((uint16_t)(uint8_t)payload[i] << 8) | (uint8_t)payload[i + 1];
+        uint32_t value = get_u32(payload.data() + i + 2);
+
+        switch (id) {
+            case 0x1: // HEADER_TABLE_SIZE
+                encoder.set_max_table_size(value);
+                break;
+            case 0x2: // ENABLE_PUSH
+                if (value > 1) return PROTOCOL_ERROR;
+                break;
+            case 0x4: { // INITIAL_WINDOW_SIZE, applies to open streams too
+                if (value > MAX_WINDOW) return FLOW_CONTROL_ERROR;
+                int64_t delta = (int64_t)value - peer_initial_window;
+                for (auto& entry : streams) {
+                    entry.second.send_window += delta;
+                    if (entry.second.send_window > MAX_WINDOW) return FLOW_CONTROL_ERROR;
+                }
+                peer_initial_window = value;
+                break;
+            }
+            case 0x5: // MAX_FRAME_SIZE
+                if (value < 16384 || value > 16777215) return PROTOCOL_ERROR;
+                peer_max_frame = value;
+                break;
+            default:
+                break; // MAX_CONCURRENT_STREAMS only limits pushes; unknown ids are ignored
+        }
+    }
+    return NO_ERROR;
+}
+
+bool Http2Session::on_window_update(uint32_t stream_id, std::string_view payload, OutputQueue& out) {
+    if (payload.size() != 4) return connection_error(FRAME_SIZE_ERROR, out);
+    uint32_t increment = get_u32(payload.data()) & 0x7fffffff;
+
+    if (stream_id == 0) {
+        if (increment == 0) return connection_error(PROTOCOL_ERROR, out);
+        conn_send_window += increment;
+        if (conn_send_window > MAX_WINDOW) return connection_error(FLOW_CONTROL_ERROR, out);
+    } else {
+        auto it = streams.find(stream_id);
+        if (it == streams.end()) {
+            if (stream_id > last_stream_id) return connection_error(PROTOCOL_ERROR, out);
+            return true; // already closed
+        }
+        if (increment == 0) {
+            reset_stream(stream_id, PROTOCOL_ERROR, out);
+            return true;
+        }
+        it->second.send_window += increment;
+        if (it->second.send_window > MAX_WINDOW) {
+            reset_stream(stream_id, FLOW_CONTROL_ERROR, out);
+            return true;
+        }
+    }
+
+    send_data(out);
+    return true;
+}
+
+// Map the decoded fields onto HttpRequest, rejecting what RFC 9113 8.2-8.3
+// calls malformed
+bool Http2Session::build_request(const std::vector<HeaderField>& fields, Stream& stream) {
+    HttpRequest& request = stream.request;
+    std::string scheme, path, authority;
+    bool regular_seen = false;
+
+    for (const HeaderField& field : fields) {
+        stream.header_bytes += field.name.size() + field.value.size() + 32;
+
+        if (!field.name.empty() && field.name[0] == ':') {
+            if (regular_seen) return false;
+            std::string* slot = field.name == ":method" ? &request.method
+                              : field.name == ":scheme" ? &scheme
+                              : field.name == ":path" ? &path
+                              : field.name == ":authority" ? &authority
+                              : nullptr;
+            if (!slot || !slot->empty()) return false;
+            *slot = field.value;
+            continue;
+        }
+
+        regular_seen = true;
+        for (char c : field.name) {
+            if (c >= 'A' && c <= 'Z') return false;
+        }
+        if (is_connection_header(field.name)) return false;
+        if (field.name == "te" && field.value != "trailers") return false;
+
+        // Repeated fields are joined; cookies may arrive split into crumbs
+        auto it = request.headers.find(field.name);
+        if (it == request.headers.end()) {
+            request.headers.emplace(field.name, field.value);
+        } else {
+            it->second += field.name == "cookie" ? "; " : ", ";
+            it->second += field.value;
+        }
+    }
+
+    if (request.method.empty() || scheme.empty() || path.empty()) return false;
+
+    if (!authority.empty()) request.headers.emplace("host", authority);
+    size_t query = path.find('?');
+    request.target = path.substr(0, query);
+    if (query != std::string::npos) {
+        request.query = path.substr(query + 1);
+        parse_query(request.query, request.query_params);
+    }
+    request.version = "HTTP/2";
+
+    auto ua = request.headers.find("user-agent");
+    if (ua != request.headers.end()) request.user_agent = ua->second;
+    stream.head = request.method == "HEAD";
+    return true;
+}
+
+void Http2Session::dispatch(uint32_t stream_id, Stream& stream, OutputQueue& out, std::vector<Request>& ready) {
+    stream.remote_closed = true;
+
+    auto length = stream.request.headers.find("content-length");
+    if (length != stream.request.headers.end()) {
+        size_t declared = 0;
+        const std::string& value = length->second;
+        auto result = std::from_chars(value.data(), value.data() + value.size(), declared);
+        if (result.ec != std::errc() || result.ptr != value.data() + value.size() ||
+            declared != stream.request.body.size()) {
+            reset_stream(stream_id, PROTOCOL_ERROR, out);
+            return;
+        }
+    }
+    ready.push_back(Request{ stream_id, std::move(stream.request) });
+}
+
+void Http2Session::respond(uint32_t stream_id, HttpResponse&& response, OutputQueue& out) {
+    auto it = streams.find(stream_id);
+    if (error || it == streams.end() || it->second.sending) return;
+    Stream& stream = it->second;
+
+    std::string block;
+    encoder.begin(block);
+
+    char digits[24];
+    auto status = std::to_chars(digits, digits + sizeof(digits), response.status_code);
+    encoder.encode(block, ":status", std::string_view(digits, status.ptr - digits));
+    size_t length = body_length(response);
+    // A 304 describes the client's stored body; its length and type stand
+    if (response.status_code != 304) {
+        if (!response.content_type.empty()) encoder.encode(block, "content-type", response.content_type);
+        auto digits_end = std::to_chars(digits, digits + sizeof(digits), length).ptr;
+        encoder.encode(block, "content-length", std::string_view(digits, digits_end - digits),
+                       HpackEncoder::Indexing::None);
+    }
+    if (!response.cache_control.empty() && !response.headers.count("Cache-Control")) {
+        encoder.encode(block, "cache-control", response.cache_control);
+    }
+
+    for (const auto& header : response.headers) {
+        std::string name = header.first;
+        std::transform(name.begin(), name.end(), name.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        if (is_connection_header(name) || name == "content-length") continue;
+
+        // Per-response values would only churn the dynamic table
+        HpackEncoder::Indexing indexing = HpackEncoder::Indexing::Incremental;
+        if (name == "set-cookie") {
+            indexing = HpackEncoder::Indexing::Never;
+        } else if (name == "etag" || name == "last-modified" || name == "date" || name == "location") {
+            indexing = HpackEncoder::Indexing::None;
+        }
+        encoder.encode(block, name, header.second, indexing);
+    }
+
+    // HEADERS, then CONTINUATION for whatever exceeds the peer's frame size
+    bool has_body = length > 0 && !stream.head;
+    std::string frames;
+    size_t offset = 0;
+    do {
+        size_t chunk = std::min(block.size() - offset, peer_max_frame);
+        bool first = offset == 0;
+        uint8_t flags = offset + chunk == block.size() ? FLAG_END_HEADERS : 0;
+        if (first && !has_body) flags |= FLAG_END_STREAM;
+        put_frame_header(frames, chunk, first ? FRAME_HEADERS : FRAME_CONTINUATION, flags, stream_id);
+        frames.append(block, offset, chunk);
+        offset += chunk;
+    } while (offset < block.size());
+    out.append(std::move(frames));
+
+    if (!has_body) {
+        finish_stream(stream_id, out);
+        return;
+    }
+
+    stream.sending = true;
+    stream.file = std::move(response.file);
+    stream.body = std::move(response.body);
+    stream.body_offset = 0;
+    stream.body_end = length;
+    send_queue.push_back(stream_id);
+    send_data(out);
+}
+
+void Http2Session::send_data(OutputQueue& out) {
+    // One frame per stream per round, so a large body cannot hold up the
+    // small ones queued behind it
+    bool progressed = true;
+    while (progressed && !send_queue.empty() && conn_send_window > 0 && out.size() < OUTPUT_HIGH_WATER) {
+        progressed = false;
+        for (size_t n = send_queue.size(); n > 0 && conn_send_window > 0 && out.size() < OUTPUT_HIGH_WATER; --n) {
+            uint32_t stream_id = send_queue.front();
+            send_queue.pop_front();
+            auto it = streams.find(stream_id);
+            if (it == streams.end()) continue; // reset meanwhile
+
+            Stream& stream = it->second;
+            if (stream.send_window <= 0) {
+                send_queue.push_back(stream_id);
+                continue;
+            }
+
+            size_t chunk = std::min({ stream.body_end - stream.body_offset, peer_max_frame,
+                                      (size_t)conn_send_window, (size_t)stream.send_window });
+            bool last = stream.body_offset + chunk == stream.body_end;
+            std::string frame;
+            put_frame_header(frame, chunk, FRAME_DATA, last ? FLAG_END_STREAM : 0, stream_id);
+            if (stream.file) {
+                out.append(std::move(frame));
+                out.append_file(stream.file, stream.body_offset, chunk);
+            } else {
+                frame.append(stream.body, stream.body_offset, chunk);
+                out.append(std::move(frame));
+            }
+
+            stream.body_offset += chunk;
+            stream.send_window -= chunk;
+            conn_send_window -= chunk;
+            progressed = true;
+
+            if (last) {
+                finish_stream(stream_id, out);
+            } else {
+                send_queue.push_back(stream_id);
+            }
+        }
+    }
+}
+
+bool Http2Session::wants_write() const {
+    if (error || conn_send_window <= 0) return false;
+    for (uint32_t stream_id : send_queue) {
+        auto it = streams.find(stream_id);
+        if (it != streams.end() && it->second.send_window > 0) return true;
+    }
+    return false;
+}
+
+// Answer a stream without running the handler
+void Http2Session::reject(uint32_t stream_id, int status_code, OutputQueue& out) {
+    HttpResponse response;
+    response.status_code = status_code;
+    response.content_type = "text/plain";
+    response.body.assign(reason_phrase(status_code));
+    respond(stream_id, std::move(response), out);
+}
+
+void Http2Session::reset_stream(uint32_t stream_id, uint32_t code, OutputQueue& out) {
+    std::string frame;
+    put_frame_header(frame, 4, FRAME_RST_STREAM, 0, stream_id);
+    put_u32(frame, code);
+    out.append(std::move(frame));
+    streams.erase(stream_id);
+}
+
+void Http2Session::finish_stream(uint32_t stream_id, OutputQueue& out) {
+    auto it = streams.find(stream_id);
+    if (it == streams.end()) return;
+    if (!it->second.remote_closed) {
+        // Answered early (e.g. 413): tell the client to stop sending
+        reset_stream(stream_id, NO_ERROR, out);
+        return;
+    }
+    streams.erase(it);
+}
+
+bool Http2Session::connection_error(uint32_t code, OutputQueue& out) {
+    std::string frame;
+    put_frame_header(frame, 8, FRAME_GOAWAY, 0, 0);
+    put_u32(frame, last_stream_id);
+    put_u32(frame, code);
+    out.append(std::move(frame));
+    error = true;
+    return false;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "rangoons.h"
+#include "hpack.h"
+#include "http.h"
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Cleartext HTTP/2 (h2c, RFC 9113) for one connection. The session turns
+// incoming frames into HttpRequests for the same route handlers HTTP/1.1
+// uses, and responses back into HEADERS/DATA frames, honouring flow control
+// in both directions. It never touches the socket: the connection loop
+// feeds it received bytes and writes out whatever it queues.
+
+// What a prior-knowledge client sends first
+extern const std::string_view HTTP2_PREFACE;
+
+class Http2Session {
+public:
+    struct Request {
+        uint32_t stream_id;
+        HttpRequest request;
+    };
+
+    Http2Session();
+
+    // Queue our SETTINGS and connection window, the server side of the preface
+    void start(OutputQueue& out);
+
+    // Same for a connection upgraded from HTTP/1.1 after the 101 has been
+    // queued. settings is the HTTP2-Settings header; request is answered
+    // on stream 1. false, leaving request untouched, when the settings are
+    // malformed.
+    bool start_upgrade(OutputQueue& out, std::string_view settings, HttpRequest&& request,
+                       std::vector<Request>& ready);
+
+    // Process the complete frames at the front of input. Replies the
+    // protocol requires (SETTINGS/PING acks, WINDOW_UPDATE) go to out and
+    // finished requests to ready. Returns the bytes consumed.
+    size_t receive(std::string_view input, OutputQueue& out, std::vector<Request>& ready);
+
+    // Queue the response to stream_id. DATA beyond the flow-control windows
+    // waits for WINDOW_UPDATE. A stream reset in the meantime drops it.
+    void respond(uint32_t stream_id, HttpResponse&& response, OutputQueue& out);
+
+    // Queue DATA for waiting responses while windows allow and out is not
+    // backed up. wants_write() tells whether another call would make progress.
+    void send_data(OutputQueue& out);
+    bool wants_write() const;
+
+    // A connection error was found and GOAWAY queued: close once written
+    bool failed() const { return error; }
+
+    // The peer sent GOAWAY and every stream it left open has been answered
+    bool finished() const { return peer_goaway && streams.empty(); }
+
+private:
+    struct Stream {
+        HttpRequest request;
+        bool remote_closed = false;  // END_STREAM received
+        bool head = false;           // HEAD: headers only
+        int64_t send_window = 0;
+        int64_t recv_window = 0;
+        size_t header_bytes = 0;
+
+        // Response body still to send
+        std::string body;
+        std::shared_ptr<FileBody> file;
+        size_t body_offset = 0;
+        size_t body_end = 0;
+        bool sending = false;
+    };
+
+    HpackDecoder decoder;
+    HpackEncoder encoder;
+    std::map<uint32_t, Stream> streams;
+    std::deque<uint32_t> send_queue;  // streams with DATA waiting, round robin
+
+    bool preface_received = false;
+    bool settings_received = false;
+    bool peer_goaway = false;
+    bool error = false;
+    uint32_t last_stream_id = 0;      // highest stream the client opened
+
+    // Header block split across HEADERS + CONTINUATION
+    uint32_t continuation_stream = 0;
+    uint8_t continuation_flags = 0;
+    std::string header_block;
+
+    // Flow control; the peer's limits start at the protocol defaults
+    int64_t conn_send_window = 65535;
+    int64_t conn_recv_window;
+    int64_t peer_initial_window = 65535;
+    size_t peer_max_frame = 16384;
+
+    bool on_frame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload,
+                  OutputQueue& out, std::vector<Request>& ready);
+    bool on_headers(uint8_t flags, uint32_t stream_id, std::string_view payload,
+                    OutputQueue& out, std::vector<Request>& ready);
+    bool on_header_block(uint32_t stream_id, uint8_t flags, OutputQueue& out, std::vector<Request>& ready);
+    bool on_data(uint8_t flags, uint32_t stream_id, std::string_view payload,
+                 OutputQueue& out, std::vector<Request>& ready);
+    bool on_settings(uint8_t flags, std::string_view payload, OutputQueue& out);
+    uint32_t apply_settings(std::string_view payload); // 0 or an error code
+    bool on_window_update(uint32_t stream_id, std::string_view payload, OutputQueue& out);
+
+    bool build_request(const std::vector<HeaderField>& fields, Stream& stream);
+    void dispatch(uint32_t stream_id, Stream& stream, OutputQueue& out, std::vector<Request>& ready);
+    void reject(uint32_t stream_id, int status_code, OutputQueue& out);
+    void reset_stream(uint32_t stream_id, uint32_t code, OutputQueue& out);
+    void finish_stream(uint32_t stream_id, OutputQueue& out);
+    bool connection_error(uint32_t code, OutputQueue& out);
+};
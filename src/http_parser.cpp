@@ -0,0 +1,350 @@
+#include "http_parser.h"
+#include <algorithm>
+#include <cstring>
+
+static bool iequals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = a[i], y = b[i];
+        if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+        if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+        if (x != y) return false;
+    }
+    return true;
+}
+
+static bool icontains(std::string_view haystack, std::string_view needle) {
+    if (needle.size() > haystack.size()) return false;
+    for (size_t i = 0; i + needle.size() <= haystack.size(); ++i) {
+        if (iequals(haystack.substr(i, needle.size()), needle)) return true;
+    }
+    return false;
+}
+
+static std::string_view trim_ows(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+void HttpParser::reset() {
+    buf = std::string_view();
+    state = State::RequestLine;
+    pos = 0;
+    request_end = 0;
+    error_code = 0;
+    method_span = target_span = version_span = Span();
+    header_spans.clear();
+    body_span = Span();
+    chunked = false;
+    body_remaining = 0;
+    chunked_body.clear();
+}
+
+HttpParser::Status HttpParser::fail(int status) {
+    error_code = status;
+    return Status::Error;
+}
+
+HttpParser::Status HttpParser::parse(std::string_view data) {
+    buf = data;
+    if (error_code) return Status::Error;
+
+    while (true) {
+        switch (state) {
+            case State::RequestLine:
+            case State::Headers: {
+                const char* nl = static_cast<const char*>(
+                    std::memchr(buf.data() + pos, '\n', buf.size() - pos));
+                if (!nl) {
+                    if (buf.size() > max_header_bytes) return fail(431);
+                    return Status::NeedMore;
+                }
+                size_t line_end = nl - buf.data();
+                if (line_end > max_header_bytes) return fail(431);
+
+                Status s = state == State::RequestLine ? parse_request_line(line_end)
+                                                       : parse_header_line(line_end);
+                if (s != Status::NeedMore) return s;
+                break;
+            }
+
+            case State::Body:
+                if (buf.size() < body_span.offset + body_span.length) return Status::NeedMore;
+                request_end = body_span.offset + body_span.length;
+                state = State::Done;
+                break;
+
+            case State::ChunkSize:
+            case State::ChunkData:
+            case State::ChunkDataEnd:
+            case State::Trailers: {
+                Status s = parse_chunks();
+                if (s != Status::NeedMore || state != State::Done) return s;
+                break;
+            }
+
+            case State::Done:
+                return Status::Complete;
+        }
+    }
+}
+
+// Returns NeedMore to keep the main loop going, anything else ends parse()
+HttpParser::Status HttpParser::parse_request_line(size_t line_end) {
+    size_t start = pos;
+    size_t end = line_end;
+    pos = line_end + 1;
+    if (end > start && buf[end - 1] == '\r') --end;
+
+    // Tolerate empty lines before the request line (RFC 9112 2.2)
+    if (end == start) return Status::NeedMore;
+
+    std::string_view line = buf.substr(start, end - start);
+    size_t sp1 = line.find(' ');
+    if (sp1 == std::string_view::npos || sp1 == 0) return fail(400);
+    size_t sp2 = line.find(' ', sp1 + 1);
+    if (sp2 == std::string_view::npos || sp2 == sp1 + 1) return fail(400);
+
+    std::string_view version = line.substr(sp2 + 1);
+    if (version.substr(0, 5) != "HTTP/") return fail(400);
+
+    method_span = { (uint32_t)start, (uint32_t)sp1 };
+    target_span = { (uint32_t)(start + sp1 + 1), (uint32_t)(sp2 - sp1 - 1) };
+    version_span = { (uint32_t)(start + sp2 + 1), (uint32_t)version.size() };
+    state = State::Headers;
+    return Status::NeedMore;
+}
+
+HttpParser::Status HttpParser::parse_header_line(size_t line_end) {
+    size_t start = pos;
+    size_t end = line_end;
+    pos = line_end + 1;
+    if (end > start && buf[end - 1] == '\r') --end;
+
+    if (end == start) return finish_headers();
+
+    // Obsolete line folding is a smuggling vector; refuse it
+    if (buf[start] == ' ' || buf[start] == '\t') return fail(400);
+
+    std::string_view line = buf.substr(start, end - start);
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos || colon == 0) return fail(400);
+    if (line[colon - 1] == ' ' || line[colon - 1] == '\t') return fail(400);
+
+    std::string_view value = trim_ows(line.substr(colon + 1));
+    size_t value_offset = value.empty() ? start + colon + 1 : value.data() - buf.data();
+
+    header_spans.push_back({ { (uint32_t)start, (uint32_t)colon },
+                             { (uint32_t)value_offset, (uint32_t)value.size() } });
+    return Status::NeedMore;
+}
+
+HttpParser::Status HttpParser::finish_headers() {
+    std::string_view transfer_encoding = header("transfer-encoding");
+    std::string_view content_length = header("content-length");
+
+    if (!transfer_encoding.empty()) {
+        if (!content_length.empty()) return fail(400);
+        // chunked must be the final coding
+        std::string_view last = transfer_encoding;
+        size_t comma = last.rfind(',');
+        if (comma != std::string_view::npos) last = trim_ows(last.substr(comma + 1));
+        if (!iequals(last, "chunked")) return fail(501);
+        chunked = true;
+        state = State::ChunkSize;
+        return Status::NeedMore;
+    }
+
+    size_t length = 0;
+    if (!content_length.empty()) {
+        for (char c : content_length) {
+            if (c < '0' || c > '9') return fail(400);
+            length = length * 10 + (c - '0');
+            if (length > max_body_bytes) return fail(413);
+        }
+    }
+
+    body_span = { (uint32_t)pos, (uint32_t)length };
+    state = State::Body;
+    return Status::NeedMore;
+}
+
+HttpParser::Status HttpParser::parse_chunks() {
+    while (true) {
+        switch (state) {
+            case State::ChunkSize:
+            case State::Trailers: {
+                const char* nl = static_cast<const char*>(
+                    std::memchr(buf.data() + pos, '\n', buf.size() - pos));
+                if (!nl) {
+                    if (buf.size() - pos > max_header_bytes) return fail(431);
+                    return Status::NeedMore;
+                }
+                size_t line_end = nl - buf.data();
+                size_t end = line_end;
+                if (end > pos && buf[end - 1] == '\r') --end;
+                std::string_view line = buf.substr(pos, end - pos);
+                pos = line_end + 1;
+
+                if (state == State::Trailers) {
+                    if (line.empty()) {
+                        request_end = pos;
+                        state = State::Done;
+                        return Status::NeedMore;
+                    }
+                    continue; // trailers are ignored
+                }
+
+                size_t size = 0;
+                size_t digits = 0;
+                for (char c : line) {
+                    if (c == ';' || c == ' ' || c == '\t') break; // chunk extensions
+                    int v = hex_value(c);
+                    if (v < 0 || ++digits > 15) return fail(400);
+                    size = size * 16 + v;
+                }
+                if (digits == 0) return fail(400);
+
+                if (size == 0) {
+                    state = State::Trailers;
+                } else {
+                    if (chunked_body.size() + size > max_body_bytes) return fail(413);
+                    body_remaining = size;
+                    state = State::ChunkData;
+                }
+                break;
+            }
+
+            case State::ChunkData: {
+                size_t take = std::min(body_remaining, buf.size() - pos);
+                chunked_body.append(buf.data() + pos, take);
+                pos += take;
+                body_remaining -= take;
+                if (body_remaining > 0) return Status::NeedMore;
+                state = State::ChunkDataEnd;
+                break;
+            }
+
+            case State::ChunkDataEnd:
+                if (buf.size() - pos < 1) return Status::NeedMore;
+                if (buf[pos] == '\n') {
+                    pos += 1;
+                } else {
+                    if (buf.size() - pos < 2) return Status::NeedMore;
+                    if (buf[pos] != '\r' || buf[pos + 1] != '\n') return fail(400);
+                    pos += 2;
+                }
+                state = State::ChunkSize;
+                break;
+
+            default:
+                return Status::NeedMore;
+        }
+    }
+}
+
+std::string_view HttpParser::path() const {
+    std::string_view t = target();
+    size_t q = t.find('?');
+    return q == std::string_view::npos ? t : t.substr(0, q);
+}
+
+std::string_view HttpParser::query() const {
+    std::string_view t = target();
+    size_t q = t.find('?');
+    return q == std::string_view::npos ? std::string_view() : t.substr(q + 1);
+}
+
+std::string_view HttpParser::header(std::string_view name) const {
+    for (const auto& h : header_spans) {
+        if (iequals(view(h.name), name)) return view(h.value);
+    }
+    return std::string_view();
+}
+
+std::string_view HttpParser::query_param(std::string_view key) const {
+    std::string_view q = query();
+    while (!q.empty()) {
+        size_t amp = q.find('&');
+        std::string_view pair = q.substr(0, amp);
+        size_t eq = pair.find('=');
+        if (pair.substr(0, eq) == key) {
+            return eq == std::string_view::npos ? std::string_view() : pair.substr(eq + 1);
+        }
+        if (amp == std::string_view::npos) break;
+        q.remove_prefix(amp + 1);
+    }
+    return std::string_view();
+}
+
+std::string_view HttpParser::body() const {
+    if (chunked) return chunked_body;
+    return view(body_span);
+}
+
+bool HttpParser::keep_alive() const {
+    std::string_view connection = header("connection");
+    if (icontains(connection, "close")) return false;
+    if (version() == "HTTP/1.0") return icontains(connection, "keep-alive");
+    return true;
+}
+
+void HttpParser::to_request(HttpRequest& request) const {
+    request.method.assign(method());
+    request.target.assign(path());
+    request.query.assign(query());
+    request.version.assign(version());
+
+    for (const auto& h : header_spans) {
+        std::string key(view(h.name));
+        std::transform(key.begin(), key.end(), key.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        request.headers[key].assign(view(h.value));
+    }
+
+    parse_query(query(), request.query_params);
+
+    request.body.assign(body());
+
+    auto ua = request.headers.find("user-agent");
+    if (ua != request.headers.end()) request.user_agent = ua->second;
+}
+
+void parse_query(std::string_view query, std::map<std::string, std::string>& params) {
+    while (!query.empty()) {
+        size_t amp = query.find('&');
+        std::string_view pair = query.substr(0, amp);
+        size_t eq = pair.find('=');
+        if (eq != std::string_view::npos) {
+            params[url_decode_component(pair.substr(0, eq))] = url_decode_component(pair.substr(eq + 1));
+        }
+        if (amp == std::string_view::npos) break;
+        query.remove_prefix(amp + 1);
+    }
+}
+
+std::string url_decode_component(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '%' && i + 2 < s.size()) {
+            int hi = hex_value(s[i + 1]);
+            int lo = hex_value(s[i + 2]);
+            if (hi >= 0 && lo >= 0) {
+                out += static_cast<char>(hi * 16 + lo);
+                i += 2;
+                continue;
+            }
+        }
+        out += s[i] == '+' ? ' ' : s[i];
+    }
+    return out;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "rangoons.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Resumable HTTP/1.x request parser that works directly over the
+// connection's receive buffer. Positions are kept as offsets from the start
+// of the request, so the caller may grow (and reallocate) its buffer between
+// calls as long as the request still starts at the beginning of the view it
+// passes in. Accessors return views into the most recent buffer.
+class HttpParser {
+public:
+    enum class Status { NeedMore, Complete, Error };
+
+    explicit HttpParser(size_t max_header_bytes = 8192, size_t max_body_bytes = 64 * 1024 * 1024)
+        : max_header_bytes(max_header_bytes), max_body_bytes(max_body_bytes) {
+        header_spans.reserve(24);
+    }
+
+    // Continue parsing; buf must start at the first byte of the request
+    Status parse(std::string_view buf);
+
+    // Forget the current request so the next one can be parsed
+    void reset();
+
+    // Total bytes of the request (headers + framed body) once Complete
+    size_t consumed() const { return request_end; }
+
+    // Suggested status for Error (400, 413, 431 or 501)
+    int error_status() const { return error_code; }
+
+    std::string_view method() const { return view(method_span); }
+    std::string_view target() const { return view(target_span); }   // path + query
+    std::string_view path() const;
+    std::string_view query() const;
+    std::string_view version() const { return view(version_span); }
+
+    size_t header_count() const { return header_spans.size(); }
+    std::string_view header_name(size_t i) const { return view(header_spans[i].name); }
+    std::string_view header_value(size_t i) const { return view(header_spans[i].value); }
+
+    // Case-insensitive header lookup, empty view when absent
+    std::string_view header(std::string_view name) const;
+
+    // Raw (still percent-encoded) query parameter, empty view when absent
+    std::string_view query_param(std::string_view key) const;
+
+    // Body bytes: a view into buf for Content-Length, decoded copy for chunked
+    std::string_view body() const;
+
+    bool keep_alive() const;
+
+    // Headers are in and the body is still arriving
+    bool reading_body() const { return state != State::RequestLine && state != State::Headers && state != State::Done; }
+
+    // Copy into the map-based HttpRequest used by the route handlers
+    void to_request(HttpRequest& request) const;
+
+private:
+    struct Span {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+    struct HeaderSpan {
+        Span name;
+        Span value;
+    };
+
+    enum class State { RequestLine, Headers, Body, ChunkSize, ChunkData, ChunkDataEnd, Trailers, Done };
+
+    size_t max_header_bytes;
+    size_t max_body_bytes;
+
+    std::string_view buf;
+    State state = State::RequestLine;
+    size_t pos = 0;           // next unparsed byte
+    size_t request_end = 0;
+    int error_code = 0;
+
+    Span method_span, target_span, version_span;
+    std::vector<HeaderSpan> header_spans;
+
+    Span body_span;           // identity body
+    bool chunked = false;
+    size_t body_remaining = 0;
+    std::string chunked_body; // decoded chunked body
+
+    std::string_view view(Span s) const { return buf.substr(s.offset, s.length); }
+    Status fail(int status);
+    Status parse_request_line(size_t line_end);
+    Status parse_header_line(size_t line_end);
+    Status finish_headers();
+    Status parse_chunks();
+};
+
+// Decode %XX escapes and '+' in a query component
+std::string url_decode_component(std::string_view s);
+
+// Add the key=value pairs of a raw query string to params
+void parse_query(std::string_view query, std::map<std::string, std::string>& params);
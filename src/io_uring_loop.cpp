@@ -0,0 +1,595 @@
+#include "io_uring_loop.h"
+
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+static const unsigned RING_ENTRIES = 1024;
+static const unsigned RECV_BUFFERS = 512; // must be a power of two
+
+static int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int ring_fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+template <typename T>
+static uint64_t tag(T* ptr, uint64_t op) {
+    return reinterpret_cast<uint64_t>(ptr) | op;
+}
+
+IoUringLoop::IoUringLoop(const Config& config, RequestHandler handler)
+    : ConnectionLoop(config, std::move(handler)) {
+    if (wake_fd == -1 || !setup_ring(RING_ENTRIES) || !setup_buffers()) return;
+
+    // Ticks drive the deadline wheel
+    tick_ts.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(timers.resolution()).count();
+    arm_tick();
+    arm_wake();
+}
+
+IoUringLoop::~IoUringLoop() {
+    for (auto& conn : connections) {
+        if (conn) close(conn->fd);
+    }
+    if (ring_fd != -1) close(ring_fd);
+    if (sqes) munmap(sqes, sqes_size);
+    if (ring_ptr) munmap(ring_ptr, ring_size);
+    if (buf_ring) munmap(buf_ring, buf_ring_size);
+}
+
+bool IoUringLoop::setup_ring(unsigned entries) {
+    // Only the loop thread touches the ring, so completion work can wait
+    // until run() asks for events (6.1+). The ring is built here but run()
+    // may be on another thread, which becomes the single issuer once it
+    // enables the ring. Older kernels fall back to COOP_TASKRUN (5.19),
+    // then to a plain ring.
+    static const unsigned flag_sets[] = {
+        IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED,
+        IORING_SETUP_COOP_TASKRUN,
+        0,
+    };
+
+    io_uring_params params{};
+    int fd = -1;
+    for (unsigned extra : flag_sets) {
+        params = io_uring_params{};
+        params.flags = IORING_SETUP_CQSIZE | extra;
+        params.cq_entries = entries * 4; // multishot ops post many CQEs per SQE
+        fd = io_uring_setup(entries, &params);
+        if (fd != -1 || errno != EINVAL) break;
+    }
+    if (fd == -1) return false;
+    ring_disabled = params.flags & IORING_SETUP_R_DISABLED;
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+        close(fd);
+        return false;
+    }
+
+    ring_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                         params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    ring_ptr = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_SQ_RING);
+    if (ring_ptr == MAP_FAILED) {
+        ring_ptr = nullptr;
+        close(fd);
+        return false;
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqe_ptr = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         fd, IORING_OFF_SQES);
+    if (sqe_ptr == MAP_FAILED) {
+        munmap(ring_ptr, ring_size);
+        ring_ptr = nullptr;
+        close(fd);
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqe_ptr);
+
+    char* base = static_cast<char*>(ring_ptr);
+    sq_head = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    sq_array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    sq_mask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+    cq_head = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+
+    // SQE slots are always used in ring order, so the index array is fixed
+    for (unsigned i = 0; i < sq_entries; ++i) sq_array[i] = i;
+    sqe_tail = *sq_tail;
+
+    ring_fd = fd;
+    return true;
+}
+
+bool IoUringLoop::setup_buffers() {
+    buf_count = RECV_BUFFERS;
+    buf_size = config.request_buffer_size > 0 ? (unsigned)config.request_buffer_size : 8192;
+
+    buf_ring_size = buf_count * sizeof(io_uring_buf);
+    void* ptr = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) return false;
+    // Fault the pages in first, or the kernel may pin the shared zero page
+    std::memset(ptr, 0, buf_ring_size);
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ptr);
+    reg.ring_entries = buf_count;
+    reg.bgid = 0;
+    if (io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        munmap(ptr, buf_ring_size);
+        return false;
+    }
+
+    buf_ring = static_cast<io_uring_buf_ring*>(ptr);
+    buf_pool.resize((size_t)buf_count * buf_size);
+    for (unsigned i = 0; i < buf_count; ++i) recycle_buffer((unsigned short)i);
+    return true;
+}
+
+io_uring_sqe* IoUringLoop::get_sqe() {
+    // Submit queued entries when the ring is full; the kernel consumes them
+    // synchronously, so there is room again on return
+    while (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+        submit(0);
+    }
+
+    io_uring_sqe* sqe = &sqes[sqe_tail & sq_mask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe_tail++;
+    to_submit++;
+    return sqe;
+}
+
+int IoUringLoop::submit(unsigned wait_nr) {
+    __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int ret = io_uring_enter(ring_fd, to_submit, wait_nr, flags);
+    if (ret > 0) to_submit -= std::min((unsigned)ret, to_submit);
+    return ret;
+}
+
+void IoUringLoop::recycle_buffer(unsigned short bid) {
+    // Index the ring by hand: in C++ the header's flexible bufs[] member is
+    // wrapped in an empty struct and lands at offset 8 instead of 0
+    io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(buf_ring) + (buf_tail & (buf_count - 1));
+    buf->addr = reinterpret_cast<uint64_t>(buf_pool.data() + (size_t)bid * buf_size);
+    buf->len = buf_size;
+    buf->bid = bid;
+    buf_tail++;
+    __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+}
+
+bool IoUringLoop::add_listener(int listen_fd) {
+    if (!ready()) return false;
+    arm_accept(listen_fd);
+    return true;
+}
+
+void IoUringLoop::run() {
+    running = true;
+
+    if (ring_disabled) {
+        if (io_uring_register(ring_fd, IORING_REGISTER_ENABLE_RINGS, nullptr, 0) != 0) {
+            std::cerr << "❌ Failed to enable io_uring: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        ring_disabled = false;
+    }
+
+    while (running) {
+        // One enter submits everything queued since the last pass and reaps
+        // completions; skip it while completions are still waiting and
+        // nothing is queued
+        bool idle = *cq_head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        int ret = idle || to_submit > 0 ? submit(idle ? 1 : 0) : 0;
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            std::cerr << "❌ io_uring_enter failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        unsigned head = *cq_head;
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            io_uring_cqe cqe = cqes[head & cq_mask];
+            __atomic_store_n(cq_head, ++head, __ATOMIC_RELEASE);
+            handle_cqe(cqe);
+        }
+    }
+}
+
+void IoUringLoop::stop() {
+    running = false;
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0) {
+        // The next timer tick notices running == false as well
+    }
+}
+
+// ---- Submissions ----
+
+void IoUringLoop::arm_accept(int listen_fd) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = ((uint64_t)listen_fd << 3) | OpAccept;
+}
+
+void IoUringLoop::arm_recv(UringConnection& conn) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn.fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = tag(&conn, OpRecv);
+    conn.recv_armed = true;
+    conn.pending_ops++;
+}
+
+void IoUringLoop::arm_tick() {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = reinterpret_cast<uint64_t>(&tick_ts);
+    sqe->len = 1;
+    sqe->user_data = OpTick;
+}
+
+void IoUringLoop::arm_wake() {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wake_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = OpWake;
+}
+
+void IoUringLoop::arm_pollout(UringConnection& conn) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = conn.fd;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = tag(&conn, OpPollOut);
+    conn.pollout_armed = true;
+    conn.send_inflight = true;
+    conn.pending_ops++;
+}
+
+// The kernel reads conn.sending until the CQE arrives, so new responses
+// keep accumulating in out_buf meanwhile. last links the send to the close
+// that follows it and asks the kernel to retry short sends itself, so
+// everything must fit one iovec set.
+void IoUringLoop::submit_sendmsg(UringConnection& conn, bool last) {
+    if (conn.sending.empty()) conn.sending.swap(conn.out_buf);
+    if (last && conn.sending.segment_count() > (size_t)MAX_SEND_IOV) conn.sending.flatten();
+
+    conn.send_msg = msghdr{};
+    conn.send_msg.msg_iov = conn.send_iov;
+    conn.send_msg.msg_iovlen = conn.sending.fill_iovec(conn.send_iov, MAX_SEND_IOV);
+
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&conn.send_msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | (last ? MSG_WAITALL : 0) | (conn.sending.has_files() ? MSG_MORE : 0);
+    sqe->flags = last ? IOSQE_IO_LINK : 0;
+    sqe->user_data = tag(&conn, OpSend);
+    conn.send_inflight = true;
+    conn.pending_ops++;
+}
+
+// Push conn.sending forward: memory segments as one SENDMSG, file segments
+// with sendfile() from the loop thread (io_uring has no sendfile op),
+// polling for POLLOUT when the socket is full. Returns false once sending
+// has drained with nothing left in flight.
+bool IoUringLoop::send_pending(UringConnection& conn) {
+    if (conn.sending.empty()) conn.sending.swap(conn.out_buf);
+
+    while (!conn.sending.empty()) {
+        int file_fd;
+        off_t offset;
+        size_t count;
+        if (!conn.sending.front_file(file_fd, offset, count)) {
+            submit_sendmsg(conn, false);
+            return true;
+        }
+
+        ssize_t n = sendfile(conn.fd, file_fd, &offset, count);
+        if (n > 0) {
+            conn.sending.consume(n);
+            continue;
+        }
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            arm_pollout(conn);
+            return true;
+        }
+        close_connection(conn, false); // error, or the file shrank underneath us
+        return true;
+    }
+    return false;
+}
+
+// ---- Completions ----
+
+void IoUringLoop::handle_cqe(const io_uring_cqe& cqe) {
+    uint64_t op = cqe.user_data & OP_MASK;
+
+    switch (op) {
+        case OpAccept:
+            on_accept((int)(cqe.user_data >> 3), cqe);
+            return;
+
+        case OpTick:
+            expire_timers();
+            if (running) arm_tick();
+            return;
+
+        case OpWake:
+            while (read(wake_fd, &wake_value, sizeof(wake_value)) > 0) {}
+            if (running) arm_wake();
+            on_completions();
+            return;
+    }
+
+    UringConnection* conn = reinterpret_cast<UringConnection*>(cqe.user_data & ~OP_MASK);
+    if (op != OpRecv || !(cqe.flags & IORING_CQE_F_MORE)) conn->pending_ops--;
+
+    switch (op) {
+        case OpRecv:
+            on_recv(*conn, cqe);
+            break;
+        case OpSend:
+            on_send(*conn, cqe.res);
+            break;
+        case OpPollOut:
+            on_pollout(*conn, cqe.res);
+            break;
+        case OpClose:
+            // The linked send failed, so the close never ran
+            if (cqe.res == -ECANCELED) close(conn->fd);
+            break;
+        case OpCancel:
+            break;
+    }
+
+    if (conn->closing && conn->pending_ops == 0) {
+        timers.cancel(conn->timer);
+        graveyard.erase(conn);
+    }
+}
+
+void IoUringLoop::on_accept(int listen_fd, const io_uring_cqe& cqe) {
+    if (!(cqe.flags & IORING_CQE_F_MORE) && running) arm_accept(listen_fd);
+
+    if (cqe.res < 0) {
+        if (cqe.res != -ECANCELED && cqe.res != -ECONNABORTED && cqe.res != -EINTR) {
+            std::cerr << "❌ Failed to accept connection: " << std::strerror(-cqe.res) << std::endl;
+        }
+        return;
+    }
+
+    int fd = cqe.res;
+    if (open_connections >= (size_t)config.max_concurrent_connections) {
+        refuse_connection(fd);
+        return;
+    }
+
+    auto conn = std::make_unique<UringConnection>();
+    conn->fd = fd;
+    conn->id = ++next_conn_id;
+    conn->parser = HttpParser(config.request_buffer_size > 0 ? config.request_buffer_size : 8192);
+
+    // Multishot accept reports no peer address; client_ip_of() looks it up
+    // when the first request arrives
+
+    if ((size_t)fd >= connections.size()) {
+        connections.resize(fd + 1);
+    }
+    conn->timer.owner = conn.get();
+    update_deadline(*conn, false);
+    arm_recv(*conn);
+    connections[fd] = std::move(conn);
+    open_connections++;
+}
+
+void IoUringLoop::on_recv(UringConnection& conn, const io_uring_cqe& cqe) {
+    bool armed = cqe.flags & IORING_CQE_F_MORE;
+    if (!armed) conn.recv_armed = false;
+
+    if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+        unsigned short bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        if (!conn.closing) {
+            conn.in_buf.append(buf_pool.data() + (size_t)bid * buf_size, cqe.res);
+            conn.progressed = true;
+        }
+        recycle_buffer(bid);
+    }
+    if (conn.closing) return;
+
+    // -ECANCELED: stopped by update_recv()
+    if (cqe.res == 0) {
+        conn.peer_closed = true;
+    } else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+        close_connection(conn, false);
+        return;
+    }
+
+    // serve() re-arms the recv when it stopped: multishot recv stops when
+    // the buffer ring runs dry, and the buffers were just returned
+    serve(conn);
+}
+
+void IoUringLoop::update_recv(UringConnection& conn) {
+    if (conn.closing || conn.peer_closed) return;
+    if (input_full(conn, conn.send_inflight || !conn.out_buf.empty())) {
+        // Completions already on their way are still appended, once
+        if (!conn.input_paused && conn.recv_armed) {
+            io_uring_sqe* sqe = get_sqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = tag(&conn, OpRecv);
+            sqe->user_data = tag(&conn, OpCancel);
+            conn.pending_ops++;
+        }
+        conn.input_paused = true;
+        return;
+    }
+    conn.input_paused = false;
+    if (!conn.recv_armed) arm_recv(conn);
+}
+
+void IoUringLoop::on_send(UringConnection& conn, int res) {
+    if (conn.closing) return;
+    conn.send_inflight = false;
+
+    if (res < 0) {
+        close_connection(conn, false);
+        return;
+    }
+
+    // Short write: continue from where the kernel stopped
+    conn.sending.consume(res);
+    conn.progressed = true;
+    if (!conn.sending.empty() && send_pending(conn)) {
+        if (!conn.closing) update_deadline(conn, true);
+        return;
+    }
+    serve(conn);
+}
+
+void IoUringLoop::on_pollout(UringConnection& conn, int res) {
+    conn.pollout_armed = false;
+    if (conn.closing) return;
+    conn.send_inflight = false;
+
+    if (res < 0 || (res & (POLLERR | POLLHUP))) {
+        close_connection(conn, false);
+        return;
+    }
+
+    if (send_pending(conn)) {
+        if (!conn.closing) update_deadline(conn, true);
+        return;
+    }
+    serve(conn);
+}
+
+void IoUringLoop::on_completions() {
+    for (Completion& completion : take_completions()) {
+        int fd = completion.fd;
+        if ((size_t)fd >= connections.size() || !connections[fd] ||
+            connections[fd]->id != completion.conn_id) {
+            continue; // closed while the handler ran
+        }
+        UringConnection& conn = *connections[fd];
+        apply_completion(conn, completion);
+        serve(conn);
+    }
+}
+
+// Answer buffered requests in order. Only one send is in flight per
+// connection; its completion calls back in here to continue.
+void IoUringLoop::serve(UringConnection& conn) {
+    while (!conn.closing && !conn.send_inflight) {
+        bool more = process_requests(conn);
+
+        // The linked send+close only covers memory, so file bodies drain
+        // through the normal path first
+        bool done = conn.close_after_write || (conn.peer_closed && !more && !conn.awaiting_response);
+        if (done && !conn.out_buf.has_files()) {
+            close_connection(conn, true);
+            return;
+        }
+
+        if (conn.out_buf.empty()) {
+            conn.state = ConnState::ReadingRequest;
+            break;
+        }
+        conn.state = ConnState::WritingResponse;
+        send_pending(conn);
+    }
+    update_recv(conn);
+    if (!conn.closing) update_deadline(conn, conn.send_inflight);
+}
+
+void IoUringLoop::expire_timers() {
+    timers.advance(std::chrono::steady_clock::now(), [this](TimerWheel::Timer& timer) {
+        UringConnection& conn = *static_cast<UringConnection*>(static_cast<Connection*>(timer.owner));
+        timed_out_connections.fetch_add(1, std::memory_order_relaxed);
+        if (!conn.closing) {
+            close_connection(conn, false);
+            return;
+        }
+        // The final send linked to the close never drained: cancelling it
+        // fails the link, and the close is then done by hand
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = tag(&conn, OpSend);
+        sqe->user_data = tag(&conn, OpCancel);
+        conn.pending_ops++;
+    });
+}
+
+// Cancel the recv, optionally send what is left of out_buf, then close the
+// fd. The connection moves to the graveyard until every CQE is in.
+void IoUringLoop::close_connection(UringConnection& conn, bool flush_output) {
+    conn.state = ConnState::Closing;
+    conn.closing = true;
+    timers.cancel(conn.timer);
+    UringConnection* ptr = &conn;
+    graveyard[ptr] = std::move(connections[conn.fd]);
+    open_connections--;
+
+    // A linked send+close pair must not be split across two submissions
+    while (sq_entries - (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)) < 5) {
+        submit(0);
+    }
+
+    // Closing the fd does not complete operations that hold the file, so
+    // the recv and any send or POLLOUT wait are cancelled explicitly
+    bool sendmsg_inflight = conn.send_inflight && !conn.pollout_armed;
+    for (uint64_t op : { OpRecv, OpPollOut, OpSend }) {
+        bool armed = op == OpRecv ? conn.recv_armed : op == OpPollOut ? conn.pollout_armed : sendmsg_inflight;
+        if (!armed) continue;
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = tag(ptr, op);
+        sqe->user_data = tag(ptr, OpCancel);
+        conn.pending_ops++;
+    }
+
+    if (flush_output && !conn.send_inflight && !conn.out_buf.empty()) {
+        submit_sendmsg(conn, true);
+        // A client that never reads would hold the send, and this
+        // connection, forever
+        if (config.send_timeout > 0) {
+            timers.arm(conn.timer, std::chrono::steady_clock::now() + std::chrono::seconds(config.send_timeout));
+        }
+    }
+
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = conn.fd;
+    sqe->user_data = tag(ptr, OpClose);
+    conn.pending_ops++;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "event_loop.h"
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Completion-based backend built directly on the io_uring syscalls. One
+// multishot accept per listener and one multishot recv per connection stay
+// armed for the lifetime of the socket; received data lands in a ring of
+// kernel-provided buffers, so idle connections pin no receive memory.
+// The final response of a connection is sent with a send linked to its
+// close, tearing the socket down without another trip through the loop.
+class IoUringLoop : public ConnectionLoop {
+public:
+    IoUringLoop(const Config& config, RequestHandler handler);
+    ~IoUringLoop() override;
+
+    // False when the kernel lacks io_uring or provided buffer rings
+    bool ready() const { return ring_fd != -1 && buf_ring != nullptr; }
+
+    bool add_listener(int listen_fd) override;
+    void run() override;
+    void stop() override;
+    size_t connection_count() const override { return open_connections.load(std::memory_order_relaxed); }
+
+private:
+    // Operation tag kept in the low bits of user_data
+    enum Op : uint64_t { OpAccept, OpRecv, OpSend, OpClose, OpCancel, OpTick, OpWake, OpPollOut };
+    static const uint64_t OP_MASK = 7;
+    static const int MAX_SEND_IOV = 64;
+
+    struct UringConnection : Connection {
+        OutputQueue sending;    // owned by the kernel until the send completes
+        struct iovec send_iov[MAX_SEND_IOV];
+        struct msghdr send_msg{};
+        int pending_ops = 0;    // submitted SQEs whose final CQE has not arrived
+        bool recv_armed = false;
+        bool pollout_armed = false;
+        bool send_inflight = false; // SENDMSG or POLLOUT outstanding
+        bool closing = false;
+    };
+
+    std::atomic<size_t> open_connections{0};
+    std::atomic<bool> running{false};
+
+    // Ring state
+    int ring_fd = -1;
+    bool ring_disabled = false; // created on one thread, enabled by run()
+    void* ring_ptr = nullptr;   // SQ and CQ rings share one mapping
+    size_t ring_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned sqe_tail = 0;      // local tail, published on submit
+    unsigned to_submit = 0;
+
+    // Provided receive buffers (buffer group 0)
+    io_uring_buf_ring* buf_ring = nullptr;
+    size_t buf_ring_size = 0;
+    std::vector<char> buf_pool;
+    unsigned buf_count = 0;
+    unsigned buf_size = 0;
+    unsigned short buf_tail = 0;
+
+    __kernel_timespec tick_ts{};
+    uint64_t wake_value = 0;
+
+    std::vector<std::unique_ptr<UringConnection>> connections; // indexed by fd
+    // Closed connections wait here until the kernel is done with them, so a
+    // late CQE never touches freed memory or a reused fd slot
+    std::unordered_map<UringConnection*, std::unique_ptr<UringConnection>> graveyard;
+
+    bool setup_ring(unsigned entries);
+    bool setup_buffers();
+    io_uring_sqe* get_sqe();
+    int submit(unsigned wait_nr);
+    void recycle_buffer(unsigned short bid);
+
+    void arm_accept(int listen_fd);
+    void arm_recv(UringConnection& conn);
+    // Stop the recv while input_full(), re-arm it once it is not
+    void update_recv(UringConnection& conn);
+    void arm_tick();
+    void arm_wake();
+    void arm_pollout(UringConnection& conn);
+    void submit_sendmsg(UringConnection& conn, bool last);
+    bool send_pending(UringConnection& conn);
+
+    void handle_cqe(const io_uring_cqe& cqe);
+    void on_accept(int listen_fd, const io_uring_cqe& cqe);
+    void on_recv(UringConnection& conn, const io_uring_cqe& cqe);
+    void on_send(UringConnection& conn, int res);
+    void on_pollout(UringConnection& conn, int res);
+    void on_completions();
+
+    void serve(UringConnection& conn);
+    void expire_timers();
+    void close_connection(UringConnection& conn, bool flush_output);
+};
@@ -12,6 +12,24 @@ static int getenv_int(const char* k, int def=0) {
     return v ? std::stoi(v) : def;
 }
 
+// Comma-separated list; unset keeps def
+static std::vector<std::string> getenv_list(const char* k, const std::vector<std::string>& def) {
+    const char* v = std::getenv(k);
+    if (!v) return def;
+    std::vector<std::string> items;
+    std::string item;
+    for (const char* p = v;; ++p) {
+        if (*p == ',' || *p == '\0') {
+            if (!item.empty()) items.push_back(item);
+            item.clear();
+            if (*p == '\0') break;
+        } else if (*p != ' ') {
+            item += *p;
+        }
+    }
+    return items;
+}
+
 static bool getenv_bool(const char* k, bool def=false) {
     const char* v = std::getenv(k);
     if (!v) return def;
@@ -38,17 +56,42 @@ int main() {
     // Edge computing configuration
     cfg.enable_edge_computing = getenv_bool("ENABLE_EDGE_COMPUTING", true);
     cfg.edge_cache_size_mb = getenv_int("EDGE_CACHE_SIZE_MB", 512);
+    cfg.edge_cache_ttl_seconds = getenv_int("EDGE_CACHE_TTL_SECONDS", 60);
+    cfg.edge_cache_policy = getenv_str("EDGE_CACHE_POLICY", "tinylfu");
+    cfg.cache_snapshot_path = getenv_str("CACHE_SNAPSHOT_PATH", "rangoons-cache.snap");
+    cfg.cache_snapshot_interval_seconds = getenv_int("CACHE_SNAPSHOT_INTERVAL", 60);
+    cfg.enable_catalog_listener = getenv_bool("CATALOG_LISTENER", true);
     cfg.max_concurrent_connections = getenv_int("MAX_CONCURRENT_CONNECTIONS", 10000);
     cfg.enable_compression = getenv_bool("ENABLE_COMPRESSION", true);
+    cfg.compression_min_bytes = getenv_int("COMPRESSION_MIN_BYTES", 1024);
+    cfg.gzip_level = getenv_int("GZIP_LEVEL", 5);
+    cfg.brotli_quality = getenv_int("BROTLI_QUALITY", 4);
     cfg.enable_http2 = getenv_bool("ENABLE_HTTP2", false);
+    cfg.edge_mode = getenv_str("EDGE_MODE", "proxy");
+    cfg.upstream_connect_timeout_ms = getenv_int("UPSTREAM_CONNECT_TIMEOUT_MS", 500);
+    cfg.upstream_timeout_ms = getenv_int("UPSTREAM_TIMEOUT_MS", 5000);
+    cfg.upstream_max_idle = getenv_int("UPSTREAM_MAX_IDLE", 16);
     
     // Performance tuning
     cfg.worker_threads = getenv_int("WORKER_THREADS", 4);
+    cfg.handler_threads = getenv_int("HANDLER_THREADS", 0);
+    cfg.admission_target_ms = getenv_int("ADMISSION_TARGET_MS", 50);
+    cfg.admission_interval_ms = getenv_int("ADMISSION_INTERVAL_MS", 500);
+    cfg.max_queued_requests = getenv_int("MAX_QUEUED_REQUESTS", 10000);
+    cfg.retry_after_seconds = getenv_int("RETRY_AFTER_SECONDS", 1);
+    cfg.priority_paths = getenv_list("PRIORITY_PATHS", cfg.priority_paths);
     cfg.connection_pool_size = getenv_int("CONNECTION_POOL_SIZE", 100);
+    cfg.db_pool_timeout_ms = getenv_int("DB_POOL_TIMEOUT_MS", 2000);
     cfg.request_buffer_size = getenv_int("REQUEST_BUFFER_SIZE", 8192);
     cfg.response_buffer_size = getenv_int("RESPONSE_BUFFER_SIZE", 16384);
     cfg.enable_keep_alive = getenv_bool("ENABLE_KEEP_ALIVE", true);
     cfg.keep_alive_timeout = getenv_int("KEEP_ALIVE_TIMEOUT", 30);
+    cfg.header_timeout = getenv_int("HEADER_TIMEOUT", 10);
+    cfg.body_timeout = getenv_int("BODY_TIMEOUT", 30);
+    cfg.send_timeout = getenv_int("SEND_TIMEOUT", 30);
+    cfg.keep_alive_max_requests = getenv_int("KEEP_ALIVE_MAX_REQUESTS", 1000);
+    cfg.io_backend = getenv_str("IO_BACKEND", "epoll");
+    cfg.static_root = getenv_str("STATIC_ROOT", "integrations");
 
     // Configure edge nodes for load balancing
     cfg.load_balancer.strategy = getenv_str("LOAD_BALANCER_STRATEGY", "least_connections");
@@ -109,8 +152,19 @@ int main() {
         std::cout << "   • Primary: " << primary_node.ip << ":" << primary_node.port << " (C++ High-Perf)" << std::endl;
         std::cout << "   • Vivo: " << vivo_node.ip << ":" << vivo_node.port << " (Mobile Edge)" << std::endl;
         std::cout << "   • Samsung: " << samsung_node.ip << ":" << samsung_node.port << " (Mobile Edge)" << std::endl;
-        std::cout << "⚡ Load Balancer: " << cfg.load_balancer.strategy << std::endl;
-        std::cout << "💾 Cache Size: " << cfg.edge_cache_size_mb << " MB" << std::endl;
+        std::cout << "⚡ Load Balancer: " << cfg.load_balancer.strategy << ", " << cfg.edge_mode;
+        if (cfg.edge_mode == "proxy") {
+            std::cout << " (connect " << cfg.upstream_connect_timeout_ms << "ms, timeout "
+                      << cfg.upstream_timeout_ms << "ms, " << cfg.upstream_max_idle << " idle per node)";
+        }
+        std::cout << std::endl;
+        std::cout << "💾 Cache Size: " << cfg.edge_cache_size_mb << " MB, TTL " << cfg.edge_cache_ttl_seconds << "s, "
+                  << cfg.edge_cache_policy << std::endl;
+        if (!cfg.cache_snapshot_path.empty()) {
+            std::cout << "💾 Cache Snapshot: " << cfg.cache_snapshot_path << " every "
+                      << cfg.cache_snapshot_interval_seconds << "s" << std::endl;
+        }
+        std::cout << "🔔 Catalog Listener: " << (cfg.enable_catalog_listener ? "ENABLED" : "DISABLED") << std::endl;
         std::cout << "🧵 Worker Threads: " << cfg.worker_threads << std::endl;
         std::cout << "🔗 Max Connections: " << cfg.max_concurrent_connections << std::endl;
     } else {
@@ -122,9 +176,19 @@ int main() {
     }
 
     std::cout << "\n🎯 Performance Features:" << std::endl;
-    std::cout << "   • Compression: " << (cfg.enable_compression ? "ON" : "OFF") << std::endl;
+    std::cout << "   • Compression: " << (cfg.enable_compression ? "ON" : "OFF");
+    if (cfg.enable_compression) {
+        std::cout << " (br q" << cfg.brotli_quality << ", gzip " << cfg.gzip_level
+                  << ", >= " << cfg.compression_min_bytes << " bytes)";
+    }
+    std::cout << std::endl;
     std::cout << "   • Keep-Alive: " << (cfg.enable_keep_alive ? "ON" : "OFF") << std::endl;
-    std::cout << "   • HTTP/2: " << (cfg.enable_http2 ? "ON" : "OFF") << std::endl;
+    std::cout << "   • Timeouts: header " << cfg.header_timeout << "s, body " << cfg.body_timeout
+              << "s, idle " << cfg.keep_alive_timeout << "s, send " << cfg.send_timeout << "s" << std::endl;
+    std::cout << "   • HTTP/2: " << (cfg.enable_http2 ? "ON (h2c)" : "OFF") << std::endl;
+    std::cout << "   • Load Shedding: >" << cfg.admission_target_ms << "ms queue delay, "
+              << cfg.max_queued_requests << " queued max (" << cfg.priority_paths.size() << " priority routes)" << std::endl;
+    std::cout << "   • I/O Backend: " << cfg.io_backend << std::endl;
     std::cout << "   • Buffer Size: " << cfg.request_buffer_size << "/" << cfg.response_buffer_size << " bytes" << std::endl;
 
     return run_server(cfg);
@@ -1,6 +1,21 @@
 #include "rangoons.h"
+#include "http.h"
+#include "event_loop.h"
+#include "work_pool.h"
+#include "static_files.h"
+#include "compression.h"
+#include "admission.h"
+#include "router.h"
+#include "upstream.h"
+#include "render_cache.h"
+#include "catalog_events.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <climits>
+#include <iostream>
 #include <thread>
-#include <queue>
 #include <atomic>
 #include <chrono>
 #include <algorithm>
@@ -11,14 +26,30 @@
 class OptimizedServer {
 private:
     std::atomic<bool> running{true};
+    
+    // One SO_REUSEPORT listener + event loop per worker thread. The kernel
+    // spreads new connections across the listeners, so there is no shared
+    // accept queue or lock between workers.
+    std::vector<std::unique_ptr<ConnectionLoop>> loops;
+    std::vector<int> listen_sockets;
     std::vector<std::thread> worker_threads;
-    std::queue<int> connection_queue;
-    std::mutex queue_mutex;
-    std::condition_variable queue_cv;
+    
+    // Handlers run here rather than on the loop threads, so a slow DB
+    // query never stalls the sockets of the loop that accepted it
+    std::unique_ptr<WorkStealingPool> handler_pool;
+    
+    // Sheds requests with a fast 503 once the pool falls behind, rather
+    // than letting every request time out during a flash sale
+    AdmissionControl admission;
+    
+    // Rendered responses of cacheable routes, bounded by edge_cache_size_mb
+    // and dropped whenever the catalog version moves
+    EdgeCache edge_cache;
+    RenderCache render_cache;
+    std::unique_ptr<CatalogListener> catalog_listener;
     
     // Performance counters
     std::atomic<uint64_t> total_requests{0};
-    std::atomic<uint64_t> active_connections{0};
     std::atomic<uint64_t> cache_hits{0};
     std::atomic<uint64_t> cache_misses{0};
     
@@ -26,24 +57,55 @@ private:
     std::vector<EdgeNode> edge_nodes;
     std::thread health_monitor_thread;
     
+    // Keep-alive connections to each edge node for the reverse proxy,
+    // indexed like edge_nodes; null for the primary (this server)
+    std::vector<std::unique_ptr<UpstreamPool>> upstreams;
+    
     // Connection pool
     std::vector<int> connection_pool;
     std::mutex pool_mutex;
     
+    Config server_config;
+    StaticFiles static_files;
+    Router router;
+    
 public:
-    OptimizedServer(const Config& config) {
+    OptimizedServer(const Config& config)
+        : admission(config),
+          edge_cache(config.edge_cache_size_mb, 16,
+                     config.edge_cache_policy == "lru" ? EdgeCachePolicy::Lru : EdgeCachePolicy::TinyLfu),
+          render_cache(edge_cache, [](const std::string& key) {
+              return g_db ? page_version(g_db->catalog_versions(), key) : 0;
+          }, config),
+          server_config(config),
+          static_files(config.static_root) {
         initialize_edge_nodes(config);
+        build_routes();
         start_health_monitor();
     }
     
     ~OptimizedServer() {
         running = false;
-        queue_cv.notify_all();
+        for (auto& loop : loops) {
+            loop->stop();
+        }
         
         for (auto& thread : worker_threads) {
             if (thread.joinable()) thread.join();
         }
         
+        // Loops must outlive the tasks that post responses back to them
+        if (handler_pool) handler_pool->shutdown();
+        
+        // Background page refreshes use the routes and upstreams below; the
+        // final snapshot is taken here, while the DB is still open
+        render_cache.shutdown();
+        if (catalog_listener) catalog_listener->stop();
+        
+        for (int fd : listen_sockets) {
+            close(fd);
+        }
+        
         if (health_monitor_thread.joinable()) {
             health_monitor_thread.join();
         }
@@ -55,7 +117,7 @@ public:
         std::string db_conn_str = config.db_host + ":" + std::to_string(config.db_port) + ":" + 
                                   config.db_name + ":" + config.db_user + ":" + config.db_password;
         
-        if (!g_db->open(db_conn_str)) {
+        if (!g_db->open(db_conn_str, config.connection_pool_size, config.db_pool_timeout_ms)) {
             std::cerr << "❌ Failed to connect to database" << std::endl;
             return 1;
         }
@@ -65,6 +127,20 @@ public:
             return 1;
         }
         
+        if (config.enable_catalog_listener) {
+            std::string err;
+            catalog_listener = std::make_unique<CatalogListener>(db_conn_str, g_db->catalog_versions());
+            if (!catalog_listener->start(&err)) {
+                std::cerr << "⚠️ Catalog listener not connected, retrying: " << err << std::endl;
+            }
+        }
+        
+        if (config.edge_cache_size_mb > 0 && !config.cache_snapshot_path.empty()) {
+            render_cache.enable_snapshots(config.cache_snapshot_path,
+                                          std::chrono::seconds(config.cache_snapshot_interval_seconds),
+                                          [] { return g_db ? g_db->catalog_stamp() : std::string(); });
+        }
+        
         // Initialize networking
         #ifdef _WIN32
         WSADATA wsaData;
@@ -74,21 +150,43 @@ public:
         }
         #endif
         
-        // Create optimized socket
-        int server_socket = create_optimized_socket(config);
-        if (server_socket == -1) return 1;
+        int num_loops = config.worker_threads > 0 ? config.worker_threads : Utils::get_cpu_core_count();
+        raise_fd_limit(config.max_concurrent_connections);
+        
+        int num_handlers = config.handler_threads > 0 ? config.handler_threads : Utils::get_cpu_core_count();
+        handler_pool = std::make_unique<WorkStealingPool>(num_handlers);
+        
+        // Split the connection budget evenly between the loops
+        Config loop_config = config;
+        loop_config.max_concurrent_connections = std::max(1, config.max_concurrent_connections / num_loops);
+        
+        for (int i = 0; i < num_loops; ++i) {
+            int server_socket = create_optimized_socket(config);
+            if (server_socket == -1) return 1;
+            listen_sockets.push_back(server_socket);
+            
+            auto loop = make_connection_loop(loop_config, [this](const HttpRequest& request) {
+                return handle_on_loop(request);
+            });
+            if (!loop->add_listener(server_socket)) return 1;
+            loop->set_executor(handler_pool.get(), i, &admission);
+            loops.push_back(std::move(loop));
+        }
         
-        // Start worker threads
-        start_worker_threads(config.worker_threads);
+        start_worker_threads(num_loops);
         
         std::cout << "🚀 Optimized Server Running!" << std::endl;
         std::cout << "🌐 Server: " << config.host << ":" << config.port << std::endl;
-        std::cout << "🧵 Worker Threads: " << config.worker_threads << std::endl;
+        std::cout << "🧵 Event Loops: " << num_loops << " (SO_REUSEPORT, " << config.io_backend << ")" << std::endl;
+        std::cout << "⚙️  Handler Threads: " << num_handlers << " (work-stealing)" << std::endl;
+        std::cout << "🚦 Admission: " << config.admission_target_ms << "ms target, "
+                  << config.max_queued_requests << " queued max" << std::endl;
         std::cout << "🔗 Max Connections: " << config.max_concurrent_connections << std::endl;
-        std::cout << "📱 Edge Nodes: " << edge_nodes.size() << std::endl;
+        std::cout << "📱 Edge Nodes: " << edge_nodes.size() << " (" << config.edge_mode << ")" << std::endl;
         
-        // Main accept loop
-        accept_connections(server_socket, config);
+        for (auto& thread : worker_threads) {
+            thread.join();
+        }
         
         return 0;
     }
@@ -137,99 +235,30 @@ private:
     }
     
     void start_worker_threads(int num_threads) {
+        int cores = Utils::get_cpu_core_count();
         for (int i = 0; i < num_threads; ++i) {
             worker_threads.emplace_back([this, i]() {
-                worker_thread_function(i);
+                loops[i]->run();
             });
+            Utils::set_thread_affinity(worker_threads.back(), i % cores);
         }
     }
     
-    void worker_thread_function(int thread_id) {
-        while (running) {
-            int client_socket = -1;
-            
-            {
-                std::unique_lock<std::mutex> lock(queue_mutex);
-                queue_cv.wait(lock, [this]() { 
-                    return !connection_queue.empty() || !running; 
-                });
-                
-                if (!running) break;
-                
-                if (!connection_queue.empty()) {
-                    client_socket = connection_queue.front();
-                    connection_queue.pop();
-                }
-            }
-            
-            if (client_socket != -1) {
-                handle_client_connection(client_socket);
-            }
-        }
-    }
-    
-    void accept_connections(int server_socket, const Config& config) {
-        while (running) {
-            struct sockaddr_in client_addr;
-            socklen_t client_len = sizeof(client_addr);
-            
-            int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &client_len);
-            if (client_socket < 0) {
-                if (running) {
-                    std::cerr << "❌ Failed to accept connection" << std::endl;
-                }
-                continue;
-            }
-            
-            // Check connection limit
-            if (active_connections.load() >= config.max_concurrent_connections) {
-                #ifdef _WIN32
-                closesocket(client_socket);
-                #else
-                close(client_socket);
-                #endif
-                continue;
-            }
-            
-            active_connections++;
-            
-            // Add to worker queue
-            {
-                std::lock_guard<std::mutex> lock(queue_mutex);
-                connection_queue.push(client_socket);
-            }
-            queue_cv.notify_one();
+    uint64_t active_connections() const {
+        uint64_t total = 0;
+        for (const auto& loop : loops) {
+            total += loop->connection_count();
         }
+        return total;
     }
     
-    void handle_client_connection(int client_socket) {
+    HttpResponse handle_on_loop(const HttpRequest& request) {
         auto start_time = std::chrono::high_resolution_clock::now();
         
-        // Read request with optimized buffer
-        char buffer[8192];
-        int bytes_read = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-        
-        if (bytes_read > 0) {
-            buffer[bytes_read] = '\0';
-            std::string request_str(buffer);
-            
-            // Parse and handle request
-            HttpRequest request;
-            if (parse_request(request_str, request)) {
-                HttpResponse response = process_request(request);
-                send_response(client_socket, response);
-                total_requests++;
-            }
-        }
-        
-        // Close connection
-        #ifdef _WIN32
-        closesocket(client_socket);
-        #else
-        close(client_socket);
-        #endif
-        
-        active_connections--;
+        HttpResponse response = process_request(request);
+        response.headers["X-Server"] = "Rangoons-Optimized";
+        response.headers["X-Edge-Computing"] = "enabled";
+        total_requests++;
         
         // Performance monitoring
         auto end_time = std::chrono::high_resolution_clock::now();
@@ -238,22 +267,36 @@ private:
         if (duration.count() > 10000) { // Log slow requests (>10ms)
             std::cout << "⚠️ Slow request: " << duration.count() << "μs" << std::endl;
         }
+        
+        return response;
     }
     
     HttpResponse process_request(const HttpRequest& request) {
-        // Check edge node routing
-        if (should_route_to_edge(request)) {
-            return route_to_edge_node(request);
+        // Check edge node routing. May also run later on the render cache's
+        // refresh thread, with its own copy of the request.
+        auto render = [this](const HttpRequest& req) {
+            return should_route_to_edge(req) ? route_to_edge_node(req)
+                                             : process_local_request(req);
+        };
+        
+        // Cacheable pages are answered from the render cache when possible
+        const RouteInfo* info = router.find(request.method, request.target);
+        if (!server_config.enable_edge_computing || !info || !info->cacheable ||
+            (request.method != "GET" && request.method != "HEAD")) {
+            return render(request);
         }
         
-        // Process locally with caching
-        return process_local_request(request);
+        RenderCache::Outcome outcome;
+        HttpResponse response = render_cache.serve(request, render, info->stale_seconds, &outcome);
+        if (outcome == RenderCache::Outcome::Miss) cache_misses++;
+        else cache_hits++;
+        return response;
     }
     
     bool should_route_to_edge(const HttpRequest& request) {
-        // Route static content and simple queries to edge nodes
-        if (request.target == "/" || request.target == "/products" || 
-            request.target.find("/static/") == 0) {
+        // Route static content and cacheable pages to edge nodes
+        const RouteInfo* info = router.find(request.method, request.target);
+        if ((info && info->cacheable) || request.target.find("/static/") == 0) {
             return true;
         }
         
@@ -265,10 +308,12 @@ private:
         EdgeNode* best_node = nullptr;
         int best_score = INT_MAX;
         
-        for (auto& node : edge_nodes) {
-            if (node.healthy && node.active && 
-                node.load_score < best_score) {
-                best_score = node.load_score;
+        for (size_t i = 0; i < edge_nodes.size(); ++i) {
+            EdgeNode& node = edge_nodes[i];
+            // Requests being proxied count as live connections
+            int score = node.load_score + (upstreams[i] ? 10 * (int)upstreams[i]->in_flight() : 0);
+            if (node.healthy && node.active && score < best_score) {
+                best_score = score;
                 best_node = &node;
             }
         }
@@ -278,10 +323,19 @@ private:
     
     HttpResponse route_to_edge_node(const HttpRequest& request) {
         EdgeNode* edge_node = get_least_loaded_edge_node();
-        if (!edge_node) {
+        // The primary node is this server. A request another Rangoons proxy
+        // already forwarded is served here too, so two nodes never bounce
+        // it between them.
+        auto via = request.headers.find("via");
+        if (!edge_node || edge_node->type == "primary" ||
+            (via != request.headers.end() && via->second.find("rangoons") != std::string::npos)) {
             return process_local_request(request);
         }
         
+        if (server_config.edge_mode == "proxy") {
+            return proxy_to_edge_node(*edge_node, request);
+        }
+        
         // Increment edge node load
         edge_node->active_connections++;
         edge_node->load_score += 10;
@@ -292,31 +346,94 @@ private:
         response.headers["Location"] = "http://" + edge_node->ip + ":" + 
                                       std::to_string(edge_node->port) + request.target;
         response.headers["X-Edge-Node"] = edge_node->name;
-        response.headers["X-Load-Score"] = std::to_string(edge_node->load_score);
+        response.headers["X-Load-Score"] = std::to_string(edge_node->load_score.load());
+        
+        return response;
+    }
+    
+    // Forward request to the edge node and relay its response. On failure
+    // the request is served locally (or gets a 502 without auto_failover),
+    // and the node is marked down after max_failures in a row.
+    HttpResponse proxy_to_edge_node(EdgeNode& edge_node, const HttpRequest& request) {
+        UpstreamPool& upstream = *upstreams[&edge_node - edge_nodes.data()];
+        
+        HttpResponse response;
+        std::string err;
+        if (upstream.forward(request, response, &err)) {
+            response.headers["X-Edge-Node"] = edge_node.name;
+            return response;
+        }
+        
+        if (upstream.consecutive_failures() >= std::max(server_config.load_balancer.max_failures, 1) &&
+            edge_node.healthy.exchange(false)) {
+            std::cout << "🔴 " << edge_node.name << " marked unhealthy: " << err << std::endl;
+        }
         
+        if (server_config.load_balancer.auto_failover) {
+            return process_local_request(request);
+        }
+        
+        response = HttpResponse();
+        response.status_code = 502;
+        response.content_type = "text/plain";
+        response.body = "Bad Gateway";
         return response;
     }
     
+    // Built once before any loop starts; read concurrently afterwards
+    void build_routes() {
+        // Pages may be stored anywhere but are revalidated on every use,
+        // which the ETag turns into a 304 while the catalog is unchanged
+        RouteInfo cacheable;
+        cacheable.cacheable = true;
+        cacheable.cache_control = "public, no-cache";
+        RouteInfo priority;
+        priority.priority = true;
+        priority.cache_control = "no-store";
+        RouteInfo admin;
+        admin.auth = true;
+        admin.cache_control = "no-store";
+        // Dashboards poll these; unchanged payloads come back as 304s
+        RouteInfo polled;
+        polled.cache_control = "no-cache";
+        // Past its TTL a listing is served for up to this long while it
+        // is re-rendered in the background
+        RouteInfo listing = cacheable;
+        listing.stale_seconds = 30;
+        
+        auto page = [this](HttpResponse (OptimizedServer::*handler)()) {
+            return [this, handler](const HttpRequest&, const RouteParams&) { return (this->*handler)(); };
+        };
+        
+        router.add("GET", "/", page(&OptimizedServer::handle_home_optimized), listing);
+        router.add("GET", "/home", page(&OptimizedServer::handle_home_optimized), listing);
+        router.add("GET", "/products", page(&OptimizedServer::handle_products_optimized), listing);
+        router.add("GET", "/admin", page(&OptimizedServer::handle_admin_optimized), admin);
+        router.add("GET", "/health", page(&OptimizedServer::handle_health_optimized), priority);
+        router.add("GET", "/status", page(&OptimizedServer::handle_status_optimized), polled);
+        router.add("GET", "/api/edge/status", page(&OptimizedServer::handle_edge_status), polled);
+        router.add("GET", "/api/performance", page(&OptimizedServer::handle_performance_metrics), polled);
+        router.set_admin_key(server_config.admin_key);
+        
+        // Route metadata decides what admission control keeps answering
+        admission.set_priority_check([this](const HttpRequest& request) {
+            const RouteInfo* info = router.find(request.method, request.target);
+            return info && info->priority;
+        });
+    }
+    
     HttpResponse process_local_request(const HttpRequest& request) {
         // High-performance request processing
-        if (request.target == "/" || request.target == "/home") {
-            return handle_home_optimized();
-        } else if (request.target == "/products") {
-            return handle_products_optimized();
-        } else if (request.target == "/admin") {
-            return handle_admin_optimized();
-        } else if (request.target == "/health") {
-            return handle_health_optimized();
-        } else if (request.target == "/status") {
-            return handle_status_optimized();
-        } else if (request.target == "/api/edge/status") {
-            return handle_edge_status();
-        } else if (request.target == "/api/performance") {
-            return handle_performance_metrics();
+        HttpResponse response;
+        if (router.route(request, response)) {
+            return response;
+        }
+        
+        if (static_files.serve(request, response)) {
+            return response;
         }
         
         // 404 Not Found
-        HttpResponse response;
         response.status_code = 404;
         response.content_type = "text/html";
         response.body = R"(
@@ -479,7 +596,7 @@ private:
                     <div class="stat-card">
                         <h3>📊 Performance</h3>
                         <p>Total Requests: )" << total_requests.load() << R"(</p>
-                        <p>Active Connections: )" << active_connections.load() << R"(</p>
+                        <p>Active Connections: )" << active_connections() << R"(</p>
                         <p>Cache Hits: )" << cache_hits.load() << R"(</p>
                         <p>Cache Misses: )" << cache_misses.load() << R"(</p>
                     </div>
@@ -498,9 +615,9 @@ private:
                 </div>
                 
                 <div class="admin-actions">
-                    <button onclick="refreshStats()">🔄 Refresh Stats</button>
-                    <button onclick="clearCache()">🧹 Clear Cache</button>
-                    <button onclick="restartEdgeNodes()">🔄 Restart Edge Nodes</button>
+                    <button onclick='refreshStats()'>🔄 Refresh Stats</button>
+                    <button onclick='clearCache()'>🧹 Clear Cache</button>
+                    <button onclick='restartEdgeNodes()'>🔄 Restart Edge Nodes</button>
                 </div>
             </div>
             
@@ -544,7 +661,7 @@ private:
         json << "\"uptime\": \"" << get_uptime() << "\",";
         json << "\"performance\": {";
         json << "\"total_requests\": " << total_requests.load() << ",";
-        json << "\"active_connections\": " << active_connections.load() << ",";
+        json << "\"active_connections\": " << active_connections() << ",";
         json << "\"cache_hits\": " << cache_hits.load() << ",";
         json << "\"cache_misses\": " << cache_misses.load();
         json << "}";
@@ -586,7 +703,7 @@ private:
         json << "],";
         json << "\"performance\": {";
         json << "\"total_requests\": " << total_requests.load() << ",";
-        json << "\"active_connections\": " << active_connections.load() << ",";
+        json << "\"active_connections\": " << active_connections() << ",";
         json << "\"cache_hits\": " << cache_hits.load() << ",";
         json << "\"cache_misses\": " << cache_misses.load();
         json << "}";
@@ -616,16 +733,28 @@ private:
             json << "\"load_score\": " << edge_nodes[i].load_score << ",";
             json << "\"response_time_ms\": " << edge_nodes[i].response_time_ms << ",";
             json << "\"active_connections\": " << edge_nodes[i].active_connections << ",";
-            json << "\"last_health_check\": \"" << edge_nodes[i].last_health_check << "\"";
+            json << "\"last_health_check\": \"" << format_timestamp(edge_nodes[i].last_health_check) << "\"";
+            if (upstreams[i]) {
+                UpstreamStats upstream = upstreams[i]->stats();
+                json << ",\"upstream\": {";
+                json << "\"requests\": " << upstream.requests << ",";
+                json << "\"failures\": " << upstream.failures << ",";
+                json << "\"connects\": " << upstream.connects << ",";
+                json << "\"reused\": " << upstream.reused << ",";
+                json << "\"idle\": " << upstream.idle << ",";
+                json << "\"in_flight\": " << upstream.in_flight;
+                json << "}";
+            }
             json << "}";
         }
         
         json << "],";
         json << "\"load_balancer\": {";
         json << "\"strategy\": \"least_connections\",";
+        json << "\"mode\": \"" << server_config.edge_mode << "\",";
         json << "\"total_nodes\": " << edge_nodes.size() << ",";
         json << "\"healthy_nodes\": " << std::count_if(edge_nodes.begin(), edge_nodes.end(), 
-                                                      [](const EdgeNode& n) { return n.healthy; });
+                                                      [](const EdgeNode& n) { return n.healthy.load(); });
         json << "}";
         json << "}";
         
@@ -653,6 +782,103 @@ private:
         }
         
         json << "}";
+        json << "},";
+        json << "\"handler_pool\": [";
+        
+        auto workers = handler_pool ? handler_pool->stats() : std::vector<WorkStealingPool::WorkerStats>();
+        for (size_t i = 0; i < workers.size(); ++i) {
+            if (i > 0) json << ",";
+            json << "{";
+            json << "\"worker\": " << i << ",";
+            json << "\"queue_depth\": " << workers[i].queue_depth << ",";
+            json << "\"executed\": " << workers[i].executed << ",";
+            json << "\"steals\": " << workers[i].steals;
+            json << "}";
+        }
+        
+        json << "],";
+        
+        CompressionStats compression = compression_stats();
+        json << "\"compression\": {";
+        json << "\"compressed\": " << compression.compressed << ",";
+        json << "\"cache_hits\": " << compression.cache_hits << ",";
+        json << "\"bytes_in\": " << compression.bytes_in << ",";
+        json << "\"bytes_out\": " << compression.bytes_out;
+        json << "},";
+        
+        AdmissionStats shedding = admission.stats();
+        uint64_t refused = 0;
+        for (const auto& loop : loops) {
+            refused += loop->connections_refused();
+        }
+        json << "\"admission\": {";
+        json << "\"admitted\": " << shedding.admitted << ",";
+        json << "\"shed_queue_delay\": " << shedding.shed_queue_delay << ",";
+        json << "\"shed_queue_full\": " << shedding.shed_queue_full << ",";
+        json << "\"shed_connections\": " << refused << ",";
+        json << "\"in_flight\": " << shedding.in_flight << ",";
+        json << "\"overloaded\": " << (shedding.overloaded ? "true" : "false") << ",";
+        json << "\"min_queue_delay_ms\": " << shedding.min_delay_ms;
+        json << "},";
+        
+        uint64_t timed_out = 0;
+        for (const auto& loop : loops) {
+            timed_out += loop->connections_timed_out();
+        }
+        EdgeCacheStats cache = edge_cache.stats();
+        json << "\"edge_cache\": {";
+        json << "\"entries\": " << cache.entries << ",";
+        json << "\"bytes\": " << cache.bytes << ",";
+        json << "\"capacity\": " << cache.capacity << ",";
+        json << "\"hits\": " << cache.hits << ",";
+        json << "\"misses\": " << cache.misses << ",";
+        json << "\"evictions\": " << cache.evictions << ",";
+        json << "\"rejections\": " << cache.rejections << ",";
+        json << "\"expirations\": " << cache.expirations << ",";
+        json << "\"restored\": " << cache.restored << ",";
+        json << "\"snapshot_pending\": " << edge_cache.snapshot_entries();
+        json << "},";
+        
+        RenderCacheStats pages = render_cache.stats();
+        json << "\"render_cache\": {";
+        json << "\"hits\": " << pages.hits << ",";
+        json << "\"stale\": " << pages.stale << ",";
+        json << "\"coalesced\": " << pages.coalesced << ",";
+        json << "\"misses\": " << pages.misses << ",";
+        json << "\"refreshes\": " << pages.refreshes << ",";
+        json << "\"encoded\": " << pages.encoded << ",";
+        json << "\"encodings\": " << pages.encodings;
+        json << "},";
+        
+        if (catalog_listener) {
+            CatalogListenerStats listener = catalog_listener->stats();
+            json << "\"catalog_listener\": {";
+            json << "\"connected\": " << (listener.connected ? "true" : "false") << ",";
+            json << "\"notifications\": " << listener.notifications << ",";
+            json << "\"full_invalidations\": " << listener.full_invalidations << ",";
+            json << "\"reconnects\": " << listener.reconnects;
+            json << "},";
+        }
+        
+        if (g_db) {
+            DBPoolStats pool = g_db->pool_stats();
+            json << "\"db_pool\": {";
+            json << "\"size\": " << pool.size << ",";
+            json << "\"open\": " << pool.open << ",";
+            json << "\"in_use\": " << pool.in_use << ",";
+            json << "\"created\": " << pool.created << ",";
+            json << "\"resets\": " << pool.resets << ",";
+            json << "\"retries\": " << pool.retries << ",";
+            json << "\"waits\": " << pool.waits << ",";
+            json << "\"timeouts\": " << pool.timeouts << ",";
+            json << "\"wait_ms_avg\": " << (pool.waits ? pool.wait_ms_total / pool.waits : 0.0) << ",";
+            json << "\"wait_ms_max\": " << pool.wait_ms_max;
+            json << "},";
+        }
+        
+        json << "\"connections\": {";
+        json << "\"open\": " << active_connections() << ",";
+        json << "\"timed_out\": " << timed_out;
         json << "}";
         json << "}";
         
@@ -660,107 +886,80 @@ private:
         return response;
     }
     
-    void send_response(int client_socket, const HttpResponse& response) {
-        std::ostringstream response_stream;
-        response_stream << "HTTP/1.1 " << response.status_code << " OK\r\n";
-        response_stream << "Content-Type: " << response.content_type << "\r\n";
-        response_stream << "Content-Length: " << response.body.length() << "\r\n";
-        response_stream << "Connection: close\r\n";
-        response_stream << "X-Server: Rangoons-Optimized\r\n";
-        response_stream << "X-Edge-Computing: enabled\r\n";
-        response_stream << "\r\n";
-        response_stream << response.body;
-        
-        std::string response_str = response_stream.str();
-        send(client_socket, response_str.c_str(), response_str.length(), 0);
-    }
-    
     void initialize_edge_nodes(const Config& config) {
-        // Primary server node (this computer)
-        EdgeNode primary_node;
-        primary_node.id = "primary-server";
-        primary_node.name = "Primary C++ Server";
-        primary_node.ip = config.host;
-        primary_node.port = config.port;
-        primary_node.type = "primary";
-        primary_node.active = true;
-        primary_node.load_score = 0;
-        primary_node.response_time_ms = 0;
-        primary_node.active_connections = 0;
-        primary_node.healthy = true;
-        primary_node.last_health_check = get_current_timestamp();
-        edge_nodes.push_back(primary_node);
-        
-        // Vivo mobile edge node
-        EdgeNode vivo_node;
-        vivo_node.id = "vivo-mobile";
-        vivo_node.name = "Vivo Mobile Edge";
-        vivo_node.ip = "192.168.18.22";
-        vivo_node.port = 8081;
-        vivo_node.type = "vivo";
-        vivo_node.active = true;
-        vivo_node.load_score = 25;
-        vivo_node.response_time_ms = 50;
-        vivo_node.active_connections = 0;
-        vivo_node.healthy = true;
-        vivo_node.last_health_check = get_current_timestamp();
-        edge_nodes.push_back(vivo_node);
-        
-        // Samsung mobile edge node
-        EdgeNode samsung_node;
-        samsung_node.id = "samsung-mobile";
-        samsung_node.name = "Samsung Mobile Edge";
-        samsung_node.ip = "192.168.18.160";
-        samsung_node.port = 8082;
-        samsung_node.type = "samsung";
-        samsung_node.active = true;
-        samsung_node.load_score = 30;
-        samsung_node.response_time_ms = 60;
-        samsung_node.active_connections = 0;
-        samsung_node.healthy = true;
-        samsung_node.last_health_check = get_current_timestamp();
-        edge_nodes.push_back(samsung_node);
+        // Nodes come from the load balancer configuration; without one this
+        // server is the only node
+        edge_nodes = config.load_balancer.nodes;
+        if (edge_nodes.empty()) {
+            EdgeNode primary_node;
+            primary_node.id = "primary-server";
+            primary_node.name = "Primary C++ Server";
+            primary_node.ip = config.host;
+            primary_node.port = config.port;
+            primary_node.type = "primary";
+            primary_node.active = true;
+            primary_node.load_score = 0;
+            primary_node.healthy = true;
+            edge_nodes.push_back(primary_node);
+        }
+        
+        for (auto& node : edge_nodes) {
+            node.last_health_check = std::time(nullptr);
+            upstreams.push_back(node.type == "primary" ? nullptr
+                                : std::make_unique<UpstreamPool>(node.ip, node.port, config));
+        }
     }
     
     void start_health_monitor() {
         health_monitor_thread = std::thread([this]() {
+            auto interval = std::chrono::milliseconds(std::max(server_config.load_balancer.health_check_interval_ms, 100));
             while (running) {
                 monitor_edge_nodes();
-                std::this_thread::sleep_for(std::chrono::seconds(30));
+                for (auto slept = std::chrono::milliseconds(0); running && slept < interval; slept += std::chrono::milliseconds(100)) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
             }
         });
     }
     
     void monitor_edge_nodes() {
-        for (auto& node : edge_nodes) {
-            if (node.type == "primary") continue; // Skip primary node
+        for (size_t i = 0; i < edge_nodes.size(); ++i) {
+            EdgeNode& node = edge_nodes[i];
+            if (node.type == "primary" || !node.active) continue; // Skip primary node
             
-            // Simulate health check
-            bool was_healthy = node.healthy;
-            node.healthy = (rand() % 100) > 10; // 90% uptime simulation
+            // Probe the node's own health endpoint through its pool
+            std::chrono::milliseconds elapsed(0);
+            bool healthy = upstreams[i]->probe("/health", &elapsed);
+            node.response_time_ms = (int)elapsed.count();
             
-            if (was_healthy != node.healthy) {
-                std::cout << (node.healthy ? "🟢" : "🔴") << " " << node.name 
-                         << " health changed to " << (node.healthy ? "healthy" : "unhealthy") << std::endl;
+            bool was_healthy = node.healthy.exchange(healthy);
+            if (was_healthy != healthy) {
+                std::cout << (healthy ? "🟢" : "🔴") << " " << node.name 
+                         << " health changed to " << (healthy ? "healthy" : "unhealthy") << std::endl;
             }
             
-            // Update load scores
-            if (node.healthy) {
-                node.load_score = std::max(0, node.load_score - 5); // Gradually reduce load
-            } else {
-                node.load_score = std::min(100, node.load_score + 20); // Increase load if unhealthy
-            }
+            // Update load scores; redirects add to them concurrently
+            int score = node.load_score.load();
+            int updated;
+            do {
+                updated = healthy ? std::max(0, score - 5)     // Gradually reduce load
+                                  : std::min(100, score + 20); // Increase load if unhealthy
+            } while (!node.load_score.compare_exchange_weak(score, updated));
             
-            node.last_health_check = get_current_timestamp();
+            node.last_health_check = std::time(nullptr);
         }
     }
     
     // Utility functions
     std::string get_current_timestamp() {
-        auto now = std::chrono::system_clock::now();
-        auto time_t = std::chrono::system_clock::to_time_t(now);
+        return format_timestamp(std::time(nullptr));
+    }
+    
+    static std::string format_timestamp(std::time_t t) {
+        std::tm tm;
+        gmtime_r(&t, &tm);
         std::stringstream ss;
-        ss << std::put_time(std::gmtime(&time_t), "%Y-%m-%dT%H:%M:%SZ");
+        ss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
         return ss.str();
     }
     
@@ -807,7 +1006,7 @@ private:
     }
     
     double calculate_connection_utilization() {
-        return static_cast<double>(active_connections.load()) / 10000.0 * 100.0; // Assuming max 10000
+        return static_cast<double>(active_connections()) / server_config.max_concurrent_connections * 100.0;
     }
 };
 
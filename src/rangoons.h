@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <memory>
@@ -9,6 +11,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
+#include <functional>
 
 // Forward declarations
 struct sqlite3;
@@ -22,13 +25,27 @@ struct EdgeNode {
     int port;
     std::string type; // "primary", "vivo", "samsung"
     bool active;
-    int load_score; // 0-100, lower is better
-    int response_time_ms;
-    int active_connections;
-    std::string last_health_check;
+    // Written by the health monitor while request threads read them
+    std::atomic<int> load_score; // 0-100, lower is better
+    std::atomic<int> response_time_ms;
+    std::atomic<int> active_connections;
+    std::atomic<int64_t> last_health_check; // unix seconds, 0 before the first
     std::atomic<bool> healthy{true};
     
-    EdgeNode() : port(8080), active(false), load_score(100), response_time_ms(0), active_connections(0) {}
+    EdgeNode() : port(8080), active(false), load_score(100), response_time_ms(0), active_connections(0),
+                 last_health_check(0) {}
+    EdgeNode(const EdgeNode& o)
+        : id(o.id), name(o.name), ip(o.ip), port(o.port), type(o.type), active(o.active),
+          load_score(o.load_score.load()), response_time_ms(o.response_time_ms.load()),
+          active_connections(o.active_connections.load()), last_health_check(o.last_health_check.load()),
+          healthy(o.healthy.load()) {}
+    EdgeNode& operator=(const EdgeNode& o) {
+        id = o.id; name = o.name; ip = o.ip; port = o.port; type = o.type; active = o.active;
+        load_score = o.load_score.load(); response_time_ms = o.response_time_ms.load();
+        active_connections = o.active_connections.load(); last_health_check = o.last_health_check.load();
+        healthy = o.healthy.load();
+        return *this;
+    }
 };
 
 // Load balancer configuration
@@ -58,17 +75,42 @@ struct Config {
     LoadBalancerConfig load_balancer;
     bool enable_edge_computing = true;
     int edge_cache_size_mb = 512;
+    int edge_cache_ttl_seconds = 60;  // for pages of cacheable routes
+    std::string edge_cache_policy = "tinylfu"; // or "lru"
+    std::string cache_snapshot_path = "rangoons-cache.snap"; // empty: no warm restarts
+    int cache_snapshot_interval_seconds = 60;
+    bool enable_catalog_listener = true; // LISTEN for catalog changes made outside this process
     int max_concurrent_connections = 10000;
     bool enable_compression = true;
+    int compression_min_bytes = 1024; // smaller bodies go out uncompressed
+    int gzip_level = 5;               // 1-9, tuned for latency over ratio
+    int brotli_quality = 4;           // 0-11
     bool enable_http2 = false;
+    std::string edge_mode = "proxy";       // "proxy" forwards to the edge node, "redirect" sends the client there
+    int upstream_connect_timeout_ms = 500;
+    int upstream_timeout_ms = 5000;        // whole exchange, request sent to response read
+    int upstream_max_idle = 16;            // keep-alive connections parked per edge node
     
     // Performance tuning
     int worker_threads = 4;
-    int connection_pool_size = 100;
+    int handler_threads = 0; // work-stealing handler pool, 0 = one per core
+    int admission_target_ms = 50;    // queue delay a standing queue is cut back to
+    int admission_interval_ms = 500; // window the minimum queue delay is taken over
+    int max_queued_requests = 10000; // 0 = unbounded; a tenth is kept for priority_paths
+    int retry_after_seconds = 1;     // on 503s for shed requests and connections
+    std::vector<std::string> priority_paths = { "/health", "/checkout", "/api/checkout" };
+    int connection_pool_size = 100;  // PostgreSQL connections per process
+    int db_pool_timeout_ms = 2000;   // longest a query waits for a free connection
     int request_buffer_size = 8192;
     int response_buffer_size = 16384;
     bool enable_keep_alive = true;
     int keep_alive_timeout = 30;
+    int header_timeout = 10;         // seconds to send a complete request head
+    int body_timeout = 30;           // seconds a request body may stall
+    int send_timeout = 30;           // seconds a response may stall unread
+    int keep_alive_max_requests = 1000;
+    std::string io_backend = "epoll"; // "epoll" or "io_uring"
+    std::string static_root = "integrations"; // served for paths no route matches
 };
 
 // Product structure
@@ -182,6 +224,8 @@ struct ProductStats {
 struct HttpRequest {
     std::string method;
     std::string target;
+    std::string query;   // raw, still percent-encoded, without the '?'
+    std::string version;
     std::map<std::string, std::string> headers;
     std::string body;
     std::map<std::string, std::string> query_params;
@@ -192,14 +236,27 @@ struct HttpRequest {
     std::string edge_node_id;
 };
 
+// Open file sent with sendfile() in place of HttpResponse::body. The fd is
+// closed once the last response and cache entry holding it are gone.
+struct FileBody {
+    int fd = -1;
+    size_t size = 0;
+
+    FileBody(int fd, size_t size) : fd(fd), size(size) {}
+    ~FileBody();
+    FileBody(const FileBody&) = delete;
+    FileBody& operator=(const FileBody&) = delete;
+};
+
 // HTTP response structure
 struct HttpResponse {
     int status_code = 200;
     std::map<std::string, std::string> headers;
     std::string body;
+    std::shared_ptr<FileBody> file; // when set, replaces body on the wire
     std::string content_type = "text/html";
     bool compressed = false;
-    int content_length = 0;
+    size_t content_length = 0; // length a HEAD answer reports when it carries no body
     std::string cache_control;
     std::string edge_node_id;
 };
@@ -213,19 +270,66 @@ struct CacheEntry {
     std::chrono::system_clock::time_point expires_at;
     int access_count;
     std::string edge_node_id;
-    bool is_compressed;
+    bool is_compressed; // data is an encoded copy of another entry's page
+    uint64_t version = 0; // DB::catalog_version() a rendered page came from
+    int stale_seconds = 0; // kept this long past ttl_seconds, to serve while refreshing
+    std::string etag;          // validators and caching policy the page
+    std::string last_modified; // was first served with
+    std::string cache_control;
     
     CacheEntry() : ttl_seconds(300), access_count(0), is_compressed(false) {}
 };
 
+// Versions of the catalog for cached pages. A page that shows one part of
+// the catalog, such as a product page, is checked against that part's
+// scope ("product:12", "handle:red-shirt", "category:shoes") and outlives
+// changes elsewhere; anything else is checked against global(), which
+// every change moves. Scopes hash onto a fixed array of counters, so two
+// sharing one only costs an extra render.
+class CatalogVersions {
+public:
+    CatalogVersions();
+    
+    uint64_t global() const { return any_change.load(std::memory_order_acquire); }
+    uint64_t of(std::string_view scope) const;
+    
+    void bump(std::string_view scope);
+    void bump_all(); // extent unknown, e.g. a bulk import or missed notifications
+    
+private:
+    static const size_t SLOTS = 4096;
+    std::atomic<uint64_t> any_change{1};
+    std::atomic<uint64_t> everything{1};
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+};
+
+struct DBPoolStats {
+    size_t size = 0;         // most connections the pool opens
+    size_t open = 0;
+    size_t in_use = 0;
+    uint64_t created = 0;    // connections opened so far
+    uint64_t resets = 0;     // broken connections reconnected
+    uint64_t retries = 0;    // reads repeated after the server dropped the connection
+    uint64_t waits = 0;      // checkouts that found none free
+    uint64_t timeouts = 0;   // of those, gave up after the wait timeout
+    double wait_ms_total = 0;
+    double wait_ms_max = 0;
+};
+
 // Database interface
 class DB {
 public:
     DB();
     ~DB();
     
-    bool open(const std::string& connection_string);
+    // Opens one connection now and more on demand, up to pool_size; a
+    // call waits up to wait_timeout_ms for one to come free
+    bool open(const std::string& connection_string, size_t pool_size = 1, int wait_timeout_ms = 5000);
     void close();
+    
+    // libpq conninfo for a host:port:dbname:user:password connection
+    // string, as open() takes; dbname is set to the database's name
+    static std::string conninfo(const std::string& connection_string, std::string* dbname = nullptr);
     bool is_open() const;
     
     // Schema management
@@ -236,6 +340,7 @@ public:
     bool update_product(const Product& p, std::string* err = nullptr);
     bool delete_product(int id, std::string* err = nullptr);
     Product get_product(int id, std::string* err = nullptr);
+    Product get_product_by_handle(const std::string& handle, std::string* err = nullptr);
     std::vector<Product> list_products(const std::string& category = "", int limit = 0, int offset = 0);
     std::vector<Product> search_products(const std::string& query, int limit = 0, int offset = 0);
     int get_product_count(const std::string& category = "");
@@ -260,7 +365,8 @@ public:
     bool update_product_stats(int product_id, const std::string& stat_type, int value, std::string* err = nullptr);
     ProductStats get_product_stats(int product_id, std::string* err = nullptr);
     
-    // CSV import
+    // CSV import: replaces the catalog with the file's products in one
+    // transaction, matching existing products by handle
     bool import_products_from_csv(const std::string& csv_data, std::string* err = nullptr);
     
     // Database export
@@ -269,43 +375,115 @@ public:
     // Edge computing
     bool sync_with_edge_node(const std::string& edge_node_id, std::string* err = nullptr);
     std::vector<std::string> get_edge_node_status();
+    
+    // Bumped by every product write, here or (through CatalogListener)
+    // anywhere else; pages rendered from an older version are stale
+    uint64_t catalog_version() const { return catalog.global(); }
+    void bump_catalog_version() { catalog.bump_all(); }
+    CatalogVersions& catalog_versions() { return catalog; }
+    
+    // Digest of every product row. Unlike catalog_version() it survives a
+    // restart, so pages saved by an earlier process can be checked against
+    // it. Empty on error.
+    std::string catalog_stamp(std::string* err = nullptr);
+    
+    DBPoolStats pool_stats() const;
 
 private:
-    void* handle = nullptr; // PostgreSQL connection
+    void* handle = nullptr; // PostgreSQL connection pool
     bool connected = false;
+    CatalogVersions catalog;
+};
+
+// Edge computing cache manager. Split into shards, each with its own lock,
+// hash map and LRU lists, so worker threads rarely meet on a lock. Every
+// entry is charged its key, value and bookkeeping bytes against
+// max_size_mb; TTLs are checked when an entry is looked up.
+//
+// TinyLfu (W-TinyLFU) keeps a small LRU window for new entries in front of
+// a segmented LRU holding the rest. An entry leaving the window only
+// displaces the main segment's victim when a count-min sketch of recent
+// requests says it is asked for more often, so a crawler walking the whole
+// catalog once cannot flush the popular pages. Lru is one plain LRU list.
+enum class EdgeCachePolicy { Lru, TinyLfu };
+
+struct EdgeCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;   // pushed out by the size bound
+    uint64_t rejections = 0;  // of those, new entries the admission policy turned away
+    uint64_t expirations = 0; // found past their TTL
+    uint64_t restored = 0;    // hits answered from the open snapshot
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t capacity = 0;
 };
 
-// Edge computing cache manager
 class EdgeCache {
 public:
-    EdgeCache(size_t max_size_mb = 512);
+    EdgeCache(size_t max_size_mb = 512, size_t shard_count = 16,
+              EdgeCachePolicy policy = EdgeCachePolicy::TinyLfu);
     ~EdgeCache();
+    EdgeCache(const EdgeCache&) = delete;
+    EdgeCache& operator=(const EdgeCache&) = delete;
     
+    // Insert or replace; false when the entry alone exceeds a shard
     bool put(const std::string& key, const std::string& data, const std::string& content_type, int ttl_seconds = 300);
+    bool put(CacheEntry entry);
+    
+    // Copy of the cached data, empty on a miss
     std::string get(const std::string& key, std::string* content_type = nullptr);
+    
+    // Shared entry, null on a miss; the body is not copied
+    std::shared_ptr<const CacheEntry> lookup(const std::string& key);
+    
     bool remove(const std::string& key);
     void clear();
-    size_t size() const;
-    size_t capacity() const;
+    size_t size() const;     // bytes charged
+    size_t capacity() const; // bytes
+    
+    // Warm restarts. save_snapshot writes the live entries keep() accepts,
+    // hottest first per shard, to a temporary file renamed over path, so a
+    // crash mid-write leaves the previous snapshot intact. label says what
+    // the entries were built from.
+    //
+    // open_snapshot maps such a file when its label matches. Nothing is
+    // copied up front: a lookup that misses checks the mapping and moves
+    // the entry into the cache, after adopt() has had a chance to adjust
+    // it. Entries past their expiry are never restored. false with err
+    // when the file is missing, malformed or for another label.
+    using SnapshotFilter = std::function<bool(const CacheEntry&)>;
+    using SnapshotAdopt = std::function<void(CacheEntry&)>;
+    bool save_snapshot(const std::string& path, const std::string& label,
+                       const SnapshotFilter& keep = nullptr, std::string* err = nullptr) const;
+    bool open_snapshot(const std::string& path, const std::string& label,
+                       SnapshotAdopt adopt = nullptr, std::string* err = nullptr);
+    size_t snapshot_entries() const; // still waiting in the open snapshot
     
     // Edge node synchronization
     bool sync_to_node(const std::string& edge_node_id, const std::string& key);
     bool sync_from_node(const std::string& edge_node_id, const std::string& key);
     
     // Cache statistics
-    int get_hit_count() const;
-    int get_miss_count() const;
+    uint64_t get_hit_count() const;
+    uint64_t get_miss_count() const;
     double get_hit_ratio() const;
+    EdgeCacheStats stats() const;
 
 private:
-    std::map<std::string, CacheEntry> cache;
+    struct Shard;
+    struct Snapshot;
+    std::unique_ptr<Shard[]> shards;
+    size_t shard_count;
+    size_t shard_mask;
     size_t max_size_bytes;
-    std::atomic<int> hit_count{0};
-    std::atomic<int> miss_count{0};
-    mutable std::mutex cache_mutex;
+    std::shared_ptr<Snapshot> snapshot; // read with std::atomic_load
+    std::atomic<bool> snapshot_open{false}; // lets a miss skip the load
     
-    void evict_lru();
-    void cleanup_expired();
+    Shard& shard_for(const std::string& key) const;
+    bool insert(std::shared_ptr<const CacheEntry> entry);
+    std::shared_ptr<const CacheEntry> restore(const std::string& key);
+    void forget_snapshot_entry(const std::string& key);
 };
 
 // Load balancer
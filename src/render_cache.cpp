@@ -0,0 +1,440 @@
+#include "render_cache.h"
+#include "http.h"
+#include <cstdio>
+#include <iostream>
+
+// One render of one key. Whoever created it renders; others wait on it.
+struct RenderCache::Flight {
+    uint64_t version;
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    bool done = false;
+    std::shared_ptr<const HttpResponse> response; // null: the render failed
+
+    explicit Flight(uint64_t version) : version(version) {}
+};
+
+// The page is rendered for the cache, not for what this client holds: an
+// upstream must not answer it with a 304, nor a HEAD with no body.
+// respond() strips the body again for a HEAD.
+static HttpRequest unconditional(const HttpRequest& request) {
+    HttpRequest full = request;
+    if (full.method == "HEAD") full.method = "GET";
+    full.headers.erase("if-none-match");
+    full.headers.erase("if-modified-since");
+    return full;
+}
+
+// Key of the page a cache entry belongs to: itself, or the page it is a
+// compressed copy of
+static std::string page_key(const std::string& entry_key) {
+    return entry_key.substr(0, entry_key.find('\n'));
+}
+
+RenderCache::RenderCache(EdgeCache& cache, VersionSource version, const Config& config)
+    : cache(cache), version(std::move(version)), config(config), ttl_seconds(config.edge_cache_ttl_seconds) {}
+
+RenderCache::~RenderCache() {
+    shutdown();
+}
+
+std::string RenderCache::key_for(const HttpRequest& request) {
+    return Utils::generate_cache_key(request.target, request.query_params);
+}
+
+bool RenderCache::is_storable(const HttpResponse& response) {
+    if (response.status_code != 200 || response.file || response.compressed) return false;
+    // An answer to a HEAD: only the length of the page
+    if (response.body.empty() && response.content_length != 0) return false;
+    if (response.headers.count("Set-Cookie")) return false;
+    std::string_view cache_control = cache_control_of(response);
+    return cache_control.find("no-store") == std::string_view::npos &&
+           cache_control.find("private") == std::string_view::npos;
+}
+
+HttpResponse RenderCache::serve(const HttpRequest& request, const Renderer& render, int stale_seconds,
+                                Outcome* outcome) {
+    std::string key = key_for(request);
+    // Read before rendering: a write that lands mid-render leaves the page
+    // tagged with the older version, so the next request renders again
+    uint64_t current = version(key);
+
+    std::shared_ptr<const CacheEntry> entry = cache.lookup(key);
+    if (entry && entry->version == current) {
+        // The cache keeps entries through their stale window; past the TTL
+        // is stale, so serve it and have it re-rendered
+        bool fresh = entry->ttl_seconds <= 0 ||
+                     std::chrono::system_clock::now() < entry->expires_at - std::chrono::seconds(entry->stale_seconds);
+        if (fresh) {
+            hits++;
+            if (outcome) *outcome = Outcome::Hit;
+            return cached_response(request, key, *entry, "HIT");
+        }
+        stale++;
+        schedule_refresh(key, unconditional(request), render, entry, stale_seconds);
+        if (outcome) *outcome = Outcome::Stale;
+        return cached_response(request, key, *entry, "STALE");
+    }
+
+    std::shared_ptr<Flight> flight;
+    bool leader = false;
+    {
+        std::lock_guard<std::mutex> lock(flights_mutex);
+        auto it = flights.find(key);
+        if (it == flights.end()) {
+            flight = std::make_shared<Flight>(current);
+            flights.emplace(key, flight);
+            leader = true;
+        } else if (it->second->version == current) {
+            flight = it->second;
+        }
+        // else a render for an older version is still running: its page
+        // is not good enough, render this one alone
+    }
+
+    if (flight && !leader) {
+        std::shared_ptr<const HttpResponse> shared;
+        {
+            std::unique_lock<std::mutex> lock(flight->mutex);
+            flight->done_cv.wait(lock, [&] { return flight->done; });
+            shared = flight->response;
+        }
+        // Only a response that could have come from the cache is handed to
+        // another client; anything else is rendered for this request
+        if (shared && is_storable(*shared)) {
+            coalesced++;
+            if (outcome) *outcome = Outcome::Coalesced;
+            HttpResponse response = *shared;
+            response.headers["X-Cache"] = "HIT";
+            encode(request, key, response, current, stale_seconds);
+            return response;
+        }
+    }
+
+    misses++;
+    if (outcome) *outcome = Outcome::Miss;
+    HttpRequest full = unconditional(request);
+    HttpResponse response;
+    if (leader) {
+        response = run_flight(key, flight, full, render, entry, stale_seconds);
+    } else {
+        response = render(full);
+        store(key, response, current, entry, stale_seconds);
+    }
+    response.headers["X-Cache"] = "MISS";
+    encode(request, key, response, current, stale_seconds);
+    return response;
+}
+
+HttpResponse RenderCache::cached_response(const HttpRequest& request, const std::string& key,
+                                          const CacheEntry& entry, const char* status) {
+    HttpResponse response;
+    response.content_type = entry.content_type;
+    response.cache_control = entry.cache_control;
+    response.headers["X-Cache"] = status;
+    if (!entry.etag.empty()) response.headers["ETag"] = entry.etag;
+    if (!entry.last_modified.empty()) response.headers["Last-Modified"] = entry.last_modified;
+    if (!entry.edge_node_id.empty()) response.headers["X-Edge-Node"] = entry.edge_node_id;
+
+    bool negotiated = is_worth_compressing(entry.data.size(), entry.content_type, config);
+    if (negotiated) add_vary_accept_encoding(response);
+
+    // The client already has this page: do not even copy it
+    std::string matched;
+    if (not_modified(request, entry.etag, entry.last_modified, &matched)) {
+        make_not_modified(response, matched);
+        return response;
+    }
+
+    // A HEAD gets the length of the body it would have had, not a copy
+    bool head = request.method == "HEAD";
+    ContentCoding coding;
+    std::shared_ptr<const CacheEntry> encoded_page =
+        negotiated ? variant(request, key, entry.data, entry, &coding) : nullptr;
+    if (encoded_page) {
+        set_encoded_body(response, coding, head ? std::string() : encoded_page->data);
+        if (head) response.content_length = encoded_page->data.size();
+    } else if (head) {
+        response.content_length = entry.data.size();
+    } else {
+        response.body = entry.data;
+    }
+    return response;
+}
+
+std::shared_ptr<const CacheEntry> RenderCache::variant(const HttpRequest& request, const std::string& key,
+                                                       std::string_view body, const CacheEntry& page,
+                                                       ContentCoding* coding) {
+    auto accept = request.headers.find("accept-encoding");
+    if (accept == request.headers.end() || page.etag.empty()) return nullptr;
+    *coding = negotiate_encoding(accept->second);
+    if (*coding == ContentCoding::Identity) return nullptr;
+
+    // Request targets cannot contain a newline, so this never names a page
+    std::string variant_key = key + '\n' + coding_name(*coding);
+    std::shared_ptr<const CacheEntry> stored = cache.lookup(variant_key);
+    if (stored && stored->etag == page.etag) {
+        if (stored->data.empty()) return nullptr; // did not pay off last time either
+        encoded++;
+        return stored;
+    }
+
+    // Kept even when empty, so a page that does not shrink is tried once
+    CacheEntry entry;
+    entry.key = std::move(variant_key);
+    entry.data = compress_body(body, *coding, config);
+    entry.content_type = page.content_type;
+    entry.ttl_seconds = page.ttl_seconds;
+    entry.stale_seconds = page.stale_seconds;
+    entry.expires_at = page.expires_at;
+    entry.version = page.version;
+    entry.etag = page.etag;
+    entry.is_compressed = true;
+    encodings++;
+    if (entry.data.empty()) {
+        cache.put(std::move(entry));
+        return nullptr;
+    }
+    auto made = std::make_shared<const CacheEntry>(entry);
+    cache.put(std::move(entry));
+    return made;
+}
+
+void RenderCache::encode(const HttpRequest& request, const std::string& key, HttpResponse& response,
+                         uint64_t page_version, int stale_seconds) {
+    // Only what store() kept has a cached page to hang a variant on
+    if (!is_storable(response) || !is_worth_compressing(response, config)) return;
+    add_vary_accept_encoding(response);
+
+    CacheEntry page;
+    page.content_type = response.content_type;
+    page.ttl_seconds = ttl_seconds;
+    page.stale_seconds = stale_seconds;
+    page.version = page_version;
+    page.etag = response.headers["ETag"];
+    ContentCoding coding;
+    std::shared_ptr<const CacheEntry> encoded_page = variant(request, key, response.body, page, &coding);
+    if (encoded_page) set_encoded_body(response, coding, encoded_page->data);
+}
+
+HttpResponse RenderCache::run_flight(const std::string& key, const std::shared_ptr<Flight>& flight,
+                                     const HttpRequest& request, const Renderer& render,
+                                     const std::shared_ptr<const CacheEntry>& previous, int stale_seconds) {
+    std::shared_ptr<const HttpResponse> response;
+    try {
+        HttpResponse rendered = render(request);
+        store(key, rendered, flight->version, previous, stale_seconds);
+        response = std::make_shared<const HttpResponse>(std::move(rendered));
+    } catch (...) {
+        finish(key, flight, nullptr);
+        throw;
+    }
+    finish(key, flight, response);
+    return *response;
+}
+
+void RenderCache::finish(const std::string& key, const std::shared_ptr<Flight>& flight,
+                         std::shared_ptr<const HttpResponse> response) {
+    {
+        std::lock_guard<std::mutex> lock(flights_mutex);
+        auto it = flights.find(key);
+        if (it != flights.end() && it->second == flight) flights.erase(it);
+    }
+    {
+        std::lock_guard<std::mutex> lock(flight->mutex);
+        flight->done = true;
+        flight->response = std::move(response);
+    }
+    flight->done_cv.notify_all();
+}
+
+void RenderCache::store(const std::string& key, HttpResponse& response, uint64_t page_version,
+                        const std::shared_ptr<const CacheEntry>& previous, int stale_seconds) {
+    if (!is_storable(response)) return;
+
+    // Validators go out with this response too. A re-render that produced
+    // the same page keeps the time it first changed, so If-Modified-Since
+    // still matches.
+    std::string& etag = response.headers["ETag"];
+    if (etag.empty()) etag = content_etag(response.body);
+    std::string& last_modified = response.headers["Last-Modified"];
+    if (last_modified.empty()) {
+        last_modified = previous && previous->etag == etag ? previous->last_modified : http_date(time(nullptr));
+    }
+
+    // Overwrites the stale page under the same key, if there was one
+    CacheEntry entry;
+    entry.key = key;
+    entry.data = response.body;
+    entry.content_type = response.content_type;
+    entry.ttl_seconds = ttl_seconds;
+    entry.stale_seconds = stale_seconds;
+    entry.version = page_version;
+    entry.etag = etag;
+    entry.last_modified = last_modified;
+    entry.cache_control = std::string(cache_control_of(response));
+    auto edge = response.headers.find("X-Edge-Node");
+    if (edge != response.headers.end()) entry.edge_node_id = edge->second;
+    cache.put(std::move(entry));
+}
+
+// ---------------- Background refresh -----------------
+
+void RenderCache::schedule_refresh(const std::string& key, const HttpRequest& request, const Renderer& render,
+                                   const std::shared_ptr<const CacheEntry>& stale_entry, int stale_seconds) {
+    std::shared_ptr<Flight> flight;
+    {
+        std::lock_guard<std::mutex> lock(flights_mutex);
+        if (flights.count(key)) return; // already being rendered
+        flight = std::make_shared<Flight>(stale_entry->version);
+        flights.emplace(key, flight);
+    }
+
+    std::unique_lock<std::mutex> lock(refresh_mutex);
+    if (stopping) {
+        lock.unlock();
+        finish(key, flight, nullptr);
+        return;
+    }
+    refresh_queue.push_back({ key, std::move(flight), request, render, stale_entry, stale_seconds });
+    if (!refresher.joinable()) {
+        refresher = std::thread([this]() { refresh_loop(); });
+    }
+    lock.unlock();
+    refresh_cv.notify_one();
+}
+
+void RenderCache::refresh_loop() {
+    std::unique_lock<std::mutex> lock(refresh_mutex);
+    while (true) {
+        refresh_cv.wait(lock, [this] { return stopping || !refresh_queue.empty(); });
+        if (stopping) return;
+        Refresh refresh = std::move(refresh_queue.front());
+        refresh_queue.pop_front();
+        lock.unlock();
+
+        refreshes++;
+        try {
+            run_flight(refresh.key, refresh.flight, refresh.request, refresh.render, refresh.previous,
+                       refresh.stale_seconds);
+        } catch (const std::exception& e) {
+            std::cerr << "⚠️ Page refresh failed for " << refresh.key << ": " << e.what() << std::endl;
+        }
+
+        lock.lock();
+    }
+}
+
+void RenderCache::shutdown() {
+    std::deque<Refresh> dropped;
+    bool was_stopping;
+    {
+        std::lock_guard<std::mutex> lock(refresh_mutex);
+        was_stopping = stopping;
+        stopping = true;
+        dropped.swap(refresh_queue);
+    }
+    refresh_cv.notify_all();
+    if (refresher.joinable()) refresher.join();
+
+    // Anyone waiting on a dropped refresh renders for itself
+    for (Refresh& refresh : dropped) {
+        finish(refresh.key, refresh.flight, nullptr);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(checkpointer_mutex);
+        checkpointer_stopping = true;
+    }
+    checkpointer_cv.notify_all();
+    if (checkpointer.joinable()) checkpointer.join();
+    if (!was_stopping && !snapshot_path.empty()) {
+        std::string err;
+        if (checkpoint(&err)) {
+            std::cout << "💾 Page cache saved to " << snapshot_path << std::endl;
+        } else {
+            std::cerr << "⚠️ Page cache not saved: " << err << std::endl;
+        }
+    }
+}
+
+// ---------------- Snapshots -----------------
+
+void RenderCache::enable_snapshots(const std::string& path, std::chrono::seconds interval, StampSource stamp) {
+    snapshot_path = path;
+    checkpoint_interval = interval;
+    this->stamp = std::move(stamp);
+
+    // The stamp vouches for the snapshot as of now. A restored page is
+    // current only if nothing changed since; after any change it is kept
+    // as outdated rather than checked scope by scope.
+    uint64_t opened = version("");
+    std::string label = this->stamp();
+    std::string err;
+    auto adopt = [version = version, opened](CacheEntry& entry) {
+        entry.version = version("") == opened ? version(page_key(entry.key)) : 0;
+    };
+    if (label.empty()) {
+        std::cerr << "⚠️ Page cache snapshot skipped: catalog stamp unavailable" << std::endl;
+    } else if (version("") == opened && cache.open_snapshot(path, label, adopt, &err)) {
+        std::cout << "💾 Page cache snapshot opened: " << cache.snapshot_entries() << " pages from " << path
+                  << std::endl;
+    } else if (!err.empty()) {
+        std::cout << "💾 Page cache starts cold: " << err << std::endl;
+    }
+
+    if (interval.count() > 0) {
+        checkpointer = std::thread([this]() { checkpoint_loop(); });
+    }
+}
+
+bool RenderCache::checkpoint(std::string* err) {
+    if (snapshot_path.empty()) {
+        if (err) *err = "snapshots are not enabled";
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(checkpoint_mutex);
+    // Only pages current when the stamp was taken match the label; if the
+    // catalog moved while they were written, the file may hold newer ones
+    uint64_t before = version("");
+    std::string label = stamp();
+    if (label.empty()) {
+        if (err) *err = "catalog stamp unavailable";
+        return false;
+    }
+    bool saved = version("") == before &&
+                 cache.save_snapshot(snapshot_path, label, [this](const CacheEntry& entry) {
+                     return entry.version == version(page_key(entry.key));
+                 }, err);
+    if (saved && version("") == before) return true;
+    if (saved) std::remove(snapshot_path.c_str());
+    if (err && (saved || err->empty())) *err = "catalog changed during checkpoint";
+    return false;
+}
+
+void RenderCache::checkpoint_loop() {
+    std::unique_lock<std::mutex> lock(checkpointer_mutex);
+    while (true) {
+        if (checkpointer_cv.wait_for(lock, checkpoint_interval, [this] { return checkpointer_stopping; })) {
+            return;
+        }
+        lock.unlock();
+        std::string err;
+        if (!checkpoint(&err)) {
+            std::cerr << "⚠️ Page cache checkpoint failed: " << err << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+RenderCacheStats RenderCache::stats() const {
+    RenderCacheStats stats;
+    stats.hits = hits.load(std::memory_order_relaxed);
+    stats.stale = stale.load(std::memory_order_relaxed);
+    stats.coalesced = coalesced.load(std::memory_order_relaxed);
+    stats.misses = misses.load(std::memory_order_relaxed);
+    stats.refreshes = refreshes.load(std::memory_order_relaxed);
+    stats.encoded = encoded.load(std::memory_order_relaxed);
+    stats.encodings = encodings.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "rangoons.h"
+#include "compression.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// Full-page cache for cacheable routes. A page is stored with the catalog
+// version it was rendered from and served until that version moves on, so
+// a product write invalidates the pages that could show it without the
+// cache having to know which did: the version source decides how finely
+// versions are scoped (see page_version()). The TTL only bounds how long
+// an unchanged catalog keeps a page.
+//
+// Renders are single-flight per key: when a page is missing, the first
+// request renders it and concurrent requests for the same key wait for
+// that result instead of running the same query. A page past its TTL but
+// inside its route's stale window is served as-is while one background
+// refresh re-renders it. Pages from an older catalog version are never
+// served stale.
+//
+// With snapshots enabled, current pages are checkpointed to a file every
+// interval and on shutdown, and the next process maps that file and
+// restores pages as they are asked for. catalog_version() starts over in
+// every process, so a snapshot is labelled with a stamp of the catalog's
+// contents instead and only opened when the catalog still matches.
+//
+// Compressed copies of a page are cached beside it, under the page's key
+// plus the coding, so their bytes are charged and evicted like any other
+// entry. Each is compressed the first time a client asks for that coding
+// and then served as-is until the page's ETag changes.
+
+struct RenderCacheStats {
+    uint64_t hits = 0;
+    uint64_t stale = 0;      // served past the TTL while refreshing
+    uint64_t coalesced = 0;  // waited for another request's render
+    uint64_t misses = 0;     // rendered by this request
+    uint64_t refreshes = 0;  // background re-renders run
+    uint64_t encoded = 0;    // served from a stored compressed copy
+    uint64_t encodings = 0;  // compressed copies made
+};
+
+class RenderCache {
+public:
+    // Version of the data the page under a key was rendered from; a page
+    // is current while it has not moved. version("") must move with any
+    // change at all.
+    using VersionSource = std::function<uint64_t(const std::string& key)>;
+    // Called on the request's thread, or later on the refresh thread with a
+    // copy of the request, so it must not capture per-request state
+    using Renderer = std::function<HttpResponse(const HttpRequest&)>;
+    // Identifies the catalog's contents across restarts; empty on error
+    using StampSource = std::function<std::string()>;
+
+    enum class Outcome { Hit, Stale, Coalesced, Miss };
+
+    // Pages live for config.edge_cache_ttl_seconds and are compressed by
+    // config's compression settings
+    RenderCache(EdgeCache& cache, VersionSource version, const Config& config);
+    ~RenderCache();
+    RenderCache(const RenderCache&) = delete;
+    RenderCache& operator=(const RenderCache&) = delete;
+
+    // The cached page for request when it is current, otherwise render()'s
+    // response, stored when it is storable. stale_seconds is the route's
+    // stale window. Sets X-Cache to HIT, STALE or MISS. Stored pages carry
+    // an ETag and Last-Modified; a cached one the request's validators
+    // match is answered 304 without copying the body. Stored pages go out
+    // already encoded for the request's Accept-Encoding.
+    HttpResponse serve(const HttpRequest& request, const Renderer& render, int stale_seconds = 0,
+                       Outcome* outcome = nullptr);
+
+    // Open path's snapshot if it matches the catalog, then checkpoint to
+    // it every interval. Call once, before serving.
+    void enable_snapshots(const std::string& path, std::chrono::seconds interval, StampSource stamp);
+
+    // Save the pages of the current catalog version now; false with err
+    // when it could not be written or the catalog moved on meanwhile
+    bool checkpoint(std::string* err = nullptr);
+
+    // Stop the refresh and checkpoint threads, then checkpoint once more;
+    // queued refreshes are dropped. Call before anything the renderers or
+    // the stamp source use is torn down.
+    void shutdown();
+
+    RenderCacheStats stats() const;
+
+    // Key request's page is cached under: path plus sorted query parameters
+    static std::string key_for(const HttpRequest& request);
+
+    // Only the body, its type and its validators are kept, so anything
+    // personal or encoded stays out of the cache
+    static bool is_storable(const HttpResponse& response);
+
+private:
+    struct Flight;
+
+    struct Refresh {
+        std::string key;
+        std::shared_ptr<Flight> flight;
+        HttpRequest request;
+        Renderer render;
+        std::shared_ptr<const CacheEntry> previous;
+        int stale_seconds;
+    };
+
+    EdgeCache& cache;
+    VersionSource version;
+    Config config;
+    int ttl_seconds;
+
+    // Renders in progress, by cache key
+    std::mutex flights_mutex;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights;
+
+    // Background refreshes run one at a time, so revalidation never adds
+    // more than one query to the database's load
+    std::mutex refresh_mutex;
+    std::condition_variable refresh_cv;
+    std::deque<Refresh> refresh_queue;
+    std::thread refresher; // started on the first refresh
+    bool stopping = false;
+
+    // Checkpoints; snapshot_path is empty while disabled
+    std::string snapshot_path;
+    StampSource stamp;
+    std::chrono::seconds checkpoint_interval{0};
+    std::mutex checkpoint_mutex; // one writer of the file at a time
+    std::mutex checkpointer_mutex;
+    std::condition_variable checkpointer_cv;
+    std::thread checkpointer;
+    bool checkpointer_stopping = false;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> stale{0};
+    std::atomic<uint64_t> coalesced{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> refreshes{0};
+    std::atomic<uint64_t> encoded{0};
+    std::atomic<uint64_t> encodings{0};
+
+    HttpResponse cached_response(const HttpRequest& request, const std::string& key, const CacheEntry& entry,
+                                 const char* status);
+    // Compressed copy of page's body in the coding request prefers, made
+    // and stored on first use; null when identity is preferred or
+    // compression does not pay off
+    std::shared_ptr<const CacheEntry> variant(const HttpRequest& request, const std::string& key,
+                                              std::string_view body, const CacheEntry& page, ContentCoding* coding);
+    // Encode a freshly rendered, stored page for request
+    void encode(const HttpRequest& request, const std::string& key, HttpResponse& response,
+                uint64_t page_version, int stale_seconds);
+    // previous: the entry being replaced, if any
+    HttpResponse run_flight(const std::string& key, const std::shared_ptr<Flight>& flight,
+                            const HttpRequest& request, const Renderer& render,
+                            const std::shared_ptr<const CacheEntry>& previous, int stale_seconds);
+    void finish(const std::string& key, const std::shared_ptr<Flight>& flight,
+                std::shared_ptr<const HttpResponse> response);
+    // Adds the page's validators to response and stores it, when storable
+    void store(const std::string& key, HttpResponse& response, uint64_t page_version,
+               const std::shared_ptr<const CacheEntry>& previous, int stale_seconds);
+    void schedule_refresh(const std::string& key, const HttpRequest& request, const Renderer& render,
+                          const std::shared_ptr<const CacheEntry>& stale_entry, int stale_seconds);
+    void refresh_loop();
+    void checkpoint_loop();
+};
@@ -0,0 +1,232 @@
+#include "router.h"
+#include <charconv>
+#include <stdexcept>
+
+// ---------------- Trie -----------------
+
+namespace {
+
+struct Endpoint {
+    std::string method;
+    RouteHandler handler;
+    RouteInfo info;
+};
+
+}
+
+// A node owns the literal text on the edge into it. Literal children are
+// told apart by their first byte; a parameter child consumes one segment.
+struct Router::Node {
+    std::string prefix;
+    std::vector<std::unique_ptr<Node>> children;
+    std::unique_ptr<Node> int_param;
+    std::unique_ptr<Node> str_param;
+    std::string int_name, str_name;
+    std::vector<Endpoint> endpoints;
+};
+
+using Node = Router::Node;
+
+static size_t common_prefix(std::string_view a, std::string_view b) {
+    size_t n = 0;
+    while (n < a.size() && n < b.size() && a[n] == b[n]) n++;
+    return n;
+}
+
+// Descend through literal text, splitting edges where it diverges
+static Node& insert_literal(Node& node, std::string_view text) {
+    if (text.empty()) return node;
+    for (auto& child : node.children) {
+        if (child->prefix[0] != text[0]) continue;
+        size_t common = common_prefix(child->prefix, text);
+        if (common < child->prefix.size()) {
+            auto split = std::make_unique<Node>();
+            split->prefix = child->prefix.substr(0, common);
+            child->prefix.erase(0, common);
+            split->children.push_back(std::move(child));
+            child = std::move(split);
+        }
+        return insert_literal(*child, text.substr(common));
+    }
+    node.children.push_back(std::make_unique<Node>());
+    node.children.back()->prefix = std::string(text);
+    return *node.children.back();
+}
+
+static bool parse_int(std::string_view s, int& value) {
+    const char* end = s.data() + s.size();
+    auto result = std::from_chars(s.data(), end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+static const Endpoint* find_endpoint(const Node& node, std::string_view method) {
+    for (const Endpoint& endpoint : node.endpoints) {
+        if (endpoint.method == method) return &endpoint;
+    }
+    return nullptr;
+}
+
+// First node, in precedence order, where path ends on a registered pattern.
+// Backtracks out of a branch that dead-ends, so /products/{id:int}/reviews
+// does not hide /products/{handle}/reviews for other ids.
+static const Node* lookup(const Node& node, std::string_view path, RouteParams& params) {
+    if (path.empty()) return node.endpoints.empty() ? nullptr : &node;
+
+    for (const auto& child : node.children) {
+        if (child->prefix[0] != path[0]) continue;
+        if (path.compare(0, child->prefix.size(), child->prefix) == 0) {
+            if (const Node* found = lookup(*child, path.substr(child->prefix.size()), params)) return found;
+        }
+        break; // first bytes are unique among literal children
+    }
+
+    size_t end = path.find('/');
+    std::string_view segment = path.substr(0, end);
+    std::string_view rest = end == std::string_view::npos ? std::string_view() : path.substr(end);
+    if (segment.empty()) return nullptr;
+
+    int value;
+    if (node.int_param && parse_int(segment, value)) {
+        params.add(node.int_name, segment);
+        if (const Node* found = lookup(*node.int_param, rest, params)) return found;
+        params.pop();
+    }
+    if (node.str_param) {
+        params.add(node.str_name, segment);
+        if (const Node* found = lookup(*node.str_param, rest, params)) return found;
+        params.pop();
+    }
+    return nullptr;
+}
+
+// ---------------- RouteParams -----------------
+
+std::string_view RouteParams::get(std::string_view name) const {
+    for (const auto& [key, value] : values) {
+        if (key == name) return value;
+    }
+    return {};
+}
+
+int RouteParams::get_int(std::string_view name) const {
+    int value = 0;
+    parse_int(get(name), value);
+    return value;
+}
+
+// ---------------- Router -----------------
+
+Router::Router() : root(std::make_unique<Node>()) {}
+Router::~Router() = default;
+
+void Router::add(std::string_view method, std::string_view pattern, RouteHandler handler, RouteInfo info) {
+    if (pattern.empty() || pattern[0] != '/') {
+        throw std::invalid_argument("route must start with '/': " + std::string(pattern));
+    }
+
+    Node* node = root.get();
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        size_t open = pattern.find('{', pos);
+        node = &insert_literal(*node, pattern.substr(pos, open - pos));
+        if (open == std::string_view::npos) break;
+
+        size_t close = pattern.find('}', open);
+        if (pattern[open - 1] != '/' || close == std::string_view::npos ||
+            (close + 1 < pattern.size() && pattern[close + 1] != '/')) {
+            throw std::invalid_argument("parameter must be a whole segment: " + std::string(pattern));
+        }
+        std::string_view spec = pattern.substr(open + 1, close - open - 1);
+        size_t colon = spec.find(':');
+        std::string name(spec.substr(0, colon));
+        std::string_view type = colon == std::string_view::npos ? std::string_view() : spec.substr(colon + 1);
+        if (name.empty() || (!type.empty() && type != "int")) {
+            throw std::invalid_argument("bad parameter '" + std::string(spec) + "' in " + std::string(pattern));
+        }
+
+        std::unique_ptr<Node>& child = type.empty() ? node->str_param : node->int_param;
+        std::string& child_name = type.empty() ? node->str_name : node->int_name;
+        if (!child) {
+            child = std::make_unique<Node>();
+            child_name = name;
+        } else if (child_name != name) {
+            throw std::invalid_argument("parameter '" + name + "' conflicts with '" + child_name + "' in " + std::string(pattern));
+        }
+        node = child.get();
+        pos = close + 1;
+    }
+
+    if (find_endpoint(*node, method)) {
+        throw std::invalid_argument("duplicate route " + std::string(method) + " " + std::string(pattern));
+    }
+    node->endpoints.push_back({ std::string(method), std::move(handler), info });
+}
+
+bool Router::match(std::string_view method, std::string_view path, Match& match) const {
+    const Node* node = lookup(*root, path, match.params);
+    if (!node) return false;
+
+    const Endpoint* endpoint = find_endpoint(*node, method);
+    if (!endpoint && method == "HEAD") endpoint = find_endpoint(*node, "GET");
+    if (endpoint) {
+        match.handler = &endpoint->handler;
+        match.info = &endpoint->info;
+        return true;
+    }
+
+    for (const Endpoint& e : node->endpoints) {
+        if (!match.allow.empty()) match.allow += ", ";
+        match.allow += e.method;
+        if (e.method == "GET" && !find_endpoint(*node, "HEAD")) match.allow += ", HEAD";
+    }
+    return true;
+}
+
+const RouteInfo* Router::find(std::string_view method, std::string_view path) const {
+    Match m;
+    return match(method, path, m) ? m.info : nullptr;
+}
+
+bool Router::authorized(const HttpRequest& request) const {
+    if (admin_key.empty()) return false;
+
+    std::string_view key;
+    auto header = request.headers.find("x-admin-key");
+    if (header != request.headers.end()) {
+        key = header->second;
+    } else {
+        auto param = request.query_params.find("key");
+        if (param != request.query_params.end()) key = param->second;
+    }
+
+    // Constant time in the key's contents
+    if (key.size() != admin_key.size()) return false;
+    unsigned char diff = 0;
+    for (size_t i = 0; i < key.size(); i++) diff |= (unsigned char)(key[i] ^ admin_key[i]);
+    return diff == 0;
+}
+
+bool Router::route(const HttpRequest& request, HttpResponse& response) const {
+    Match m;
+    if (!match(request.method, request.target, m)) return false;
+
+    response = HttpResponse();
+    response.content_type = "text/plain";
+    if (!m.handler) {
+        response.status_code = 405;
+        response.headers["Allow"] = m.allow;
+        response.body = "Method Not Allowed";
+        return true;
+    }
+    if (m.info->auth && !authorized(request)) {
+        response.status_code = 401;
+        response.headers["WWW-Authenticate"] = "X-Admin-Key";
+        response.cache_control = "no-store";
+        response.body = admin_key.empty() ? "Admin access is disabled (ADMIN_KEY not set)" : "Unauthorized";
+        return true;
+    }
+
+    response = (*m.handler)(request, m.params);
+    if (response.cache_control.empty()) response.cache_control = m.info->cache_control;
+    return true;
+}
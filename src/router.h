@@ -0,0 +1,86 @@
+#pragma once
+
+#include "rangoons.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Route table built once at startup: a radix trie over the path, with the
+// handlers for each method stored where a pattern ends. Patterns are
+// literal text plus whole-segment parameters, "{name}" for any segment and
+// "{name:int}" for a decimal integer:
+//
+//     /products/{id:int}      /products/{handle}      /api/cart/{cart_id}
+//
+// Literal edges win over parameters and integer parameters over plain
+// ones, so a lookup walks the path once unless parameters overlap.
+
+// Per-route metadata the server consults around the handler
+struct RouteInfo {
+    bool cacheable = false; // response depends only on the URL; edges and caches may serve it
+    bool priority = false;  // kept answering while load is shed
+    bool auth = false;      // requires the admin key
+    int stale_seconds = 0;  // cacheable: served this long past its TTL while re-rendered
+    std::string cache_control; // default Cache-Control of the route's responses
+};
+
+// Parameters captured by a match. Views point into the request path.
+class RouteParams {
+public:
+    std::string_view get(std::string_view name) const;
+    int get_int(std::string_view name) const; // {name:int} always parses
+
+    void add(std::string_view name, std::string_view value) { values.emplace_back(name, value); }
+    void pop() { values.pop_back(); }
+
+private:
+    std::vector<std::pair<std::string_view, std::string_view>> values;
+};
+
+using RouteHandler = std::function<HttpResponse(const HttpRequest&, const RouteParams&)>;
+
+class Router {
+public:
+    Router();
+    ~Router();
+    Router(const Router&) = delete;
+    Router& operator=(const Router&) = delete;
+
+    // Register handler for method and pattern. Throws std::invalid_argument
+    // on a malformed pattern or a duplicate route, which is a startup bug.
+    void add(std::string_view method, std::string_view pattern, RouteHandler handler, RouteInfo info = {});
+
+    // Key that routes with auth require, sent as an X-Admin-Key header or
+    // ?key= query parameter. Empty locks those routes.
+    void set_admin_key(std::string key) { admin_key = std::move(key); }
+
+    struct Match {
+        const RouteHandler* handler = nullptr; // null: path matched, method did not
+        const RouteInfo* info = nullptr;
+        RouteParams params;
+        std::string allow; // methods the path does accept, for 405
+    };
+
+    // false when no pattern matches path at all. HEAD falls back to GET.
+    bool match(std::string_view method, std::string_view path, Match& match) const;
+
+    // Metadata of the route method and path would run, null when none
+    const RouteInfo* find(std::string_view method, std::string_view path) const;
+
+    // Answer request from the table: the handler's response, 401/403 for
+    // auth routes without the key, 405 when only the method is unknown.
+    // false when no route matches, for the caller's fallback (static files,
+    // 404).
+    bool route(const HttpRequest& request, HttpResponse& response) const;
+
+    struct Node; // trie node, defined in router.cpp
+
+private:
+    std::unique_ptr<Node> root;
+    std::string admin_key;
+
+    bool authorized(const HttpRequest& request) const;
+};
@@ -1,4 +1,10 @@
 #include "rangoons.h"
+#include "http.h"
+#include "event_loop.h"
+#include "catalog_events.h"
+#include "render_cache.h"
+#include "router.h"
+#include "static_files.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -7,6 +13,7 @@
 #else
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #endif
@@ -28,28 +35,14 @@
 // ---------------- Globals -----------------
 static std::unique_ptr<DB> g_db;
 static Config g_config;
+static std::unique_ptr<StaticFiles> g_static_files;
+static Router g_router;
+static std::unique_ptr<EdgeCache> g_page_cache;
+static std::unique_ptr<RenderCache> g_render_cache; // null when edge_cache_size_mb is 0
+static std::unique_ptr<CatalogListener> g_catalog_listener;
 
 // ---------------- Helpers -----------------
 
-// Minimal URL encoder for query strings
-static std::string url_encode(const std::string& s) {
-    std::ostringstream o;
-    o << std::uppercase << std::hex;
-    for (unsigned char c : s) {
-        if ((c >= 'A' && c <= 'Z') ||
-            (c >= 'a' && c <= 'z') ||
-            (c >= '0' && c <= '9') ||
-            c=='-' || c=='_' || c=='.' || c=='~') {
-            o << c;
-        } else if (c == ' ') {
-            o << "%20";
-        } else {
-            o << '%' << std::setw(2) << std::setfill('0') << int(c);
-        }
-    }
-    return o.str();
-}
-
 // Minimal JSON escaper for strings
 static std::string json_escape(const std::string& s) {
     std::string out; out.reserve(s.size()+8);
@@ -81,88 +74,6 @@ static std::string format_price(int price_cents) {
     return oss.str();
 }
 
-// Generate UUID
-static std::string generate_uuid() {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(0, 15);
-    static const char* hex = "0123456789abcdef";
-    
-    std::string uuid = "xxxxxxxx-xxxx-4xxx-yxxx-xxxxxxxxxxxx";
-    for (char& c : uuid) {
-        if (c == 'x') c = hex[dis(gen)];
-        else if (c == 'y') c = hex[dis(gen) & 0x3 | 0x8];
-    }
-    return uuid;
-}
-
-// ---------------- HTTP Parsing -----------------
-
-struct HttpRequest {
-    std::string method;
-    std::string target;
-    std::map<std::string, std::string> headers;
-    std::string body;
-    std::map<std::string, std::string> query_params;
-};
-
-static std::string trim(const std::string& s){
-    size_t a=0,b=s.size();
-    while (a<b && (s[a]==' '||s[a]=='\t'||s[a]=='\r'||s[a]=='\n')) ++a;
-    while (b>a && (s[b-1]==' '||s[b-1]=='\t'||s[b-1]=='\r'||s[b-1]=='\n')) --b;
-    return s.substr(a,b-a);
-}
-
-static std::string tolower_str(std::string v){ for(char& c:v) c=std::tolower((unsigned char)c); return v; }
-
-static bool parse_request(const std::string& raw_request, HttpRequest& request) {
-    std::istringstream ss(raw_request);
-    std::string line;
-    
-    // Parse first line (method, target, version)
-    if (!std::getline(ss, line)) return false;
-    
-    std::istringstream first_line(line);
-    first_line >> request.method >> request.target;
-    
-    // Parse query parameters
-    size_t query_pos = request.target.find('?');
-    if (query_pos != std::string::npos) {
-        std::string query_string = request.target.substr(query_pos + 1);
-        request.target = request.target.substr(0, query_pos);
-        
-        std::istringstream query_ss(query_string);
-        std::string param;
-        while (std::getline(query_ss, param, '&')) {
-            size_t equal_pos = param.find('=');
-            if (equal_pos != std::string::npos) {
-                std::string key = param.substr(0, equal_pos);
-                std::string value = param.substr(equal_pos + 1);
-                request.query_params[url_encode(key)] = url_encode(value);
-            }
-        }
-    }
-    
-    // Parse headers
-    while (std::getline(ss, line) && line != "\r" && line != "") {
-        size_t colon_pos = line.find(':');
-        if (colon_pos != std::string::npos) {
-            std::string key = trim(line.substr(0, colon_pos));
-            std::string value = trim(line.substr(colon_pos + 1));
-            request.headers[tolower_str(key)] = value;
-        }
-    }
-    
-    // Parse body
-    std::stringstream body_ss;
-    while (std::getline(ss, line)) {
-        body_ss << line << "\n";
-    }
-    request.body = body_ss.str();
-    
-    return true;
-}
-
 // ---------------- HTML Generation -----------------
 
 static std::string generate_html_header(const std::string& title) {
@@ -237,7 +148,7 @@ static std::string generate_product_card(const Product& product) {
                 <h3 class="product-title">)" << product.title << R"(</h3>
                 <div class="product-price">)" << format_price(product.price_cents) << R"(</div>
                 <p class="product-description">)" << (product.description.empty() ? "No description available" : product.description) << R"(</p>
-                <button class="add-to-cart" onclick="addToCart()" data-product-id=")" << product.id << R"(" data-price=")" << product.price_cents << R"(">🛒 Add to Cart</button>
+                <button class="add-to-cart" onclick='addToCart()' data-product-id=")" << product.id << R"(" data-price=")" << product.price_cents << R"(">🛒 Add to Cart</button>
             </div>
         </div>
     )";
@@ -451,17 +362,195 @@ static HttpResponse handle_status() {
     return response;
 }
 
+static HttpResponse handle_not_found() {
+    HttpResponse response;
+    response.status_code = 404;
+    response.content_type = "text/html";
+    response.body = R"(
+            <!DOCTYPE html>
+            <html>
+            <head><title>404 Not Found</title></head>
+            <body>
+                <h1>404 - Page Not Found</h1>
+                <p>The requested page could not be found.</p>
+                <a href="/">Go Home</a>
+            </body>
+            </html>
+        )";
+    return response;
+}
+
+static HttpResponse handle_product_detail(const Product& product) {
+    if (product.id == 0) return handle_not_found();
+
+    HttpResponse response;
+    response.content_type = "text/html";
+
+    std::ostringstream html;
+    html << generate_html_header(product.title);
+    html << R"(
+        <div class="products-grid">
+    )";
+    html << generate_product_card(product);
+    html << R"(
+        </div>
+        <script>
+            function addToCart() {
+                alert('Product added to cart!');
+            }
+        </script>
+    )";
+    html << generate_html_footer();
+    response.body = html.str();
+    return response;
+}
+
+static HttpResponse handle_product_detail(int id) {
+    return handle_product_detail(g_db->get_product(id));
+}
+
+static std::string product_json(const Product& p) {
+    std::ostringstream json;
+    json << "{";
+    json << "\"id\": " << p.id << ",";
+    json << "\"handle\": \"" << json_escape(p.handle) << "\",";
+    json << "\"title\": \"" << json_escape(p.title) << "\",";
+    json << "\"description\": \"" << json_escape(p.description) << "\",";
+    json << "\"vendor\": \"" << json_escape(p.vendor) << "\",";
+    json << "\"category\": \"" << json_escape(p.category) << "\",";
+    json << "\"sku\": \"" << json_escape(p.sku) << "\",";
+    json << "\"stock\": " << p.stock << ",";
+    json << "\"price_cents\": " << p.price_cents << ",";
+    json << "\"compare_price_cents\": " << p.compare_price_cents << ",";
+    json << "\"image_url\": \"" << json_escape(p.image_url) << "\"";
+    json << "}";
+    return json.str();
+}
+
+static HttpResponse handle_api_product(int id) {
+    HttpResponse response;
+    response.content_type = "application/json";
+
+    Product product = g_db->get_product(id);
+    if (product.id == 0) {
+        response.status_code = 404;
+        response.body = "{\"error\": \"Product not found\"}";
+        return response;
+    }
+    response.body = product_json(product);
+    return response;
+}
+
+static HttpResponse handle_api_cart(const std::string& cart_id) {
+    HttpResponse response;
+    response.content_type = "application/json";
+
+    std::string err;
+    std::vector<CartItem> items = g_db->get_cart_items(cart_id, &err);
+    if (!err.empty()) {
+        response.status_code = 500;
+        response.body = "{\"error\": \"" + json_escape(err) + "\"}";
+        return response;
+    }
+
+    std::ostringstream json;
+    json << "{\"cart_id\": \"" << json_escape(cart_id) << "\", \"items\": [";
+    for (size_t i = 0; i < items.size(); i++) {
+        if (i > 0) json << ",";
+        json << "{\"product_id\": " << items[i].product_id
+             << ", \"qty\": " << items[i].qty
+             << ", \"selected_options\": " << (items[i].selected_options.empty() ? "{}" : items[i].selected_options)
+             << "}";
+    }
+    json << "]}";
+    response.body = json.str();
+    return response;
+}
+
+// ---------------- Dispatch -----------------
+
+// Static routes, product pages and the JSON API. Everything else falls
+// through to config.static_root, then 404.
+static void build_routes(Router& router) {
+    // Pages may be stored anywhere but are revalidated on every use, which
+    // the ETag turns into a 304 while the catalog is unchanged
+    RouteInfo cacheable;
+    cacheable.cacheable = true;
+    cacheable.cache_control = "public, no-cache";
+    RouteInfo priority;
+    priority.priority = true;
+    priority.cache_control = "no-store";
+    RouteInfo admin;
+    admin.auth = true;
+    admin.cache_control = "no-store";
+    // Dashboards poll these; unchanged payloads come back as 304s
+    RouteInfo polled;
+    polled.cache_control = "no-cache";
+    // Past its TTL a listing is served for up to this long while it is
+    // re-rendered in the background
+    RouteInfo listing = cacheable;
+    listing.stale_seconds = 30;
+
+    auto page = [](HttpResponse (*handler)()) {
+        return [handler](const HttpRequest&, const RouteParams&) { return handler(); };
+    };
+
+    router.add("GET", "/", page(handle_home), listing);
+    router.add("GET", "/home", page(handle_home), listing);
+    router.add("GET", "/products", page(handle_products), listing);
+    router.add("GET", "/products/{id:int}", [](const HttpRequest&, const RouteParams& params) {
+        return handle_product_detail(params.get_int("id"));
+    }, cacheable);
+    router.add("GET", "/products/{handle}", [](const HttpRequest&, const RouteParams& params) {
+        return handle_product_detail(g_db->get_product_by_handle(std::string(params.get("handle"))));
+    }, cacheable);
+    router.add("GET", "/admin", page(handle_admin), admin);
+    router.add("GET", "/health", page(handle_health), priority);
+    router.add("GET", "/status", page(handle_status), polled);
+    router.add("GET", "/api/products/{id:int}", [](const HttpRequest&, const RouteParams& params) {
+        return handle_api_product(params.get_int("id"));
+    }, cacheable);
+    router.add("GET", "/api/cart/{cart_id}", [](const HttpRequest&, const RouteParams& params) {
+        return handle_api_cart(std::string(params.get("cart_id")));
+    }, priority);
+    router.set_admin_key(g_config.admin_key);
+}
+
+static HttpResponse dispatch_request(const HttpRequest& request) {
+    // Storefront pages are rendered once per catalog version
+    const RouteInfo* info = g_render_cache ? g_router.find(request.method, request.target) : nullptr;
+    if (info && info->cacheable && (request.method == "GET" || request.method == "HEAD")) {
+        return g_render_cache->serve(request, [](const HttpRequest& req) {
+            HttpResponse response;
+            g_router.route(req, response);
+            return response;
+        }, info->stale_seconds);
+    }
+    
+    HttpResponse response;
+    if (g_router.route(request, response)) {
+        // Matched a route (or answered 401/405 for it)
+    } else if (g_static_files && g_static_files->serve(request, response)) {
+        // File under config.static_root
+    } else {
+        response = handle_not_found();
+    }
+    return response;
+}
+
 // ---------------- Main Server Function -----------------
 
 int run_server(const Config& config) {
     g_config = config;
+    g_static_files = std::make_unique<StaticFiles>(config.static_root);
+    build_routes(g_router);
     
     // Initialize database
     g_db = std::make_unique<DB>();
     std::string db_conn_str = config.db_host + ":" + std::to_string(config.db_port) + ":" + 
                               config.db_name + ":" + config.db_user + ":" + config.db_password;
     
-    if (!g_db->open(db_conn_str)) {
+    if (!g_db->open(db_conn_str, config.connection_pool_size, config.db_pool_timeout_ms)) {
         std::cerr << "❌ Failed to connect to database" << std::endl;
         return 1;
     }
@@ -471,6 +560,28 @@ int run_server(const Config& config) {
         return 1;
     }
     
+    if (config.enable_catalog_listener) {
+        std::string err;
+        g_catalog_listener = std::make_unique<CatalogListener>(db_conn_str, g_db->catalog_versions());
+        if (!g_catalog_listener->start(&err)) {
+            std::cerr << "⚠️ Catalog listener not connected, retrying: " << err << std::endl;
+        }
+    }
+    
+    if (config.edge_cache_size_mb > 0) {
+        g_page_cache = std::make_unique<EdgeCache>(
+            config.edge_cache_size_mb, 16,
+            config.edge_cache_policy == "lru" ? EdgeCachePolicy::Lru : EdgeCachePolicy::TinyLfu);
+        g_render_cache = std::make_unique<RenderCache>(
+            *g_page_cache, [](const std::string& key) { return page_version(g_db->catalog_versions(), key); },
+            config);
+        if (!config.cache_snapshot_path.empty()) {
+            g_render_cache->enable_snapshots(config.cache_snapshot_path,
+                                             std::chrono::seconds(config.cache_snapshot_interval_seconds),
+                                             [] { return g_db->catalog_stamp(); });
+        }
+    }
+    
     // Initialize networking
     #ifdef _WIN32
     WSADATA wsaData;
@@ -491,6 +602,10 @@ int run_server(const Config& config) {
     int opt = 1;
     setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
     
+    // Accepted sockets inherit this; HTTP/2 interleaves small frames with
+    // large ones and must not wait on Nagle
+    setsockopt(server_socket, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(opt));
+    
     // Bind socket
     struct sockaddr_in server_addr;
     server_addr.sin_family = AF_INET;
@@ -503,7 +618,7 @@ int run_server(const Config& config) {
     }
     
     // Listen for connections
-    if (listen(server_socket, 10) < 0) {
+    if (listen(server_socket, SOMAXCONN) < 0) {
         std::cerr << "❌ Failed to listen on socket" << std::endl;
         return 1;
     }
@@ -512,92 +627,38 @@ int run_server(const Config& config) {
     std::cout << "🌐 Access your website at: http://localhost:" << config.port << std::endl;
     std::cout << "📊 Admin panel: http://localhost:" << config.port << "/admin" << std::endl;
     
-    // Main server loop
+    #ifdef _WIN32
+    // Blocking fallback: one request per connection
     while (true) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        
-        int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &client_len);
-        if (client_socket < 0) {
-            std::cerr << "❌ Failed to accept connection" << std::endl;
-            continue;
-        }
-        
-        // Read request
+        int client_socket = accept(server_socket, nullptr, nullptr);
+        if (client_socket < 0) continue;
+
+        // A client that connects and sends nothing must not block the loop
+        DWORD timeout_ms = (DWORD)config.header_timeout * 1000;
+        setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout_ms, sizeof(timeout_ms));
+
         char buffer[4096];
         int bytes_read = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-        if (bytes_read <= 0) {
-            #ifdef _WIN32
-            closesocket(client_socket);
-            #else
-            close(client_socket);
-            #endif
-            continue;
-        }
-        
-        buffer[bytes_read] = '\0';
-        std::string request_str(buffer);
-        
-        // Parse request
         HttpRequest request;
-        if (!parse_request(request_str, request)) {
-            #ifdef _WIN32
-            closesocket(client_socket);
-            #else
-            close(client_socket);
-            #endif
-            continue;
-        }
-        
-        // Handle request
-        HttpResponse response;
-        if (request.target == "/" || request.target == "/home") {
-            response = handle_home();
-        } else if (request.target == "/products") {
-            response = handle_products();
-        } else if (request.target == "/admin") {
-            response = handle_admin();
-        } else if (request.target == "/health") {
-            response = handle_health();
-        } else if (request.target == "/status") {
-            response = handle_status();
-        } else {
-            // 404 Not Found
-            response.status_code = 404;
-            response.content_type = "text/html";
-            response.body = R"(
-                <!DOCTYPE html>
-                <html>
-                <head><title>404 Not Found</title></head>
-                <body>
-                    <h1>404 - Page Not Found</h1>
-                    <p>The requested page could not be found.</p>
-                    <a href="/">Go Home</a>
-                </body>
-                </html>
-            )";
+        if (bytes_read > 0 && parse_request(std::string(buffer, bytes_read), request)) {
+            std::string response_str = build_response(dispatch_request(request));
+            send(client_socket, response_str.c_str(), (int)response_str.length(), 0);
         }
-        
-        // Build response
-        std::ostringstream response_stream;
-        response_stream << "HTTP/1.1 " << response.status_code << " OK\r\n";
-        response_stream << "Content-Type: " << response.content_type << "\r\n";
-        response_stream << "Content-Length: " << response.body.length() << "\r\n";
-        response_stream << "Connection: close\r\n";
-        response_stream << "\r\n";
-        response_stream << response.body;
-        
-        std::string response_str = response_stream.str();
-        send(client_socket, response_str.c_str(), response_str.length(), 0);
-        
-        #ifdef _WIN32
         closesocket(client_socket);
-        #else
-        close(client_socket);
-        #endif
     }
+    #else
+    // Main server loop: epoll reactor or io_uring, per config.io_backend
+    raise_fd_limit(config.max_concurrent_connections);
+    auto loop = make_connection_loop(config, dispatch_request);
+    if (!loop->add_listener(server_socket)) {
+        return 1;
+    }
+    loop->run();
+    #endif
     
-    // Cleanup
+    // Cleanup; the page cache saves its last snapshot while the DB is open
+    if (g_render_cache) g_render_cache->shutdown();
+    if (g_catalog_listener) g_catalog_listener->stop();
     #ifdef _WIN32
     closesocket(server_socket);
     WSACleanup();
@@ -0,0 +1,168 @@
+#include "static_files.h"
+#include "compression.h"
+#include "http.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+
+static const char* content_type_for(const std::string& path) {
+    static const std::pair<const char*, const char*> types[] = {
+        { ".html", "text/html; charset=utf-8" },
+        { ".htm", "text/html; charset=utf-8" },
+        { ".css", "text/css; charset=utf-8" },
+        { ".js", "application/javascript; charset=utf-8" },
+        { ".json", "application/json" },
+        { ".txt", "text/plain; charset=utf-8" },
+        { ".svg", "image/svg+xml" },
+        { ".png", "image/png" },
+        { ".jpg", "image/jpeg" },
+        { ".jpeg", "image/jpeg" },
+        { ".gif", "image/gif" },
+        { ".webp", "image/webp" },
+        { ".ico", "image/x-icon" },
+        { ".woff2", "font/woff2" },
+        { ".woff", "font/woff" },
+        { ".webmanifest", "application/manifest+json" },
+    };
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || path.find('/', dot) != std::string::npos) return nullptr;
+    std::string ext = Utils::tolower_str(path.substr(dot));
+    for (const auto& type : types) {
+        if (ext == type.first) return type.second;
+    }
+    return nullptr;
+}
+
+// Only plain paths below root: no dot segments (which also hides
+// dotfiles), backslashes or NULs
+static bool safe_path(const std::string& path) {
+    if (path.empty() || path[0] != '/') return false;
+    size_t start = 1;
+    while (start <= path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos) end = path.size();
+        if (end > start && path[start] == '.') return false;
+        start = end + 1;
+    }
+    return path.find('\\') == std::string::npos && path.find('\0') == std::string::npos;
+}
+
+// Strong validator: changes whenever the file is replaced or rewritten
+static std::string make_etag(const struct stat& st) {
+    char buf[80];
+    snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx\"", (unsigned long)st.st_ino, (unsigned long)st.st_size,
+             (unsigned long)(st.st_mtim.tv_sec * 1000000000L + st.st_mtim.tv_nsec));
+    return buf;
+}
+
+StaticFiles::StaticFiles(std::string root, size_t max_entries)
+    : root(std::move(root)), max_entries(max_entries) {
+    while (this->root.size() > 1 && this->root.back() == '/') this->root.pop_back();
+}
+
+bool StaticFiles::serve(const HttpRequest& request, HttpResponse& response) {
+    if (request.method != "GET" && request.method != "HEAD") return false;
+
+    std::string path = request.target;
+    if (!path.empty() && path.back() == '/') path += "index.html";
+    if (!safe_path(path)) return false;
+
+    std::shared_ptr<const Entry> entry = lookup(path);
+    if (!entry) return false;
+
+    const Variant* variant = &entry->variants[Identity];
+    const char* encoding = nullptr;
+    auto accept = request.headers.find("accept-encoding");
+    if (accept != request.headers.end()) {
+        if (entry->variants[Brotli].file && accepts_encoding(accept->second, "br")) {
+            variant = &entry->variants[Brotli];
+            encoding = "br";
+        } else if (entry->variants[Gzip].file && accepts_encoding(accept->second, "gzip")) {
+            variant = &entry->variants[Gzip];
+            encoding = "gzip";
+        }
+    }
+
+    response.status_code = 200;
+    response.content_type = entry->content_type;
+    response.file = variant->file;
+    response.headers["ETag"] = variant->etag;
+    response.headers["Last-Modified"] = entry->last_modified;
+    response.cache_control = "public, max-age=300";
+    if (encoding) response.headers["Content-Encoding"] = encoding;
+    if (entry->variants[Brotli].file || entry->variants[Gzip].file) {
+        response.headers["Vary"] = "Accept-Encoding";
+    }
+    return true;
+}
+
+std::shared_ptr<const StaticFiles::Entry> StaticFiles::lookup(const std::string& path) {
+    time_t now = time(nullptr);
+    std::shared_ptr<const Entry> cached;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = cache.find(path);
+        if (it != cache.end()) cached = it->second;
+    }
+    if (cached && cached->checked.load(std::memory_order_relaxed) == now) return cached;
+
+    struct stat st;
+    std::string full = root + path;
+    if (stat(full.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (cached) {
+            std::lock_guard<std::mutex> lock(mutex);
+            cache.erase(path);
+        }
+        return nullptr;
+    }
+
+    if (cached && cached->inode == st.st_ino && cached->size == st.st_size &&
+        cached->mtime.tv_sec == st.st_mtim.tv_sec && cached->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        cached->checked.store(now, std::memory_order_relaxed);
+        return cached;
+    }
+
+    std::shared_ptr<const Entry> entry = load(path, st);
+    if (!entry) return nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (cache.size() >= max_entries && cache.find(path) == cache.end()) {
+        cache.erase(cache.begin());
+    }
+    cache[path] = entry;
+    return entry;
+}
+
+std::shared_ptr<const StaticFiles::Entry> StaticFiles::load(const std::string& path, const struct stat& st) {
+    const char* content_type = content_type_for(path);
+    if (!content_type) return nullptr;
+
+    auto entry = std::make_shared<Entry>();
+    entry->content_type = content_type;
+    entry->last_modified = http_date(st.st_mtim.tv_sec);
+    entry->inode = st.st_ino;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtim;
+    entry->checked = time(nullptr);
+
+    static const char* suffixes[EncodingCount] = { "", ".br", ".gz" };
+    for (int i = 0; i < EncodingCount; ++i) {
+        std::string full = root + path + suffixes[i];
+        int fd = open(full.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) continue;
+
+        struct stat vst;
+        if (fstat(fd, &vst) != 0 || !S_ISREG(vst.st_mode) ||
+            // A precompressed sibling older than the original is stale
+            (i != Identity && vst.st_mtim.tv_sec < st.st_mtim.tv_sec)) {
+            close(fd);
+            continue;
+        }
+        entry->variants[i].file = std::make_shared<FileBody>(fd, (size_t)vst.st_size);
+        entry->variants[i].etag = make_etag(vst);
+    }
+
+    if (!entry->variants[Identity].file) return nullptr;
+    return entry;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "rangoons.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <atomic>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Serves files under a root directory with sendfile(). Open descriptors and
+// their metadata are cached and re-validated with stat() at most once a
+// second. A sibling "<file>.br" or "<file>.gz" is served instead when the
+// client accepts that encoding.
+class StaticFiles {
+public:
+    explicit StaticFiles(std::string root, size_t max_entries = 1024);
+
+    // Fill response for a GET of a file under root. Returns false when the
+    // path is unsafe or does not name a servable file.
+    bool serve(const HttpRequest& request, HttpResponse& response);
+
+private:
+    enum Encoding { Identity, Brotli, Gzip, EncodingCount };
+
+    struct Variant {
+        std::shared_ptr<FileBody> file;
+        std::string etag;
+    };
+
+    struct Entry {
+        Variant variants[EncodingCount];
+        std::string content_type;
+        std::string last_modified;
+        ino_t inode = 0;
+        off_t size = 0;
+        struct timespec mtime{};
+        mutable std::atomic<time_t> checked{0}; // last stat() of the identity file
+    };
+
+    std::string root;
+    size_t max_entries;
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<const Entry>> cache;
+
+    std::shared_ptr<const Entry> lookup(const std::string& path);
+    std::shared_ptr<const Entry> load(const std::string& path, const struct stat& st);
+};
@@ -0,0 +1,97 @@
+#include "timer_wheel.h"
+
+TimerWheel::TimerWheel(std::chrono::milliseconds resolution)
+    : tick(resolution.count() > 0 ? resolution : std::chrono::milliseconds(1)), origin(Clock::now()) {
+    for (auto& level : slots) {
+        for (Timer& head : level) {
+            head.prev = head.next = &head;
+        }
+    }
+}
+
+uint64_t TimerWheel::tick_at(Clock::time_point t, bool round_up) const {
+    if (t <= origin) return 0;
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t - origin).count();
+    auto per_tick = std::chrono::duration_cast<std::chrono::nanoseconds>(tick).count();
+    return (uint64_t)((elapsed + (round_up ? per_tick - 1 : 0)) / per_tick);
+}
+
+void TimerWheel::arm(Timer& timer, Clock::time_point deadline) {
+    if (timer.armed()) {
+        unlink(timer);
+    } else {
+        armed_count++;
+    }
+    // Never into the slot being processed: the earliest is the next tick
+    timer.expires = std::max(tick_at(deadline, true), current + 1);
+    place(timer);
+}
+
+void TimerWheel::cancel(Timer& timer) {
+    if (!timer.armed()) return;
+    unlink(timer);
+    armed_count--;
+}
+
+void TimerWheel::place(Timer& timer) {
+    uint64_t delta = timer.expires - current;
+    for (int level = 0; level < LEVELS; ++level) {
+        int shift = SLOT_BITS * level;
+        if (delta < (SLOTS << shift) || level == LEVELS - 1) {
+            // Beyond the top level's span: park at its far end, the timer
+            // comes back round and cascades down with a fresh delta
+            uint64_t expires = level == LEVELS - 1 ? std::min(timer.expires, current + (SLOTS << shift) - 1)
+                                                   : timer.expires;
+            link(slots[level][(expires >> shift) & MASK], timer);
+            return;
+        }
+    }
+}
+
+// Step one tick and hand back the timers due on it. Whenever a level's
+// index wraps to zero, the matching slot of the level above is spread over
+// the levels below, starting from the highest level that wrapped.
+void TimerWheel::collect(Timer& due) {
+    due.prev = due.next = &due;
+    current++;
+
+    if ((current & MASK) == 0) {
+        int top = 1;
+        while (top + 1 < LEVELS && ((current >> (SLOT_BITS * top)) & MASK) == 0) top++;
+        for (int level = top; level >= 1; --level) {
+            Timer pending;
+            pending.prev = pending.next = &pending;
+            splice(slots[level][(current >> (SLOT_BITS * level)) & MASK], pending);
+            while (pending.next != &pending) {
+                Timer& timer = *pending.next;
+                unlink(timer);
+                place(timer);
+            }
+        }
+    }
+
+    splice(slots[0][current & MASK], due);
+}
+
+void TimerWheel::link(Timer& head, Timer& timer) {
+    timer.prev = head.prev;
+    timer.next = &head;
+    head.prev->next = &timer;
+    head.prev = &timer;
+}
+
+void TimerWheel::unlink(Timer& timer) {
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    timer.prev = timer.next = nullptr;
+}
+
+// Move every timer on from's list to the (empty) list to
+void TimerWheel::splice(Timer& from, Timer& to) {
+    if (from.next == &from) return;
+    to.next = from.next;
+    to.prev = from.prev;
+    to.next->prev = &to;
+    to.prev->next = &to;
+    from.prev = from.next = &from;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Hierarchical timing wheel (Varghese & Lauck) for connection deadlines.
+// Four levels of 64 slots: the first covers the next 64 ticks one slot per
+// tick, each level above 64 times the span of the one below, and a slot's
+// timers drop a level when the wheel reaches it. Arming and cancelling
+// only relink an intrusive node, so re-arming on every read costs nothing
+// however many connections are open.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Embedded in whatever times out; owner tells the expiry callback whose
+    // deadline it was
+    struct Timer {
+        Timer* prev = nullptr;
+        Timer* next = nullptr;
+        uint64_t expires = 0; // tick
+        void* owner = nullptr;
+
+        bool armed() const { return prev != nullptr; }
+    };
+
+    explicit TimerWheel(std::chrono::milliseconds resolution);
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // (Re)arm timer to fire at the first tick at or after deadline
+    void arm(Timer& timer, Clock::time_point deadline);
+    void cancel(Timer& timer);
+
+    // Run the wheel up to now, calling expire(timer) for every timer that
+    // fell due. expire may arm or cancel any timer, including its own.
+    template <typename Expire>
+    void advance(Clock::time_point now, Expire&& expire) {
+        uint64_t target = tick_at(now, false);
+        if (armed_count == 0) {
+            current = std::max(current, target);
+            return;
+        }
+        while (current < target) {
+            Timer due;
+            collect(due);
+            while (due.next != &due) {
+                Timer& timer = *due.next;
+                unlink(timer);
+                armed_count--;
+                expire(timer);
+            }
+        }
+    }
+
+    size_t size() const { return armed_count; }
+    std::chrono::milliseconds resolution() const { return tick; }
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const uint64_t SLOTS = 1 << SLOT_BITS;
+    static const uint64_t MASK = SLOTS - 1;
+
+    std::chrono::milliseconds tick;
+    Clock::time_point origin;
+    uint64_t current = 0;    // last tick processed
+    size_t armed_count = 0;
+    Timer slots[LEVELS][SLOTS]; // list heads, circular
+
+    uint64_t tick_at(Clock::time_point t, bool round_up) const;
+    void place(Timer& timer);
+    void collect(Timer& due);
+    static void link(Timer& head, Timer& timer);
+    static void unlink(Timer& timer);
+    static void splice(Timer& from, Timer& to);
+};
@@ -0,0 +1,492 @@
+#include "upstream.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+static const size_t MAX_HEAD_BYTES = 64 * 1024;
+static const size_t MAX_BODY_BYTES = 64 * 1024 * 1024;
+
+// ---------------- Helpers -----------------
+
+static std::string lowercase(std::string_view s) {
+    std::string out(s);
+    std::transform(out.begin(), out.end(), out.begin(), [](unsigned char c) { return std::tolower(c); });
+    return out;
+}
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+// Whether comma-separated list has token, case-insensitively
+static bool has_token(std::string_view list, std::string_view token) {
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = trim(list.substr(0, comma));
+        if (item.size() == token.size() && lowercase(item) == token) return true;
+        if (comma == std::string_view::npos) break;
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+// Hop-by-hop headers (RFC 9110 7.6.1) belong to one connection, plus any
+// the Connection header names
+static bool is_hop_by_hop(const std::string& name, std::string_view connection) {
+    static const char* const fixed[] = {
+        "connection", "keep-alive", "proxy-connection", "proxy-authenticate", "proxy-authorization",
+        "te", "trailer", "transfer-encoding", "upgrade", "http2-settings"
+    };
+    for (const char* h : fixed) {
+        if (name == h) return true;
+    }
+    return has_token(connection, name);
+}
+
+static bool wait_fd(int fd, short events, UpstreamPool::Clock::time_point deadline) {
+    for (;;) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - UpstreamPool::Clock::now());
+        if (left.count() <= 0) {
+            errno = ETIMEDOUT;
+            return false;
+        }
+        struct pollfd pfd = { fd, events, 0 };
+        int n = poll(&pfd, 1, (int)std::min<long long>(left.count(), INT32_MAX));
+        if (n > 0) return true;
+        if (n < 0 && errno != EINTR) return false;
+    }
+}
+
+static bool send_all(int fd, std::string_view data, UpstreamPool::Clock::time_point deadline) {
+    while (!data.empty()) {
+        ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+            data.remove_prefix(n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!wait_fd(fd, POLLOUT, deadline)) return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Read more of the response into buf: > 0 bytes read, 0 at EOF, -1 on
+// error or timeout (errno ETIMEDOUT)
+static ssize_t fill(int fd, std::string& buf, UpstreamPool::Clock::time_point deadline) {
+    char chunk[16384];
+    for (;;) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+            buf.append(chunk, n);
+            return n;
+        }
+        if (n == 0) return 0;
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+        if (!wait_fd(fd, POLLIN, deadline)) return -1;
+    }
+}
+
+// Request line, headers and body to send upstream for request
+static std::string serialize_upstream_request(const HttpRequest& request, const std::string& authority) {
+    auto header = [&](const char* name) -> std::string_view {
+        auto it = request.headers.find(name);
+        return it == request.headers.end() ? std::string_view() : std::string_view(it->second);
+    };
+    std::string_view connection = header("connection");
+    std::string_view host = header("host");
+
+    std::string out;
+    out.reserve(512 + request.body.size());
+    out += request.method;
+    out += ' ';
+    out += request.target;
+    if (!request.query.empty()) {
+        out += '?';
+        out += request.query;
+    }
+    out += " HTTP/1.1\r\nHost: ";
+    out += host.empty() ? std::string_view(authority) : host;
+    out += "\r\n";
+
+    for (const auto& [name, value] : request.headers) {
+        if (name == "host" || name == "content-length" || name == "expect" ||
+            name == "x-forwarded-for" || name == "x-forwarded-host" || name == "x-forwarded-proto" || name == "via" ||
+            is_hop_by_hop(name, connection)) {
+            continue;
+        }
+        out += name;
+        out += ": ";
+        out += value;
+        out += "\r\n";
+    }
+
+    std::string_view forwarded_for = header("x-forwarded-for");
+    if (!forwarded_for.empty() || !request.client_ip.empty()) {
+        out += "X-Forwarded-For: ";
+        out += forwarded_for;
+        if (!forwarded_for.empty() && !request.client_ip.empty()) out += ", ";
+        out += request.client_ip;
+        out += "\r\n";
+    }
+    if (!host.empty()) {
+        out += "X-Forwarded-Host: ";
+        out += header("x-forwarded-host").empty() ? host : header("x-forwarded-host");
+        out += "\r\n";
+    }
+    out += "X-Forwarded-Proto: ";
+    out += header("x-forwarded-proto").empty() ? std::string_view("http") : header("x-forwarded-proto");
+    out += "\r\nVia: ";
+    if (!header("via").empty()) {
+        out += header("via");
+        out += ", ";
+    }
+    out += "1.1 rangoons\r\n";
+
+    if (!request.body.empty() || request.method == "POST" || request.method == "PUT" || request.method == "PATCH") {
+        out += "Content-Length: ";
+        out += std::to_string(request.body.size());
+        out += "\r\n";
+    }
+    out += "\r\n";
+    out += request.body;
+    return out;
+}
+
+// ---------------- UpstreamPool -----------------
+
+UpstreamPool::UpstreamPool(std::string host, int port, const Config& config)
+    : upstream_host(std::move(host)),
+      upstream_port(port),
+      authority(upstream_host + ":" + std::to_string(port)),
+      connect_timeout(std::max(config.upstream_connect_timeout_ms, 1)),
+      exchange_timeout(std::max(config.upstream_timeout_ms, 1)),
+      max_idle(std::max(config.upstream_max_idle, 0)) {}
+
+UpstreamPool::~UpstreamPool() {
+    for (int fd : idle) close(fd);
+}
+
+int UpstreamPool::take_idle() {
+    std::lock_guard<std::mutex> lock(idle_mutex);
+    while (!idle.empty()) {
+        int fd = idle.back();
+        idle.pop_back();
+
+        // A parked connection with something to read has been closed (or
+        // broken) by the upstream; it cannot owe us a response
+        char byte;
+        ssize_t n = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return fd;
+        close(fd);
+    }
+    return -1;
+}
+
+void UpstreamPool::release(int fd, bool keep_alive) {
+    if (keep_alive) {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        if (idle.size() < max_idle) {
+            idle.push_back(fd);
+            return;
+        }
+    }
+    close(fd);
+}
+
+int UpstreamPool::connect_upstream(Clock::time_point deadline, std::string* err) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* addrs = nullptr;
+    int rc = getaddrinfo(upstream_host.c_str(), std::to_string(upstream_port).c_str(), &hints, &addrs);
+    if (rc != 0) {
+        if (err) *err = "resolve " + upstream_host + ": " + gai_strerror(rc);
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* ai = addrs; ai && fd == -1; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd == -1) continue;
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        int so_error = errno;
+        if (so_error == EINPROGRESS && wait_fd(fd, POLLOUT, deadline)) {
+            socklen_t len = sizeof(so_error);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &len);
+            if (so_error == 0) break;
+        } else if (so_error == EINPROGRESS) {
+            so_error = ETIMEDOUT;
+        }
+        if (err) *err = "connect " + authority + ": " + strerror(so_error);
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+
+    if (fd != -1) connects.fetch_add(1, std::memory_order_relaxed);
+    return fd;
+}
+
+bool UpstreamPool::exchange(int fd, const std::string& wire, bool head, Clock::time_point deadline,
+                            HttpResponse& response, bool& keep_alive, bool& stale, std::string* err) {
+    keep_alive = false;
+    stale = false;
+    if (!send_all(fd, wire, deadline)) {
+        stale = errno != ETIMEDOUT;
+        if (err) *err = "send to " + authority + (errno == ETIMEDOUT ? " timed out" : " failed");
+        return false;
+    }
+
+    std::string buf;
+    auto fail = [&](const char* what) {
+        if (err) *err = std::string(what) + " from " + authority;
+        return false;
+    };
+    auto more = [&]() { return fill(fd, buf, deadline); };
+
+    // Head, skipping interim 1xx responses
+    int status = 0;
+    std::string version;
+    std::vector<std::pair<std::string, std::string>> headers;
+    size_t pos = 0;
+    for (;;) {
+        size_t end;
+        while ((end = buf.find("\r\n\r\n", pos)) == std::string::npos) {
+            if (buf.size() - pos > MAX_HEAD_BYTES) return fail("oversized response head");
+            ssize_t n = more();
+            if (n > 0) continue;
+            // Closed or reset before a byte of the response: the upstream
+            // dropped the connection while it sat idle
+            stale = buf.empty() && (n == 0 || errno != ETIMEDOUT);
+            if (n == 0) return fail(buf.empty() ? "connection closed" : "truncated response head");
+            return fail(errno == ETIMEDOUT ? "timed out waiting for response" : "error reading response");
+        }
+
+        std::string_view head_block(buf.data() + pos, end - pos);
+        size_t line_end = head_block.find("\r\n");
+        std::string_view status_line = head_block.substr(0, line_end);
+        if (status_line.size() < 12 || status_line.compare(0, 7, "HTTP/1.") != 0 || status_line[8] != ' ') {
+            return fail("malformed status line");
+        }
+        version = std::string(status_line.substr(0, 8));
+        auto parsed = std::from_chars(status_line.data() + 9, status_line.data() + 12, status);
+        if (parsed.ec != std::errc() || parsed.ptr != status_line.data() + 12 || status < 100 || status > 599) {
+            return fail("malformed status line");
+        }
+
+        headers.clear();
+        std::string_view rest = line_end == std::string_view::npos ? std::string_view() : head_block.substr(line_end + 2);
+        while (!rest.empty()) {
+            size_t eol = rest.find("\r\n");
+            std::string_view line = rest.substr(0, eol);
+            size_t colon = line.find(':');
+            if (colon == std::string_view::npos || colon == 0) return fail("malformed header");
+            headers.emplace_back(lowercase(line.substr(0, colon)), std::string(trim(line.substr(colon + 1))));
+            if (eol == std::string_view::npos) break;
+            rest.remove_prefix(eol + 2);
+        }
+
+        pos = end + 4;
+        if (status == 101) return fail("unexpected protocol switch");
+        if (status >= 200) break;
+    }
+
+    std::string connection, transfer_encoding;
+    long long content_length = -1;
+    for (const auto& [name, value] : headers) {
+        if (name == "connection") {
+            connection += value + ",";
+        } else if (name == "transfer-encoding") {
+            transfer_encoding = lowercase(value);
+        } else if (name == "content-length") {
+            long long length = -1;
+            auto parsed = std::from_chars(value.data(), value.data() + value.size(), length);
+            if (parsed.ec != std::errc() || parsed.ptr != value.data() + value.size() ||
+                (content_length != -1 && content_length != length)) {
+                return fail("bad Content-Length");
+            }
+            content_length = length;
+        }
+    }
+    keep_alive = version == "HTTP/1.1" ? !has_token(connection, "close") : has_token(connection, "keep-alive");
+
+    // Body
+    std::string body;
+    bool no_body = head || status == 204 || status == 304;
+    if (no_body) {
+        // Nothing follows the head
+    } else if (!transfer_encoding.empty()) {
+        if (transfer_encoding != "chunked" && !has_token(transfer_encoding, "chunked")) return fail("unsupported Transfer-Encoding");
+        for (;;) {
+            size_t eol;
+            while ((eol = buf.find("\r\n", pos)) == std::string::npos) {
+                if (more() <= 0) return fail("truncated chunked body");
+            }
+            std::string_view size_line(buf.data() + pos, eol - pos);
+            size_line = trim(size_line.substr(0, size_line.find(';')));
+            size_t size = 0;
+            auto parsed = std::from_chars(size_line.data(), size_line.data() + size_line.size(), size, 16);
+            if (size_line.empty() || parsed.ec != std::errc() || parsed.ptr != size_line.data() + size_line.size()) {
+                return fail("bad chunk size");
+            }
+            pos = eol + 2;
+            if (size == 0) break;
+            if (body.size() + size > MAX_BODY_BYTES) return fail("oversized response body");
+            while (buf.size() < pos + size + 2) {
+                if (more() <= 0) return fail("truncated chunked body");
+            }
+            body.append(buf, pos, size);
+            pos += size + 2;
+        }
+        // Trailers, discarded, up to the empty line
+        for (;;) {
+            size_t eol;
+            while ((eol = buf.find("\r\n", pos)) == std::string::npos) {
+                if (more() <= 0) return fail("truncated chunked trailer");
+            }
+            bool last = eol == pos;
+            pos = eol + 2;
+            if (last) break;
+        }
+    } else if (content_length >= 0) {
+        if ((size_t)content_length > MAX_BODY_BYTES) return fail("oversized response body");
+        while (buf.size() - pos < (size_t)content_length) {
+            ssize_t n = more();
+            if (n <= 0) return fail("truncated response body");
+        }
+        body.assign(buf, pos, content_length);
+        pos += content_length;
+    } else {
+        // Delimited by close
+        keep_alive = false;
+        for (;;) {
+            if (buf.size() - pos > MAX_BODY_BYTES) return fail("oversized response body");
+            ssize_t n = more();
+            if (n == 0) break;
+            if (n < 0) return fail(errno == ETIMEDOUT ? "timed out reading response" : "error reading response");
+        }
+        body.assign(buf, pos, std::string::npos);
+        pos = buf.size();
+    }
+    // A response followed by stray bytes leaves the connection out of step
+    if (pos != buf.size()) keep_alive = false;
+
+    response = HttpResponse();
+    response.status_code = status;
+    response.content_type.clear();
+    response.body = std::move(body);
+    // A HEAD answer keeps the length of the body it stands for
+    if (head && content_length > 0) response.content_length = (size_t)content_length;
+    for (auto& [name, value] : headers) {
+        if (is_hop_by_hop(name, connection) || name == "content-length") continue;
+        if (name == "content-type") {
+            response.content_type = std::move(value);
+            continue;
+        }
+        if (name == "content-encoding") response.compressed = true;
+        // Canonical capitalisation, to match locally built responses
+        std::string canonical = name;
+        bool upper = true;
+        for (char& c : canonical) {
+            if (upper) c = (char)std::toupper((unsigned char)c);
+            upper = c == '-';
+        }
+        // Repeated fields are folded; the header map has no room for more
+        // than one Set-Cookie, so only the last of those survives
+        std::string& slot = response.headers[canonical];
+        if (slot.empty() || name == "set-cookie") {
+            slot = std::move(value);
+        } else {
+            slot += ", " + value;
+        }
+    }
+    if (response.content_type.empty()) response.content_type = "application/octet-stream";
+    return true;
+}
+
+bool UpstreamPool::forward(const HttpRequest& request, HttpResponse& response, std::string* err) {
+    requests.fetch_add(1, std::memory_order_relaxed);
+    active.fetch_add(1, std::memory_order_relaxed);
+
+    Clock::time_point deadline = Clock::now() + exchange_timeout;
+    std::string wire = serialize_upstream_request(request, authority);
+    bool head = request.method == "HEAD";
+    bool idempotent = head || request.method == "GET" || request.method == "OPTIONS" ||
+                      request.method == "PUT" || request.method == "DELETE";
+
+    bool ok = false, retry = true;
+    int fd = take_idle();
+    if (fd != -1) {
+        reused.fetch_add(1, std::memory_order_relaxed);
+        bool keep_alive = false, stale = false;
+        ok = exchange(fd, wire, head, deadline, response, keep_alive, stale, err);
+        release(fd, ok && keep_alive);
+        // The upstream may have closed the pooled connection just as we
+        // sent; nothing came back, so the request can go again
+        retry = stale && idempotent;
+    }
+    if (!ok && retry) {
+        fd = connect_upstream(std::min(deadline, Clock::now() + connect_timeout), err);
+        if (fd != -1) {
+            bool keep_alive = false, stale = false;
+            ok = exchange(fd, wire, head, deadline, response, keep_alive, stale, err);
+            release(fd, ok && keep_alive);
+        }
+    }
+
+    if (ok) {
+        failure_streak.store(0, std::memory_order_relaxed);
+    } else {
+        failures.fetch_add(1, std::memory_order_relaxed);
+        failure_streak.fetch_add(1, std::memory_order_relaxed);
+    }
+    active.fetch_sub(1, std::memory_order_relaxed);
+    return ok;
+}
+
+bool UpstreamPool::probe(const std::string& path, std::chrono::milliseconds* elapsed) {
+    HttpRequest request;
+    request.method = "GET";
+    request.target = path;
+    request.headers["host"] = authority;
+
+    auto start = Clock::now();
+    HttpResponse response;
+    bool ok = forward(request, response) && response.status_code >= 200 && response.status_code < 300;
+    if (elapsed) *elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+    return ok;
+}
+
+UpstreamStats UpstreamPool::stats() const {
+    UpstreamStats stats;
+    stats.requests = requests.load(std::memory_order_relaxed);
+    stats.failures = failures.load(std::memory_order_relaxed);
+    stats.connects = connects.load(std::memory_order_relaxed);
+    stats.reused = reused.load(std::memory_order_relaxed);
+    stats.in_flight = active.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(idle_mutex);
+    stats.idle = idle.size();
+    return stats;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "rangoons.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// HTTP/1.1 client side of the edge reverse proxy: one pool of keep-alive
+// connections per upstream. Forwarding blocks the calling thread, which is
+// a handler pool worker, never an event loop; every wait is bounded by the
+// connect and exchange timeouts.
+
+struct UpstreamStats {
+    uint64_t requests = 0;
+    uint64_t failures = 0;  // connect, I/O or protocol errors and timeouts
+    uint64_t connects = 0;  // new connections opened
+    uint64_t reused = 0;    // requests sent on a pooled connection
+    size_t idle = 0;
+    size_t in_flight = 0;
+};
+
+class UpstreamPool {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    UpstreamPool(std::string host, int port, const Config& config);
+    ~UpstreamPool();
+    UpstreamPool(const UpstreamPool&) = delete;
+    UpstreamPool& operator=(const UpstreamPool&) = delete;
+
+    // Send request upstream and read the whole response into response.
+    // Hop-by-hop headers are dropped and X-Forwarded-* added. A pooled
+    // connection the upstream closed meanwhile is retried once on a fresh
+    // one. false on failure, with response untouched and err saying why.
+    bool forward(const HttpRequest& request, HttpResponse& response, std::string* err = nullptr);
+
+    // GET path; true when it answers 2xx within the timeouts
+    bool probe(const std::string& path, std::chrono::milliseconds* elapsed = nullptr);
+
+    // Failures since the last success, for marking the node down
+    int consecutive_failures() const { return failure_streak.load(std::memory_order_relaxed); }
+    size_t in_flight() const { return active.load(std::memory_order_relaxed); }
+    UpstreamStats stats() const;
+
+    const std::string& host() const { return upstream_host; }
+    int port() const { return upstream_port; }
+
+private:
+    std::string upstream_host;
+    int upstream_port;
+    std::string authority; // host:port
+    std::chrono::milliseconds connect_timeout;
+    std::chrono::milliseconds exchange_timeout;
+    size_t max_idle;
+
+    mutable std::mutex idle_mutex;
+    std::vector<int> idle; // most recently used last
+
+    std::atomic<size_t> active{0};
+    std::atomic<int> failure_streak{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> failures{0};
+    std::atomic<uint64_t> connects{0};
+    std::atomic<uint64_t> reused{0};
+
+    int take_idle();
+    void release(int fd, bool keep_alive);
+    int connect_upstream(Clock::time_point deadline, std::string* err);
+
+    // One request/response on fd. stale: it failed because the connection
+    // was closed or reset before any of the response came back.
+    bool exchange(int fd, const std::string& wire, bool head, Clock::time_point deadline,
+                  HttpResponse& response, bool& keep_alive, bool& stale, std::string* err);
+};
@@ -1,4 +1,5 @@
 #include "rangoons.h"
+#include "compression.h"
 #include <sstream>
 #include <iomanip>
 #include <random>
@@ -6,6 +7,11 @@
 #include <ctime>
 #include <algorithm>
 #include <cctype>
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace Utils {
 
@@ -273,4 +279,55 @@ std::string sanitize_filename(const std::string& filename) {
     return result;
 }
 
+// gzip, so the output is usable as a Content-Encoding as-is
+std::string compress_data(const std::string& data) {
+    return gzip_compress(data, 6);
+}
+
+std::string decompress_data(const std::string& compressed_data) {
+    return gzip_decompress(compressed_data);
+}
+
+void set_thread_affinity(std::thread& thread, int cpu_core) {
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu_core, &cpuset);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuset);
+#else
+    (void)thread;
+    (void)cpu_core;
+#endif
+}
+
+int get_cpu_core_count() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 0 ? (int)cores : 1;
+}
+
+// url?k=v&k=v with params in key order (std::map), so the same page asked
+// for with its query parameters shuffled shares one key. '%', '&' and '='
+// inside names and values are escaped to keep distinct params distinct.
+std::string generate_cache_key(const std::string& url, const std::map<std::string, std::string>& params) {
+    auto append_escaped = [](std::string& out, const std::string& s) {
+        for (char c : s) {
+            if (c == '%') out += "%25";
+            else if (c == '&') out += "%26";
+            else if (c == '=') out += "%3D";
+            else out += c;
+        }
+    };
+
+    std::string key = url;
+    char separator = '?';
+    for (const auto& [name, value] : params) {
+        key += separator;
+        append_escaped(key, name);
+        key += '=';
+        append_escaped(key, value);
+        separator = '&';
+    }
+    return key;
+}
+
 } // namespace Utils
@@ -0,0 +1,217 @@
+#include "work_pool.h"
+#include <chrono>
+#include <iostream>
+
+// Set on pool threads so tasks submitted from inside a task go straight to
+// the submitting worker's own deque
+static thread_local WorkStealingPool* current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+// ---------------- Deque -----------------
+
+bool WorkStealingPool::Deque::push(Node* node) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY) return false;
+
+    slots[b & (CAPACITY - 1)].store(node, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+WorkStealingPool::Node* WorkStealingPool::Deque::pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Node* node = slots[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // Last element: race the thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            node = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return node;
+}
+
+WorkStealingPool::Node* WorkStealingPool::Deque::steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) return nullptr;
+
+    Node* node = slots[t & (CAPACITY - 1)].load(std::memory_order_acquire);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed)) {
+        return nullptr; // lost the race to the owner or another thief
+    }
+    return node;
+}
+
+size_t WorkStealingPool::Deque::size() const {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_relaxed);
+    return b > t ? (size_t)(b - t) : 0;
+}
+
+// ---------------- Pool -----------------
+
+WorkStealingPool::WorkStealingPool(size_t num_workers) {
+    if (num_workers == 0) num_workers = 1;
+    for (size_t i = 0; i < num_workers; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < num_workers; ++i) {
+        workers[i]->thread = std::thread([this, i]() { worker_loop(i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    shutdown();
+}
+
+void WorkStealingPool::submit(Task task, size_t hint) {
+    Node* node = new Node{std::move(task), nullptr};
+
+    if (current_pool == this && workers[current_worker]->deque.push(node)) {
+        // Nested submit from a task: stays local, stealable by peers
+    } else {
+        Worker& worker = *workers[hint % workers.size()];
+        // Count first so a concurrent drain never takes the depth below zero
+        worker.inbox_depth.fetch_add(1, std::memory_order_relaxed);
+        node->next = worker.inbox.load(std::memory_order_relaxed);
+        while (!worker.inbox.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                                   std::memory_order_relaxed)) {}
+    }
+
+    // Pairs with the sleepers increment in worker_loop: either the worker
+    // sees the task on its recheck or we see it asleep here
+    if (sleepers.load(std::memory_order_seq_cst) > 0) {
+        std::lock_guard<std::mutex> lock(park_mutex);
+        park_cv.notify_one();
+    }
+}
+
+void WorkStealingPool::shutdown() {
+    if (stopping.exchange(true)) return;
+    {
+        std::lock_guard<std::mutex> lock(park_mutex);
+        park_cv.notify_all();
+    }
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+}
+
+std::vector<WorkStealingPool::WorkerStats> WorkStealingPool::stats() const {
+    std::vector<WorkerStats> result;
+    result.reserve(workers.size());
+    for (const auto& worker : workers) {
+        WorkerStats s;
+        s.queue_depth = worker->deque.size() + worker->inbox_depth.load(std::memory_order_relaxed);
+        s.executed = worker->executed.load(std::memory_order_relaxed);
+        s.steals = worker->steals.load(std::memory_order_relaxed);
+        result.push_back(s);
+    }
+    return result;
+}
+
+void WorkStealingPool::worker_loop(size_t index) {
+    current_pool = this;
+    current_worker = index;
+    Worker& self = *workers[index];
+
+    while (true) {
+        Node* node = find_task(index);
+        if (node) {
+            run(node, self);
+            continue;
+        }
+
+        // Tasks submitted before shutdown() still run
+        if (stopping.load(std::memory_order_acquire) && !has_work()) break;
+
+        std::unique_lock<std::mutex> lock(park_mutex);
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        if (!has_work() && !stopping.load(std::memory_order_acquire)) {
+            // The timeout only guards against a missed notify
+            park_cv.wait_for(lock, std::chrono::milliseconds(50));
+        }
+        sleepers.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    current_pool = nullptr;
+}
+
+WorkStealingPool::Node* WorkStealingPool::find_task(size_t index) {
+    Worker& self = *workers[index];
+
+    if (Node* node = self.deque.pop()) return node;
+    if (move_inbox(self, self) > 0) {
+        if (Node* node = self.deque.pop()) return node;
+    }
+
+    // Steal from the top of each peer's deque, then take over inboxes whose
+    // owner has not drained them because it is busy
+    for (size_t k = 1; k < workers.size(); ++k) {
+        Worker& victim = *workers[(index + k) % workers.size()];
+        if (Node* node = victim.deque.steal()) {
+            self.steals.fetch_add(1, std::memory_order_relaxed);
+            return node;
+        }
+    }
+    for (size_t k = 1; k < workers.size(); ++k) {
+        Worker& victim = *workers[(index + k) % workers.size()];
+        size_t taken = move_inbox(victim, self);
+        if (taken > 0) {
+            self.steals.fetch_add(taken, std::memory_order_relaxed);
+            if (Node* node = self.deque.pop()) return node;
+        }
+    }
+    return nullptr;
+}
+
+// Move every task in from's inbox onto to's deque. Runs on to's thread.
+// The inbox is newest-first, so pushing it in that order leaves the oldest
+// task at the bottom where the owner pops next.
+size_t WorkStealingPool::move_inbox(Worker& from, Worker& to) {
+    Node* list = from.inbox.exchange(nullptr, std::memory_order_acquire);
+    size_t moved = 0;
+    while (list) {
+        Node* next = list->next;
+        list->next = nullptr;
+        if (!to.deque.push(list)) {
+            run(list, to); // deque full: just do the work now
+        }
+        list = next;
+        moved++;
+    }
+    if (moved > 0) from.inbox_depth.fetch_sub(moved, std::memory_order_relaxed);
+    return moved;
+}
+
+bool WorkStealingPool::has_work() const {
+    for (const auto& worker : workers) {
+        if (worker->deque.size() > 0 || worker->inbox.load(std::memory_order_seq_cst)) return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::run(Node* node, Worker& worker) {
+    try {
+        node->task();
+    } catch (const std::exception& e) {
+        std::cerr << "❌ Handler task failed: " << e.what() << std::endl;
+    }
+    delete node;
+    worker.executed.fetch_add(1, std::memory_order_relaxed);
+}
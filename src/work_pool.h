@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing executor for request handlers. Every worker owns a
+// Chase-Lev deque it pops from without locking; idle workers steal from the
+// other end of their peers' deques. Threads outside the pool (the event
+// loops) hand tasks in through a lock-free per-worker inbox, which thieves
+// can also take over wholesale when its owner is stuck in a slow handler.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    struct WorkerStats {
+        size_t queue_depth = 0;  // queued in the deque plus the inbox
+        uint64_t executed = 0;
+        uint64_t steals = 0;     // tasks this worker took from other workers
+    };
+
+    explicit WorkStealingPool(size_t num_workers);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Queue a task. hint picks the inbox for submitters outside the pool,
+    // so each event loop keeps feeding the same worker while it keeps up.
+    void submit(Task task, size_t hint = 0);
+
+    // Run whatever is still queued, then join the workers
+    void shutdown();
+
+    size_t size() const { return workers.size(); }
+    std::vector<WorkerStats> stats() const;
+
+private:
+    struct Node {
+        Task task;
+        Node* next = nullptr;
+    };
+
+    // Fixed-capacity Chase-Lev deque: push/pop by the owner at the bottom,
+    // steal by anyone at the top
+    class Deque {
+    public:
+        static const int64_t CAPACITY = 4096; // power of two
+
+        bool push(Node* node);
+        Node* pop();
+        Node* steal();
+        size_t size() const;
+
+    private:
+        alignas(64) std::atomic<int64_t> top{0};
+        alignas(64) std::atomic<int64_t> bottom{0};
+        std::unique_ptr<std::atomic<Node*>[]> slots{new std::atomic<Node*>[CAPACITY]};
+    };
+
+    struct alignas(64) Worker {
+        Deque deque;
+        alignas(64) std::atomic<Node*> inbox{nullptr}; // LIFO stack, newest first
+        std::atomic<size_t> inbox_depth{0};
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> steals{0};
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> stopping{false};
+
+    // Parking for idle workers only; the task path never takes this lock
+    std::mutex park_mutex;
+    std::condition_variable park_cv;
+    std::atomic<int> sleepers{0};
+
+    void worker_loop(size_t index);
+    Node* find_task(size_t index);
+    size_t move_inbox(Worker& from, Worker& to);
+    bool has_work() const;
+    void run(Node* node, Worker& worker);
+};